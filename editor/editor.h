@@ -20,6 +20,7 @@ void finish_sector(map_data_t *map, editor_state_t *editor);
 bool point_exists(mapvertex_t point, map_data_t *map, int *index);
 int split_linedef(map_data_t *map, int linedef_id, float x, float y);
 editor_state_t *get_editor(void);
+bool update_map_load(game_t *gm);
 
 result_t win_sprite(window_t *win, uint32_t msg, uint32_t wparam, void *lparam);
 
@@ -123,24 +123,20 @@ extern GLuint no_tex;
 //  }
 //}
 
-static void draw_floors_editor(map_data_t const *map) {
-  GLuint tex0_size = glGetUniformLocation(ui_prog, "tex0_size");
-  
-  glUniform4f(ui_prog_color, 1.0f, 1.0f, 1.0f, 1.0f);
-  glBindVertexArray(map->floors.vao);
-  
+static void draw_floors_editor(map_data_t const *map, mat4 mvp) {
+  extern GLuint flat_prog;
+  uint16_t *sectors = malloc(sizeof(uint16_t) * map->num_sectors);
+  if (!sectors) return;
   for (int i = 0; i < map->num_sectors; i++) {
-    if (map->floors.sectors[i].floor.texture) {
-      mapside_texture_t const *tex = map->floors.sectors[i].floor.texture;
-      glBindTexture(GL_TEXTURE_2D, tex->texture);
-      glUniform2f(tex0_size, tex->width, tex->height);
-    } else {
-      glBindTexture(GL_TEXTURE_2D, no_tex);
-    }
-    glDrawArrays(GL_TRIANGLES,
-                 map->floors.sectors[i].floor.vertex_start,
-                 map->floors.sectors[i].floor.vertex_count);
+    sectors[i] = i;
   }
+  
+  glUseProgram(flat_prog);
+  glUniformMatrix4fv(flat_prog_mvp, 1, GL_FALSE, (const float*)mvp);
+  glUniform1i(flat_prog_unlit, true);
+  draw_flat_batch(map, sectors, map->num_sectors, false);
+  glUseProgram(ui_prog);
+  free(sectors);
 }
 
 // Draw walls with different colors based on whether they're one-sided or two-sided
@@ -425,7 +421,7 @@ draw_editor(window_t *win,
   // Draw grid
 //  draw_grid(editor->grid_size, player, 64);
 
-  draw_floors_editor(map);
+  draw_floors_editor(map, mvp);
 
   // Draw existing walls
   draw_walls_editor(editor, map);
@@ -213,6 +213,24 @@ static void hover_vertex(game_t *game, editor_selection_t *hover, float *world)
   }
 }
   
+static void draw_load_progress(window_t *win, game_t const *game) {
+  static char const *stages[] = {
+    [LOAD_PARSING] = "Reading",
+    [LOAD_BUILDING] = "Building",
+    [LOAD_UPLOADING] = "Uploading",
+    [LOAD_FAILED] = "Failed to load",
+    [LOAD_CANCELLED] = "Cancelled loading",
+  };
+  char text[96];
+  snprintf(text, sizeof(text), "%s %s%s", stages[game->load_state], game->mapname,
+           game->loader ? "..." : "");
+  draw_text_small(text, 5, 5, get_sys_color(brDarkEdge));
+  draw_text_small(text, 4, 4, get_sys_color(brTextNormal));
+  if (game->loader) {
+    post_message(win, evPaint, 0, NULL);
+  }
+}
+
 result_t win_editor(window_t *win, uint32_t msg, uint32_t wparam, void *lparam) {
   game_t *game = win->userdata;
   editor_state_t *editor = game ? &game->state : NULL;
@@ -223,11 +241,23 @@ result_t win_editor(window_t *win, uint32_t msg, uint32_t wparam, void *lparam)
       ((game_t *)lparam)->state.window = win;
       return true;
     case evDestroy:
+      release_map_load(game->loader);
       free_map_data(&game->map);
       return true;
     case evPaint:
+      if (!update_map_load(game)) {
+        draw_load_progress(win, game);
+        return true;
+      }
+      update_texture_residency();
       draw_editor(win, &game->map, editor, &game->player);
       return true;
+  }
+  // The map is still being built on the loader thread
+  if (game && game->loader) {
+    return false;
+  }
+  switch (msg) {
     case evMouseMove:
       track_mouse(win);
       editor->hover.type = ObjTypeNone;
@@ -412,6 +442,7 @@ result_t win_editor(window_t *win, uint32_t msg, uint32_t wparam, void *lparam)
             // Rebuild vertex buffers (which will also recompute bboxes)
             build_wall_vertex_buffer(&game->map);
             build_floor_vertex_buffer(&game->map);
+            build_map_nodes(&game->map, NODEBUILD_FAST);
           }
           return true;
       }
@@ -452,6 +483,16 @@ result_t win_editor(window_t *win, uint32_t msg, uint32_t wparam, void *lparam)
             editor->num_draw_points = 0;
           }
           return true;
+        case AX_KEY_B: {
+          // Edits keep fast nodes up to date; this builds the release ones
+          uint32_t start = (uint32_t)axGetMilliseconds();
+          if (build_map_nodes(&game->map, NODEBUILD_THOROUGH)) {
+            conprintf("Built %d nodes, %d subsectors, %d segs in %u ms",
+                      game->map.num_nodes, game->map.num_subsectors, game->map.num_segs,
+                      (uint32_t)axGetMilliseconds() - start);
+          }
+          return true;
+        }
         case AX_KEY_G:
           // Toggle grid size (8, 16, 32, 64, 128)
           editor->grid_size *= 2;
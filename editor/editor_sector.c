@@ -415,6 +415,7 @@ bool set_loop_sector(map_data_t *map, uint16_t sector, uint16_t *vertices, uint1
   // Rebuild vertex buffers (which will also recompute bboxes)
   build_wall_vertex_buffer(map);
   build_floor_vertex_buffer(map);
+  build_map_nodes(map, NODEBUILD_FAST);
   
   return true;
 }
@@ -440,6 +441,7 @@ int split_linedef(map_data_t *map, int linedef_id, float x, float y) {
   linedef->end = vertex;
   
   add_linedef(map, end, vertex, front, back);
+  build_map_nodes(map, NODEBUILD_FAST);
   
   return vertex;
 }
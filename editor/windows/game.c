@@ -1,3 +1,5 @@
+#include <time.h>
+
 #include <cglm/cglm.h>
 #include <cglm/struct.h>
 
@@ -51,33 +53,31 @@ static irect16_t *new_frame(void) {
 void new_map(void) {
   game_t *gm = malloc(sizeof(game_t));
   memset(gm, 0, sizeof(game_t));
-  gm->last_time = (uint32_t)axGetMilliseconds();
+  reset_game_clock(gm);
   show_window(create_window("New map", 0, new_frame(), NULL, win_editor, 0, gm), true);
   init_editor(&gm->state);
   g_game = gm;
 }
 
+// Starts loading a map in the background and opens its editor window
+// right away; the window shows progress until update_map_load finishes.
+// Only one load runs at a time, picking another map aborts the previous one.
 void open_map(const char *mapname) {
-  game_t *gm = malloc(sizeof(game_t));
-  gm->map = load_map(mapname);
-  gm->last_time = (uint32_t)axGetMilliseconds();
-
-  if (gm->map.num_vertices > 0) {
-    print_map_info(&gm->map);
-//    allocate_mapside_textures(&game->map);
-//    allocate_flat_textures(&game->map);
-    init_sky(&gm->map);
-    init_player(&gm->map, &gm->player);
-    build_wall_vertex_buffer(&gm->map);
-    build_floor_vertex_buffer(&gm->map);
-
-    set_editor_camera(&gm->state, gm->player.x, gm->player.y);
-
-    conprintf("Successfully loaded map %s", get_map_name(mapname));
-  } else {
-    conprintf("Failed to load map %s", mapname);
+  if (g_game && g_game->loader) {
+    release_map_load(g_game->loader);
+    g_game->loader = NULL;
+    g_game->load_state = LOAD_CANCELLED;
+    conprintf("Cancelled loading map %s", get_map_name(g_game->mapname));
+    invalidate_window(g_game->state.window);
   }
 
+  game_t *gm = malloc(sizeof(game_t));
+  memset(gm, 0, sizeof(game_t));
+  reset_game_clock(gm);
+  snprintf(gm->mapname, sizeof(gm->mapname), "%s", mapname);
+  gm->loader = start_map_load(mapname);
+  gm->load_state = gm->loader ? LOAD_PARSING : LOAD_FAILED;
+
   init_editor(&gm->state);
 
   show_window(create_window(mapname, 0, new_frame(), NULL, win_editor, 0, gm), true);
@@ -85,6 +85,41 @@ void open_map(const char *mapname) {
   g_game = gm;
 }
 
+// Hands a finished background load over to the game. Returns true once
+// the map is ready to draw and edit.
+bool update_map_load(game_t *gm) {
+  if (!gm->loader) {
+    return gm->load_state == LOAD_READY;
+  }
+  gm->load_state = poll_map_load(gm->loader, &gm->map);
+  switch (gm->load_state) {
+    case LOAD_READY:
+      release_map_load(gm->loader);
+      gm->loader = NULL;
+      print_map_info(&gm->map);
+      prefetch_map_textures(&gm->map);
+      init_sky(&gm->map);
+      init_player(&gm->map, &gm->player);
+      reset_game_clock(gm);
+      set_editor_camera(&gm->state, gm->player.x, gm->player.y);
+      conprintf("Successfully loaded map %s", get_map_name(gm->mapname));
+      return true;
+    case LOAD_FAILED:
+      release_map_load(gm->loader);
+      gm->loader = NULL;
+      conprintf("Failed to load map %s", gm->mapname);
+      return false;
+    case LOAD_CANCELLED:
+      // Not an error, the user picked another map
+      release_map_load(gm->loader);
+      gm->loader = NULL;
+      conprintf("Cancelled loading map %s", get_map_name(gm->mapname));
+      return false;
+    default:
+      return false;
+  }
+}
+
 //#define ISOMETRIC
 
 void get_view_matrix(map_data_t const *map, player_t const *player, float aspect, mat4 out) {
@@ -212,7 +247,9 @@ void draw_dungeon(window_t const *win, bool draw_pixel) {
 
   map_data_t const *map = &game->map;
   mapsector_t const *sector = update_player_height(map, &game->player);
-  player_t *player = &game->player;
+  player_t view;
+  get_view_player(game, &view);
+  player_t *player = &view;
   mat4 mvp;
   
   get_view_matrix(map, player, (float)win->frame.w/(float)win->frame.h, mvp);
@@ -334,7 +371,18 @@ void paint_face(map_data_t *map, bool eyedropper) {
 }
 
 void handle_scroll(int wheel[], map_data_t *map);
-void game_tick(game_t *game);
+
+// Sleeps out the rest of the frame so paints come at most MAX_FPS times
+// a second instead of spinning as fast as the window can be repainted
+static void limit_frame_rate(void) {
+  static uint32_t last_frame = 0;
+  uint32_t elapsed = (uint32_t)axGetMilliseconds() - last_frame;
+  if (elapsed < 1000 / MAX_FPS) {
+    uint32_t wait = 1000 / MAX_FPS - elapsed;
+    nanosleep(&(struct timespec){ wait / 1000, (wait % 1000) * 1000000L }, NULL);
+  }
+  last_frame = (uint32_t)axGetMilliseconds();
+}
 
 result_t win_perf(window_t *win, uint32_t msg, uint32_t wparam, void *lparam);
 result_t win_editor(window_t *win, uint32_t msg, uint32_t wparam, void *lparam);
@@ -353,8 +401,10 @@ result_t win_game(window_t *win, uint32_t msg, uint32_t wparam, void *lparam) {
       return true;
     case evPaint:
       game_tick(game);
+      update_texture_residency();
       draw_dungeon(win, moved);
       if (g_ui_runtime.focused == win) {
+        limit_frame_rate();
         post_message(win, evPaint, wparam, lparam);
       }
       moved = false;
@@ -372,6 +422,11 @@ result_t win_game(window_t *win, uint32_t msg, uint32_t wparam, void *lparam) {
             g_relative_mouse_mode = false;
             set_capture(NULL);
             break;
+          case AX_KEY_B:
+            // Switch visibility engines to compare them on the same view
+            vis_engine = vis_engine == VIS_BSP ? VIS_PORTALS : VIS_BSP;
+            conprintf("Visibility: %s", vis_engine == VIS_BSP ? "BSP" : "portals");
+            break;
           case AX_KEY_W:
           case AX_KEY_UPARROW:
             if (alt) {
@@ -30,7 +30,14 @@ result_t win_perf(window_t *win, uint32_t msg, uint32_t wparam, void *lparam) {
       
       extern int sectors_drawn;
       char sec[64]={0};
-      snprintf(sec, sizeof(sec), "SECTORS: %d", sectors_drawn);
+      snprintf(sec, sizeof(sec), "SECTORS: %d (%s)", sectors_drawn,
+               vis_engine == VIS_BSP ? "BSP" : "PORTALS");
+      
+      lumpcache_stats_t cache;
+      get_lump_cache_stats(&cache);
+      char lumps[64]={0};
+      snprintf(lumps, sizeof(lumps), "LUMPS: %u/%u %zuK",
+               cache.hits, cache.hits + cache.misses, cache.bytes_resident >> 10);
       
       int x = CONSOLE_PADDING;
       int y = CONSOLE_PADDING;
@@ -38,6 +45,7 @@ result_t win_perf(window_t *win, uint32_t msg, uint32_t wparam, void *lparam) {
       // Draw the FPS text
       draw_text_gl3(fps_state.fps_text, x, y, 1.0f);
       draw_text_gl3(sec, x, y+LINE_HEIGHT, 1.0f);
+      draw_text_gl3(lumps, x, y+LINE_HEIGHT*2, 1.0f);
       return true;
     }
   }
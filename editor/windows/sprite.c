@@ -37,14 +37,18 @@ result_t win_sprite(window_t *win, uint32_t msg, uint32_t wparam, void *lparam)
       if (!*win->title) return false;
       if ((spr = find_sprite(win->title))) {
         irect16_t r = fit_sprite(spr, &win->frame);
-        draw_rect(spr->texture, r);
+        draw_sprite_rect(spr, r);
       } else if ((tex = get_flat_texture(win->title))||(tex = get_texture(win->title))) {
+        request_texture_image(tex);
         float scale = fminf(1, fminf(((float)win->frame.w) / tex->width,
                                      ((float)win->frame.h) / tex->height));
         draw_rect(tex->texture, R(win->frame.x+(win->frame.w-tex->width*scale)/2,
                   win->frame.y+(win->frame.h-tex->height*scale)/2,
                   tex->width * scale,
                   tex->height * scale));
+        if (update_texture_residency()) {
+          invalidate_window(win);
+        }
       }
       return true;
     case evLeftButtonUp:
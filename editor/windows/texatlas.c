@@ -208,6 +208,7 @@ void draw_texture_layout(texture_layout_t* layout, mapside_texture_t* textures,
   for (int i = 0; i < layout->num_entries; i++) {
     texture_layout_entry_t* entry = &layout->entries[i];
     mapside_texture_t* tex = &textures[entry->texture_idx];
+    request_texture_image(tex);
     
     // Draw the texture according to its position in the layout
     draw_rect(tex->texture, R(entry->x, entry->y, tex->width * scale, tex->height * scale));
@@ -234,6 +235,7 @@ void draw_texture_layout_with_selection(texture_layout_t* layout,
   for (int i = 0; i < layout->num_entries; i++) {
     texture_layout_entry_t* entry = &layout->entries[i];
     mapside_texture_t* tex = &textures[entry->texture_idx];
+    request_texture_image(tex);
     // Draw the texture
     draw_rect(tex->texture, R(entry->x * scale, entry->y * scale, tex->width * scale, tex->height * scale));
     draw_rect_ex(black_tex, R(entry->x * scale, entry->y * scale, tex->width * scale, tex->height * scale), true, 1);
@@ -366,6 +368,7 @@ result_t win_image(window_t *win, uint32_t msg, uint32_t wparam, void *lparam) {
       win->userdata = lparam;
       return true;
     case evPaint:
+      request_texture_image(tex);
       draw_rect(tex ? tex->texture : 1, R(win->frame.x, win->frame.y, win->frame.w, win->frame.h));
       return true;
   }
@@ -388,6 +391,10 @@ result_t win_textures(window_t *win, uint32_t msg, uint32_t wparam, void *lparam
       return true;
     case evPaint:
       draw_texture_layout_with_selection(udata->layout, udata->cache->textures, udata->cache->selected, SCALE);
+      // Placeholders were drawn for textures requested just now
+      if (update_texture_residency()) {
+        invalidate_window(win);
+      }
       return false;
     case evLeftButtonUp: {
       int texture_idx =
@@ -1,98 +1,342 @@
-#include <OpenGL/gl3.h>
 #include <cglm/cglm.h>
 #include <cglm/struct.h>
-#include <stdbool.h>
-#include "../mapview/map.h"
+#include <mapview/map.h>
+
+// Classic BSP visibility.
+//
+// Walks the node tree front to back from the view point and keeps a list
+// of angular column ranges already covered by solid walls, as Doom's
+// renderer does. Subtrees and segs hidden entirely behind solid walls are
+// skipped, so only what can be seen is handed to the GL path. Columns are
+// spread linearly over the horizontal field of view, which keeps the clip
+// list independent of the window size.
 
 typedef unsigned angle_t;
 
-int      sscount;
-int      linecount;
-int      loopcount;
+// Binary Angle Measurement, BAM.
+#define ANG45     0x20000000u
+#define ANG90     0x40000000u
+#define ANG180    0x80000000u
+
+#define CLIPCOLUMNS 2048
 
-int        viewwidth;
-float      viewx;
-float      viewy;
-float      viewz;
-angle_t    viewangle;
+// Widens the horizontal view cone so walls at the frustum's edges are
+// never clipped too early
+#define CLIPMARGIN (ANG45 / 16)
 
 //
 // ClipWallSegment
 // Clips the given range of columns
 // and includes it in the new clip list.
 //
-typedef  struct
+typedef struct
 {
-  int  first;
+  int first;
   int last;
-  
+
 } cliprange_t;
 
-#define MAXSEGS    32
+// Alternating covered and open ranges can never exceed this
+#define MAXSEGS (CLIPCOLUMNS / 2 + 2)
 
 // newend is one past the last valid seg
-cliprange_t*  newend;
-cliprange_t  solidsegs[MAXSEGS];
+static cliprange_t *newend;
+static cliprange_t solidsegs[MAXSEGS];
+
+static float viewx;
+static float viewy;
+static angle_t viewangle;
+static angle_t clipangle;
+// Set while the view looks steeply up or down and the frustum takes in
+// every heading. Columns cannot wrap around the viewer, so the walk then
+// culls by the frustum alone and nothing is occluded.
+static bool fullview;
+
+// State of the walk in progress
+static map_data_t const *bspmap;
+static viewdef_t const *bspview;
+static void (*add_sector_func)(map_data_t const *, mapsector_t const *, viewdef_t const *);
+static void (*add_side_func)(map_data_t const *, uint16_t, int);
 
-#define FINEANGLES    8192
-#define FINEMASK    (FINEANGLES-1)
+// Linedef sides already handed out this walk, two per linedef; a linedef
+// split into several segs is still drawn once
+static uint32_t *side_stamps = NULL;
+static int num_side_stamps = 0;
+static uint32_t stamp = 0;
 
-// 0x100000000 to 0x2000
-#define ANGLETOFINESHIFT  19
+bool point_in_frustum(vec3 point, vec4 const planes[6]);
 
-angle_t      clipangle;
+static angle_t rad2angle(double angle) {
+  // Fraction of a full turn in [0, 1); go through 64 bits so a value that
+  // rounds up to a whole turn wraps to 0 instead of overflowing
+  double turns = angle / (2.0 * M_PI);
+  turns -= floor(turns);
+  return (angle_t)(uint64_t)(turns * 4294967296.0);
+}
+
+static angle_t R_PointToAngle(float x, float y) {
+  return rad2angle(atan2((double)y - viewy, (double)x - viewx));
+}
+
+// Maps an angle relative to the view direction, within clipangle, to a
+// fractional column. The left edge of the view is column 0.
+static float angle_to_x(angle_t angle) {
+  int64_t offset = (int64_t)clipangle - (int32_t)angle;
+  return (float)((double)offset * CLIPCOLUMNS / (2.0 * clipangle));
+}
 
-// The viewangletox[viewangle + FINEANGLES/4] lookup
-// maps the visible view angles to screen X coordinates,
-// flattening the arc to a flat projection plane.
-// There will be many angles mapped to the same X.
-int      viewangletox[FINEANGLES/2];
+// Finds the horizontal view cone from the inverse view projection
+static void R_SetupFrame(viewdef_t const *viewdef) {
+  static float const corners[4][2] = { { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 } };
+  mat4 inv;
+  glm_mat4_inv((vec4 *)viewdef->mvp, inv);
 
+  viewx = viewdef->viewpos[0];
+  viewy = viewdef->viewpos[1];
 
-#define ANGLE_MAX 0x100000000u  // 2^32
-#define PI 3.14159265358979323846
-#define TWO_PI (2.0 * PI)
-// Binary Angle Measument, BAM.
-#define ANG45      0x20000000
-#define ANG90      0x40000000
-#define ANG180    0x80000000
-#define ANG270    0xc0000000
+  vec4 center = { 0, 0, 1, 1 };
+  glm_mat4_mulv(inv, center, center);
+  viewangle = R_PointToAngle(center[0] / center[3], center[1] / center[3]);
 
+  vec3 up = { viewdef->viewpos[0], viewdef->viewpos[1], viewdef->viewpos[2] + 16 };
+  vec3 down = { viewdef->viewpos[0], viewdef->viewpos[1], viewdef->viewpos[2] - 16 };
+  fullview = point_in_frustum(up, viewdef->frustum) || point_in_frustum(down, viewdef->frustum);
+  if (fullview) {
+    clipangle = ANG180 - 1;
+    return;
+  }
 
-angle_t rad2angle(float angle) {
-  if (angle < 0)
-    angle += TWO_PI;           // normalize to [0, 2PI)
-  
-  // Convert from radians to angle_t (0..0xFFFFFFFF)
-  return (angle_t)(angle * (ANGLE_MAX / TWO_PI));
+  uint32_t widest = 0;
+  for (int i = 0; i < 4; i++) {
+    vec4 corner = { corners[i][0], corners[i][1], 1, 1 };
+    glm_mat4_mulv(inv, corner, corner);
+    int32_t offset = (int32_t)(R_PointToAngle(corner[0] / corner[3], corner[1] / corner[3]) - viewangle);
+    widest = MAX(widest, (uint32_t)(offset < 0 ? -(int64_t)offset : offset));
+  }
+  clipangle = (angle_t)MIN((uint64_t)widest + CLIPMARGIN, ANG180 - 1);
 }
 
-angle_t R_PointToAngle(float x1, float y1, float x2, float y2) {
-  float dx = x2 - x1;
-  float dy = y2 - y1;
-  
-  return rad2angle(atan2f(dy, dx));  // radians, range [-PI, PI]
+//
+// R_ClearClipSegs
+//
+static void R_ClearClipSegs(void)
+{
+  solidsegs[0].first = -0x7fffffff;
+  solidsegs[0].last = -1;
+  solidsegs[1].first = CLIPCOLUMNS;
+  solidsegs[1].last = 0x7fffffff;
+  newend = solidsegs+2;
 }
 
-//#define MAXSEGS    32
+// True once solid walls cover every column
+static bool R_ClipListFull(void)
+{
+  return solidsegs[0].last >= CLIPCOLUMNS - 1;
+}
+
+// Returns true if some column of first..last is not covered yet.
+// Touching ranges are merged, so one range holds any covered span.
+static bool R_RangeVisible(int first, int last)
+{
+  cliprange_t *start = solidsegs;
+  while (start->last < last)
+    start++;
+
+  return first < start->first || last > start->last;
+}
+
+//
+// R_ClipSolidWallSegment
+// Marks columns first..last as covered by a solid wall.
 //
-//// newend is one past the last valid seg
-//cliprange_t*  newend;
-//cliprange_t  solidsegs[MAXSEGS];
+static void R_ClipSolidWallSegment(int first, int last)
+{
+  cliprange_t *next;
+  cliprange_t *start;
+
+  // Find the first range that touches the range
+  //  (adjacent columns are touching).
+  start = solidsegs;
+  while (start->last < first-1)
+    start++;
+
+  if (first < start->first)
+  {
+    if (last < start->first-1)
+    {
+      // Post is entirely visible (above start),
+      //  so insert a new clippost. A full list
+      //  only loses occlusion, never geometry.
+      if (newend == solidsegs + MAXSEGS)
+        return;
+      next = newend;
+      newend++;
+
+      while (next != start)
+      {
+        *next = *(next-1);
+        next--;
+      }
+      next->first = first;
+      next->last = last;
+      return;
+    }
+
+    // Extend the existing post to the left.
+    start->first = first;
+  }
+
+  // Bottom contained in start?
+  if (last <= start->last)
+    return;
+
+  next = start;
+  while (last >= (next+1)->first-1)
+  {
+    next++;
 
-maplinedef_t*    curline;
-mapsidedef_t*    sidedef;
-maplinedef_t*    linedef;
-mapsector_t*  frontsector;
-mapsector_t*  backsector;
+    if (last <= next->last)
+    {
+      // Bottom is contained in next.
+      // Adjust the clip size.
+      start->last = next->last;
+      goto crunch;
+    }
+  }
+
+  // There is a fragment after *next.
+  start->last = last;
+
+  // Remove start+1 to next from the clip list,
+  // because start now covers their area.
+crunch:
+  if (next == start)
+  {
+    // Post just extended past the bottom of one post.
+    return;
+  }
+
+  // Pre-increment, unlike the original, which kept one stale post
+  // after every merge and let the list fill up
+  while (++next != newend)
+  {
+    // Remove a post.
+    *++start = *next;
+  }
+
+  newend = start+1;
+}
 
-enum
+static mapsector_t const *side_sector(uint16_t sidenum)
 {
-  BOXTOP,
-  BOXBOTTOM,
-  BOXLEFT,
-  BOXRIGHT
-};  // bbox coordinates
+  if (sidenum >= bspmap->num_sidedefs)
+    return NULL;
+  uint16_t sector = bspmap->sidedefs[sidenum].sector;
+  return sector < bspmap->num_sectors ? &bspmap->sectors[sector] : NULL;
+}
+
+static void R_AddSide(uint16_t linedef, int side)
+{
+  uint32_t *mark = &side_stamps[linedef * 2 + side];
+  if (*mark == stamp)
+    return;
+  *mark = stamp;
+  add_side_func(bspmap, linedef, side);
+}
+
+//
+// R_AddLine
+// Clips the given seg against the view cone and the solid
+// walls seen so far, and hands its linedef side on if any
+// part of it shows. One-sided walls and closed doors then
+// cover the columns they fill completely.
+//
+static void R_AddLine(mapseg_t const *line)
+{
+  angle_t angle1;
+  angle_t angle2;
+  angle_t span;
+  angle_t tspan;
+
+  if (line->v1 >= bspmap->num_node_vertices || line->v2 >= bspmap->num_node_vertices ||
+      line->linedef >= bspmap->num_linedefs || line->side > 1)
+    return;
+
+  maplinedef_t const *linedef = &bspmap->linedefs[line->linedef];
+  mapsector_t const *frontsector = side_sector(linedef->sidenum[line->side]);
+  mapsector_t const *backsector = side_sector(linedef->sidenum[line->side^1]);
+  // walls are drawn through the front side, so a line without one has none
+  if (!frontsector || !side_sector(linedef->sidenum[0]))
+    return;
+
+  mapvertex_t const *v1 = &bspmap->node_vertices[line->v1];
+  mapvertex_t const *v2 = &bspmap->node_vertices[line->v2];
+
+  angle1 = R_PointToAngle(v1->x, v1->y);
+  angle2 = R_PointToAngle(v2->x, v2->y);
+
+  // Clip to view edges.
+  span = angle1 - angle2;
+
+  // Back side? I.e. backface culling?
+  if (span >= ANG180)
+    return;
+
+  if (fullview)
+  {
+    R_AddSide(line->linedef, line->side);
+    return;
+  }
+
+  angle1 -= viewangle;
+  angle2 -= viewangle;
+
+  tspan = angle1 + clipangle;
+  if (tspan > 2*clipangle)
+  {
+    tspan -= 2*clipangle;
+
+    // Totally off the left edge?
+    if (tspan >= span)
+      return;
+
+    angle1 = clipangle;
+  }
+  tspan = clipangle - angle2;
+  if (tspan > 2*clipangle)
+  {
+    tspan -= 2*clipangle;
+
+    // Totally off the right edge?
+    if (tspan >= span)
+      return;
+
+    angle2 = -clipangle;
+  }
+
+  float x1 = angle_to_x(angle1);
+  float x2 = angle_to_x(angle2);
+
+  // Any column the seg touches may show it
+  int first = (int)floorf(x1);
+  int last = MAX(first, (int)ceilf(x2) - 1);
+  if (!R_RangeVisible(first, last))
+    return;
+
+  R_AddSide(line->linedef, line->side);
+
+  // Single sided line or closed door?
+  if (!backsector ||
+      backsector->ceilingheight <= frontsector->floorheight ||
+      backsector->floorheight >= frontsector->ceilingheight)
+  {
+    // only columns the seg fills completely are covered
+    first = (int)ceilf(x1);
+    last = (int)floorf(x2) - 1;
+    if (first <= last)
+      R_ClipSolidWallSegment(first, last);
+  }
+}
 
 //
 // R_CheckBBox
@@ -100,7 +344,7 @@ enum
 // Returns true
 //  if some part of the bbox might be visible.
 //
-int  checkcoord[12][4] =
+static int const checkcoord[12][4] =
 {
   {3,0,2,1},
   {3,0,2,0},
@@ -115,40 +359,17 @@ int  checkcoord[12][4] =
   {2,1,3,0}
 };
 
-//
-// R_ClearClipSegs
-//
-void R_ClearClipSegs (int width)
+static bool R_CheckBBox(int16_t const *bspcoord)
 {
-  viewwidth = width;
-  solidsegs[0].first = -(0x7fffffff);
-  solidsegs[0].last = -1;
-  solidsegs[1].first = viewwidth;
-  solidsegs[1].last = 0x7fffffff;
-  newend = solidsegs+2;
-}
+  int boxx;
+  int boxy;
+  int boxpos;
+
+  angle_t angle1;
+  angle_t angle2;
+  angle_t span;
+  angle_t tspan;
 
-bool R_CheckBBox (int16_t*  bspcoord)
-{
-  int      boxx;
-  int      boxy;
-  int      boxpos;
-  
-  float    x1;
-  float    y1;
-  float    x2;
-  float    y2;
-  
-  angle_t    angle1;
-  angle_t    angle2;
-  angle_t    span;
-  angle_t    tspan;
-  
-  cliprange_t*  start;
-  
-  int      sx1;
-  int      sx2;
-  
   // Find the corners of the box
   // that define the edges from current viewpoint.
   if (viewx <= bspcoord[BOXLEFT])
@@ -157,109 +378,94 @@ bool R_CheckBBox (int16_t*  bspcoord)
     boxx = 1;
   else
     boxx = 2;
-  
+
   if (viewy >= bspcoord[BOXTOP])
     boxy = 0;
   else if (viewy > bspcoord[BOXBOTTOM])
     boxy = 1;
   else
     boxy = 2;
-  
+
   boxpos = (boxy<<2)+boxx;
   if (boxpos == 5)
     return true;
-  
-  x1 = bspcoord[checkcoord[boxpos][0]];
-  y1 = bspcoord[checkcoord[boxpos][1]];
-  x2 = bspcoord[checkcoord[boxpos][2]];
-  y2 = bspcoord[checkcoord[boxpos][3]];
-  
+
+  if (fullview)
+  {
+    vec3 box[2] = {
+      { bspcoord[BOXLEFT], bspcoord[BOXBOTTOM], -32768 },
+      { bspcoord[BOXRIGHT], bspcoord[BOXTOP], 32767 },
+    };
+    return glm_aabb_frustum(box, (vec4 *)bspview->frustum);
+  }
+
   // check clip list for an open space
-  angle1 = R_PointToAngle (viewx, viewy, x1, y1) - viewangle;
-  angle2 = R_PointToAngle (viewx, viewy, x2, y2) - viewangle;
-  
+  angle1 = R_PointToAngle(bspcoord[checkcoord[boxpos][0]], bspcoord[checkcoord[boxpos][1]]) - viewangle;
+  angle2 = R_PointToAngle(bspcoord[checkcoord[boxpos][2]], bspcoord[checkcoord[boxpos][3]]) - viewangle;
+
   span = angle1 - angle2;
-  
+
   // Sitting on a line?
   if (span >= ANG180)
     return true;
-  
+
   tspan = angle1 + clipangle;
-  
+
   if (tspan > 2*clipangle)
   {
     tspan -= 2*clipangle;
-    
+
     // Totally off the left edge?
     if (tspan >= span)
       return false;
-    
+
     angle1 = clipangle;
   }
   tspan = clipangle - angle2;
   if (tspan > 2*clipangle)
   {
     tspan -= 2*clipangle;
-    
-    // Totally off the left edge?
+
+    // Totally off the right edge?
     if (tspan >= span)
       return false;
-    
-    angle2 = (clipangle * -1);
-  }
-  
-  // Find the first clippost
-  //  that touches the source post
-  //  (adjacent pixels are touching).
-  sx1 = viewangletox[(angle1+ANG90)>>ANGLETOFINESHIFT];
-  sx2 = viewangletox[(angle2+ANG90)>>ANGLETOFINESHIFT];
-  
-  // Does not cross a pixel.
-  if (sx1 == sx2)
-    return false;
-  sx2--;
-  
-  start = solidsegs;
-  while (start->last < sx2)
-    start++;
-  
-  if (sx1 >= start->first
-      && sx2 <= start->last)
-  {
-    // The clippost contains the new span.
-    return false;
+
+    angle2 = -clipangle;
   }
-  
-  return true;
+
+  int sx1 = (int)floorf(angle_to_x(angle1));
+  int sx2 = MAX(sx1, (int)ceilf(angle_to_x(angle2)) - 1);
+  return R_RangeVisible(sx1, sx2);
 }
 
-int R_PointOnSide(float x, float y, mapnode_t* node) {
-  float  dx;
-  float  dy;
-  float  left;
-  float  right;
-  
+static int R_PointOnSide(float x, float y, mapnode_t const *node)
+{
+  float dx;
+  float dy;
+  float left;
+  float right;
+
   if (!node->dx)
   {
     if (x <= node->x)
       return node->dy > 0;
-    
+
     return node->dy < 0;
   }
   if (!node->dy)
   {
     if (y <= node->y)
       return node->dx < 0;
-    
+
     return node->dx > 0;
   }
-  
+
   dx = (x - node->x);
   dy = (y - node->y);
-  
+
   left = node->dy * dx;
   right = dy * node->dx;
-  
+
   if (right < left)
   {
     // front side
@@ -271,93 +477,118 @@ int R_PointOnSide(float x, float y, mapnode_t* node) {
 
 //
 // R_Subsector
-// Determine floor/ceiling planes.
-// Add sprites of things in sector.
-// Draw one or more line segments.
+// Marks the subsector's sector visible
+// and adds its line segments.
 //
-void R_Subsector (map_data_t *map, int num, viewdef_t *viewdef)
+static void R_Subsector(int num)
 {
-  int count/*, sector*/;
-  mapseg_t* line;
-  
-#ifdef RANGECHECK
-  if (num >= numsubsectors)
-    I_Error ("R_Subsector: ss %i with numss = %i", num, numsubsectors);
-#endif
-  
-  sscount++;
-  mapsubsector_t* sub = &map->subsectors[num];
-  mapseg_t* seg = &map->segs[sub->firstseg];
-
-  frontsector = &map->sectors[map->sidedefs[map->linedefs[seg->linedef].sidenum[seg->side]].sector];
-  count = sub->numsegs;
-  line = &map->segs[sub->firstseg];
-  
-//  if (frontsector->floorheight < viewz)
-//  {
-//    floorplane = R_FindPlane (frontsector->floorheight, frontsector->floorpic, frontsector->lightlevel);
-//  }
-//  else
-//    floorplane = NULL;
-//  
-//  if (frontsector->ceilingheight > viewz || frontsector->ceilingpic == skyflatnum)
-//  {
-//    ceilingplane = R_FindPlane (frontsector->ceilingheight, frontsector->ceilingpic, frontsector->lightlevel);
-//  }
-//  else
-//    ceilingplane = NULL;
-  
-  if (map->floors.sectors[frontsector - map->sectors].frame != viewdef->frame)
+  if (num >= bspmap->num_subsectors)
+    return;
+
+  mapsubsector_t const *sub = &bspmap->subsectors[num];
+  if (!sub->numsegs || sub->firstseg + sub->numsegs > bspmap->num_segs)
+    return;
+
+  mapseg_t const *line = &bspmap->segs[sub->firstseg];
+  int count = sub->numsegs;
+
+  if (line->linedef < bspmap->num_linedefs && line->side <= 1)
   {
-//    sorted_flats[sorted_flats_count++] = planes + sector;
-    map->floors.sectors[frontsector - map->sectors].frame = viewdef->frame;
+    maplinedef_t const *linedef = &bspmap->linedefs[line->linedef];
+    mapsector_t const *frontsector = side_sector(linedef->sidenum[line->side]);
+    if (frontsector)
+    {
+      mapsector2_t *sec = &bspmap->floors.sectors[frontsector - bspmap->sectors];
+      if (sec->frame != bspview->frame)
+      {
+        sec->frame = bspview->frame;
+        add_sector_func(bspmap, frontsector, bspview);
+      }
+    }
   }
-  
-//  R_AddSprites (frontsector);
-  
+
   while (count--)
   {
-//    R_AddLine (line);
+    R_AddLine(line);
     line++;
   }
 }
 
-
+//
 // RenderBSPNode
 // Renders all subsectors below a given node,
 //  traversing subtree recursively.
-// Just call with BSP root.
-void R_RenderBSPNode (map_data_t *map, int bspnum, viewdef_t *viewdef)
+// Just call with BSP root. Node builders store children
+// before their parents, which is required here so a
+// broken tree cannot loop.
+//
+static void R_RenderBSPNode(int bspnum)
 {
-  mapnode_t*  bsp;
-  int    side;
-  
-  
-  viewx = viewdef->player.x;
-  viewy = viewdef->player.y;
-  viewz = viewdef->player.z;
-  viewangle = rad2angle(viewdef->player.angle);
-  
+  mapnode_t const *bsp;
+  int side;
+
   // Found a subsector?
   if (bspnum & NF_SUBSECTOR)
   {
-    if (bspnum == -1)
-      R_Subsector (map, 0, viewdef);
-    else
-      R_Subsector (map, bspnum&(~NF_SUBSECTOR), viewdef);
+    R_Subsector(bspnum & (~NF_SUBSECTOR));
     return;
   }
-  
-  bsp = &map->nodes[bspnum];
-  
+
+  bsp = &bspmap->nodes[bspnum];
+
   // Decide which side the view point is on.
   side = R_PointOnSide(viewx, viewy, bsp);
-  
+
   // Recursively divide front space.
-  R_RenderBSPNode (map, bsp->children[side], viewdef);
-  
+  if (bsp->children[side] & NF_SUBSECTOR || bsp->children[side] < bspnum)
+    R_RenderBSPNode(bsp->children[side]);
+
+  // Everything further back is hidden.
+  if (R_ClipListFull())
+    return;
+
   // Possibly divide back space.
-  if (R_CheckBBox (bsp->bbox[side^1]))
-    R_RenderBSPNode (map, bsp->children[side^1], viewdef);
+  if ((bsp->children[side^1] & NF_SUBSECTOR || bsp->children[side^1] < bspnum) &&
+      R_CheckBBox(bsp->bbox[side^1]))
+    R_RenderBSPNode(bsp->children[side^1]);
 }
 
+// Walks the map's BSP tree from the view and calls add_sector once for every
+// sector seen and add_side once for every linedef side seen, both front to
+// back. Returns false without calling either when the map has no usable
+// nodes, so the caller can fall back to portal traversal.
+bool render_bsp_view(map_data_t const *map, viewdef_t const *viewdef,
+                     void (*add_sector)(map_data_t const *, mapsector_t const *, viewdef_t const *),
+                     void (*add_side)(map_data_t const *, uint16_t linedef, int side))
+{
+  if (!map->num_segs || !map->num_subsectors || map->num_nodes > NF_SUBSECTOR ||
+      !map->floors.sectors)
+    return false;
+
+  if (map->num_linedefs * 2 > num_side_stamps) {
+    uint32_t *stamps = realloc(side_stamps, sizeof(uint32_t) * map->num_linedefs * 2);
+    if (!stamps) return false;
+    memset(stamps, 0, sizeof(uint32_t) * map->num_linedefs * 2);
+    side_stamps = stamps;
+    num_side_stamps = map->num_linedefs * 2;
+    stamp = 0;
+  }
+  if (++stamp == 0) {
+    memset(side_stamps, 0, sizeof(uint32_t) * num_side_stamps);
+    stamp = 1;
+  }
+
+  bspmap = map;
+  bspview = viewdef;
+  add_sector_func = add_sector;
+  add_side_func = add_side;
+
+  R_SetupFrame(viewdef);
+  R_ClearClipSegs();
+  // A map with a single subsector has no nodes
+  R_RenderBSPNode(map->num_nodes ? map->num_nodes - 1 : NF_SUBSECTOR);
+
+  bspmap = NULL;
+  bspview = NULL;
+  return true;
+}
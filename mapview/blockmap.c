@@ -0,0 +1,583 @@
+#ifdef TEST_MODE
+#include <tests/map_test.h>
+#else
+#include <mapview/map.h>
+#endif
+#include <math.h>
+
+// Blockmap for collision. The map is cut into BLOCKSIZE square cells and
+// every cell lists the linedefs crossing it, in compressed rows like the
+// sector topology, so a query costs the cells it overlaps instead of the
+// whole map. It is built from the linedefs rather than read from the
+// BLOCKMAP lump, which edited maps do not have.
+
+#define MAX_CORNER_LINES 8    // Linedefs considered per vertex
+#define CORNER_EPSILON 0.1f
+
+// Cells crossed by the segment a-b, row by row. Each row takes the part of
+// the segment inside it; lines on a row boundary go into both rows.
+static void add_line_cells(map_data_t *map, uint16_t line, mapvertex_t const *a,
+                           mapvertex_t const *b, bool fill) {
+  int ox = map->blockmap.x, oy = map->blockmap.y;
+  int row0 = (MIN(a->y, b->y) - oy) / BLOCKSIZE;
+  int row1 = (MAX(a->y, b->y) - oy) / BLOCKSIZE;
+  for (int row = row0; row <= row1; row++) {
+    double y0 = oy + row * BLOCKSIZE, y1 = y0 + BLOCKSIZE;
+    double xa = a->x, xb = b->x;
+    if (a->y != b->y) {
+      double ta = (MAX(y0, MIN(a->y, b->y)) - a->y) / (double)(b->y - a->y);
+      double tb = (MIN(y1, MAX(a->y, b->y)) - a->y) / (double)(b->y - a->y);
+      xa = a->x + ta * (b->x - a->x);
+      xb = a->x + tb * (b->x - a->x);
+    }
+    int col0 = MAX(0, (int)floor((MIN(xa, xb) - ox) / BLOCKSIZE));
+    int col1 = MIN(map->blockmap.width - 1, (int)floor((MAX(xa, xb) - ox) / BLOCKSIZE));
+    for (int col = col0; col <= col1; col++) {
+      uint32_t cell = row * map->blockmap.width + col;
+      if (fill) {
+        map->blockmap.lines[map->blockmap.cell_start[cell]++] = line;
+      } else {
+        map->blockmap.cell_start[cell + 1]++;
+      }
+    }
+  }
+}
+
+// Direction from the vertex along the linedef, or false if it is too short
+static bool corner_direction(map_data_t const *map, maplinedef_t const *line, uint16_t v,
+                             float *dx, float *dy) {
+  mapvertex_t const *vertex = &map->vertices[v];
+  if (line->start == v) {
+    *dx = map->vertices[line->end].x - vertex->x;
+    *dy = map->vertices[line->end].y - vertex->y;
+  } else {
+    *dx = vertex->x - map->vertices[line->start].x;
+    *dy = vertex->y - map->vertices[line->start].y;
+  }
+  float len = sqrtf(*dx * *dx + *dy * *dy);
+  if (len <= CORNER_EPSILON) return false;
+  *dx /= len;
+  *dy /= len;
+  return true;
+}
+
+// A vertex is a corner when two of its first linedefs meet at a
+// significant angle (dot product below 0.7)
+static bool compute_corner(map_data_t const *map, uint16_t v, uint16_t const *lines, int count) {
+  count = MIN(count, MAX_CORNER_LINES);
+  for (int i = 0; i < count; i++) {
+    float dx1, dy1;
+    if (!corner_direction(map, &map->linedefs[lines[i]], v, &dx1, &dy1)) continue;
+    for (int j = i + 1; j < count; j++) {
+      float dx2, dy2;
+      if (!corner_direction(map, &map->linedefs[lines[j]], v, &dx2, &dy2)) continue;
+      if (dx1 * dx2 + dy1 * dy2 < 0.7f) return true;
+    }
+  }
+  return false;
+}
+
+static bool build_corners(map_data_t *map) {
+  uint32_t num_vertices = map->num_vertices;
+  bool *corners = realloc(map->blockmap.corners, sizeof(bool) * (num_vertices + 1));
+  if (!corners) return false;
+  map->blockmap.corners = corners;
+  map->blockmap.num_corners = num_vertices;
+  memset(corners, 0, sizeof(bool) * (num_vertices + 1));
+
+  // Linedefs by vertex, in linedef order
+  uint32_t *start = calloc(num_vertices + 1, sizeof(uint32_t));
+  uint16_t *lines = malloc(sizeof(uint16_t) * (map->num_linedefs * 2 + 1));
+  if (!start || !lines) {
+    free(start);
+    free(lines);
+    return false;
+  }
+  for (int i = 0; i < map->num_linedefs; i++) {
+    start[map->linedefs[i].start + 1]++;
+    if (map->linedefs[i].end != map->linedefs[i].start) {
+      start[map->linedefs[i].end + 1]++;
+    }
+  }
+  for (uint32_t i = 0; i < num_vertices; i++) {
+    start[i + 1] += start[i];
+  }
+  for (int i = 0; i < map->num_linedefs; i++) {
+    lines[start[map->linedefs[i].start]++] = i;
+    if (map->linedefs[i].end != map->linedefs[i].start) {
+      lines[start[map->linedefs[i].end]++] = i;
+    }
+  }
+  // start[v] now ends row v; the previous row's end is where it begins
+  for (uint32_t v = 0; v < num_vertices; v++) {
+    uint32_t first = v ? start[v - 1] : 0;
+    corners[v] = compute_corner(map, v, lines + first, start[v] - first);
+  }
+  free(start);
+  free(lines);
+  return true;
+}
+
+// Point location. Each cell lists the sectors overlapping it with their
+// linedefs in the cell and whether the cell's reference point, just inside
+// its lower right corner, is in the sector. The walk from a point to the
+// reference point stays in the cell, so only those linedefs can change the
+// answer. Coordinates are doubled where the reference point sits between
+// whole units, and the arithmetic is exact so the walk agrees with a
+// ray cast over the whole sector.
+
+// Doubled x of the reference point of a column, half a unit left of its edge
+static int32_t reference_x2(map_data_t const *map, int col) {
+  return 2 * (map->blockmap.x + (col + 1) * BLOCKSIZE) - 1;
+}
+
+// Whether the ray from (x2 / 2, y) towards +x crosses the segment a-b. The
+// ray starts just above and right of the point, so it never meets a vertex.
+static bool ray_crosses(mapvertex_t const *a, mapvertex_t const *b, int32_t x2, int y) {
+  if ((a->y > y) == (b->y > y)) return false;
+  int64_t dx = b->x - a->x, dy = b->y - a->y;
+  int64_t num = (2 * (int64_t)a->x - x2) * dy + 2 * (int64_t)(y - a->y) * dx;
+  return num != 0 && (num > 0) == (dy > 0);
+}
+
+// Whether a-b crosses the vertical x = x2 / 2 above height y, for odd x2
+static bool crosses_above(mapvertex_t const *a, mapvertex_t const *b, int32_t x2, int y) {
+  int64_t dx = b->x - a->x, dy = b->y - a->y;
+  if ((2 * a->x > x2) == (2 * b->x > x2)) return false;
+  int64_t num = 2 * (int64_t)(a->y - y) * dx + (x2 - 2 * (int64_t)a->x) * dy;
+  if (num == 0) return dy != 0 && (dx > 0) == (dy > 0);
+  return (num > 0) == (dx > 0);
+}
+
+// Sector a linedef side bounds, or -1 when the line has it on both sides
+// and so never changes whether a point is inside
+static int boundary_sector(map_data_t const *map, maplinedef_t const *line, int side) {
+  uint16_t sidenum = line->sidenum[side];
+  if (sidenum >= map->num_sidedefs) return -1;
+  uint16_t sector = map->sidedefs[sidenum].sector;
+  if (sector >= map->num_sectors) return -1;
+  uint16_t other = line->sidenum[!side];
+  if (other < map->num_sidedefs && map->sidedefs[other].sector == sector) return -1;
+  return sector;
+}
+
+static int compare_keys(void const *a, void const *b) {
+  uint64_t ka = *(uint64_t const *)a, kb = *(uint64_t const *)b;
+  return (ka > kb) - (ka < kb);
+}
+
+// A sector is closed when every point is the end of an even number of its
+// linedefs. Only then is inside a property of the area the walk can use.
+static bool find_open_sectors(map_data_t *map) {
+  uint32_t num_sectors = map->num_sectors;
+  bool *open = calloc(num_sectors + 1, sizeof(bool));
+  uint16_t *list = malloc(sizeof(uint16_t) * (num_sectors + 1));
+  uint64_t *keys = malloc(sizeof(uint64_t) * (map->num_linedefs * 4 + 1));
+  if (!open || !list || !keys) {
+    free(open);
+    free(list);
+    free(keys);
+    return false;
+  }
+  int num_keys = 0;
+  for (int i = 0; i < map->num_linedefs; i++) {
+    maplinedef_t const *line = &map->linedefs[i];
+    for (int side = 0; side < 2; side++) {
+      int sector = boundary_sector(map, line, side);
+      if (sector < 0) continue;
+      for (int end = 0; end < 2; end++) {
+        mapvertex_t const *v = &map->vertices[end ? line->end : line->start];
+        keys[num_keys++] = (uint64_t)sector << 32 | (uint32_t)(uint16_t)v->x << 16 | (uint16_t)v->y;
+      }
+    }
+  }
+  qsort(keys, num_keys, sizeof(uint64_t), compare_keys);
+  for (int i = 0; i < num_keys; ) {
+    int j = i;
+    while (j < num_keys && keys[j] == keys[i]) j++;
+    if ((j - i) & 1) open[keys[i] >> 32] = true;
+    i = j;
+  }
+  free(keys);
+
+  map->blockmap.open_sectors = open;
+  map->blockmap.open_list = list;
+  map->blockmap.num_open = 0;
+  for (uint32_t i = 0; i < num_sectors; i++) {
+    if (open[i]) list[map->blockmap.num_open++] = i;
+  }
+  return true;
+}
+
+// Where the ray cast from a row's reference height toggles a sector: the
+// reference points of columns 0 through col are left of the crossing
+typedef struct {
+  int col;
+  uint16_t sector;
+} rowcrossing_t;
+
+static int compare_crossings(void const *a, void const *b) {
+  return ((rowcrossing_t const *)a)->col - ((rowcrossing_t const *)b)->col;
+}
+
+typedef struct {
+  uint32_t num_entries, max_entries;
+  uint32_t num_lines, max_lines;
+  uint16_t *active;        // Sectors containing the current reference point
+  int *active_pos;
+  uint32_t *mark;          // Cell that last added an entry for the sector
+  uint32_t *cursor;        // Next line slot of the sector's entry
+} cellbuilder_t;
+
+static bool grow(void **array, uint32_t *capacity, uint32_t needed, size_t size) {
+  if (needed <= *capacity) return true;
+  uint32_t capacity2 = MAX(needed, *capacity * 2);
+  void *grown = realloc(*array, capacity2 * size);
+  if (!grown) return false;
+  *array = grown;
+  *capacity = capacity2;
+  return true;
+}
+
+static void toggle_active(cellbuilder_t *b, uint16_t sector, int *num_active) {
+  if (b->active_pos[sector] < 0) {
+    b->active_pos[sector] = *num_active;
+    b->active[(*num_active)++] = sector;
+  } else {
+    uint16_t last = b->active[--(*num_active)];
+    b->active[b->active_pos[sector]] = last;
+    b->active_pos[last] = b->active_pos[sector];
+    b->active_pos[sector] = -1;
+  }
+}
+
+static bool add_entry(map_data_t *map, cellbuilder_t *b, uint16_t sector, bool inside) {
+  if (!grow((void **)&map->blockmap.sectors, &b->max_entries, b->num_entries + 2,
+            sizeof(mapcellsector_t))) return false;
+  map->blockmap.sectors[b->num_entries++] = (mapcellsector_t){ sector, inside, 0 };
+  return true;
+}
+
+// Entries for one cell: sectors with linedefs in it, then the sectors its
+// reference point is in
+static bool add_cell_sectors(map_data_t *map, cellbuilder_t *b, uint32_t cell, int num_active) {
+  uint32_t first = b->num_entries;
+  uint32_t line0 = map->blockmap.cell_start[cell], line1 = map->blockmap.cell_start[cell + 1];
+  for (int pass = 0; pass < 2; pass++) {
+    for (uint32_t k = line0; k < line1; k++) {
+      uint16_t line = map->blockmap.lines[k];
+      for (int side = 0; side < 2; side++) {
+        int sector = boundary_sector(map, &map->linedefs[line], side);
+        if (sector < 0 || map->blockmap.open_sectors[sector]) continue;
+        if (pass == 1) {
+          map->blockmap.sector_lines[b->cursor[sector]++] = line;
+        } else if (b->mark[sector] != cell + 1) {
+          b->mark[sector] = cell + 1;
+          b->cursor[sector] = 1;
+          if (!add_entry(map, b, sector, b->active_pos[sector] >= 0)) return false;
+        } else {
+          b->cursor[sector]++;
+        }
+      }
+    }
+    if (pass == 0) {
+      // Turn the counts into line runs
+      for (uint32_t e = first; e < b->num_entries; e++) {
+        mapcellsector_t *entry = &map->blockmap.sectors[e];
+        uint32_t count = b->cursor[entry->sector];
+        entry->first_line = b->num_lines;
+        b->cursor[entry->sector] = b->num_lines;
+        b->num_lines += count;
+      }
+      if (!grow((void **)&map->blockmap.sector_lines, &b->max_lines, b->num_lines + 1,
+                sizeof(uint16_t))) return false;
+    }
+  }
+  for (int i = 0; i < num_active; i++) {
+    if (b->mark[b->active[i]] == cell + 1) continue;
+    if (!add_entry(map, b, b->active[i], true)) return false;
+    map->blockmap.sectors[b->num_entries - 1].first_line = b->num_lines;
+  }
+  map->blockmap.sector_start[cell + 1] = b->num_entries;
+  return true;
+}
+
+// Sweeps each row along its reference height, keeping the set of sectors
+// the reference point of the current column is in
+static bool build_sector_cells(map_data_t *map) {
+  uint32_t num_sectors = map->num_sectors;
+  int width = map->blockmap.width;
+  uint32_t num_cells = width * map->blockmap.height;
+  free(map->blockmap.sector_start);
+  free(map->blockmap.sectors);
+  free(map->blockmap.sector_lines);
+  free(map->blockmap.open_sectors);
+  free(map->blockmap.open_list);
+  map->blockmap.sectors = NULL;
+  map->blockmap.sector_lines = NULL;
+  map->blockmap.open_sectors = NULL;
+  map->blockmap.open_list = NULL;
+  cellbuilder_t b = { 0 };
+  b.active = malloc(sizeof(uint16_t) * (num_sectors + 1));
+  b.active_pos = malloc(sizeof(int) * (num_sectors + 1));
+  b.mark = calloc(num_sectors + 1, sizeof(uint32_t));
+  b.cursor = calloc(num_sectors + 1, sizeof(uint32_t));
+  uint16_t *row_lines = malloc(sizeof(uint16_t) * (map->num_linedefs + 1));
+  rowcrossing_t *crossings = malloc(sizeof(rowcrossing_t) * (map->num_linedefs * 2 + 1));
+  map->blockmap.sector_start = calloc(num_cells + 1, sizeof(uint32_t));
+  bool ok = b.active && b.active_pos && b.mark && b.cursor && row_lines && crossings &&
+            map->blockmap.sector_start && find_open_sectors(map);
+  for (uint32_t i = 0; ok && i < num_sectors; i++) {
+    b.active_pos[i] = -1;
+  }
+
+  for (int row = 0; ok && row < map->blockmap.height; row++) {
+    int y = map->blockmap.y + row * BLOCKSIZE;
+    int count = get_blockmap_lines(map, map->blockmap.x, y,
+                                   map->blockmap.x + width * BLOCKSIZE - 1, y,
+                                   row_lines, map->num_linedefs);
+    int num_crossings = 0;
+    for (int i = 0; i < count; i++) {
+      maplinedef_t const *line = &map->linedefs[row_lines[i]];
+      mapvertex_t const *a = &map->vertices[line->start];
+      mapvertex_t const *v = &map->vertices[line->end];
+      if ((a->y > y) == (v->y > y)) continue;
+      // Estimate the last column left of the crossing, then settle it exactly
+      double x = a->x + (double)(y - a->y) * (v->x - a->x) / (v->y - a->y);
+      int col = MAX(-1, MIN(width - 1, (int)floor((x - map->blockmap.x + 0.5) / BLOCKSIZE) - 1));
+      while (col + 1 < width && ray_crosses(a, v, reference_x2(map, col + 1), y)) col++;
+      while (col >= 0 && !ray_crosses(a, v, reference_x2(map, col), y)) col--;
+      if (col < 0) continue;
+      for (int side = 0; side < 2; side++) {
+        int sector = boundary_sector(map, line, side);
+        if (sector < 0 || map->blockmap.open_sectors[sector]) continue;
+        crossings[num_crossings++] = (rowcrossing_t){ col, sector };
+      }
+    }
+    qsort(crossings, num_crossings, sizeof(rowcrossing_t), compare_crossings);
+
+    // Column 0 is left of every crossing; each later column drops the
+    // crossings that ended before it
+    int num_active = 0;
+    for (int i = 0; i < num_crossings; i++) {
+      toggle_active(&b, crossings[i].sector, &num_active);
+    }
+    int next = 0;
+    for (int col = 0; ok && col < width; col++) {
+      ok = add_cell_sectors(map, &b, row * width + col, num_active);
+      for (; next < num_crossings && crossings[next].col == col; next++) {
+        toggle_active(&b, crossings[next].sector, &num_active);
+      }
+    }
+  }
+  if (ok) ok = add_entry(map, &b, 0, false);
+  if (ok) {
+    map->blockmap.sectors[b.num_entries - 1].first_line = b.num_lines;
+    map->blockmap.num_linedefs = map->num_linedefs;
+    map->blockmap.num_sidedefs = map->num_sidedefs;
+    map->blockmap.num_sectors = map->num_sectors;
+  }
+
+  free(b.active);
+  free(b.active_pos);
+  free(b.mark);
+  free(b.cursor);
+  free(row_lines);
+  free(crossings);
+  return ok;
+}
+
+// Rebuilds the blockmap and the corner flags from the linedefs
+void build_blockmap(map_data_t *map) {
+  for (int i = 0; i < map->num_linedefs; i++) {
+    maplinedef_t const *line = &map->linedefs[i];
+    if (line->start >= map->num_vertices || line->end >= map->num_vertices) {
+      printf("Error: Linedef %d has no vertex, blockmap not built\n", i);
+      free_blockmap(map);
+      return;
+    }
+  }
+
+  int16_t minx = 0, miny = 0, maxx = 0, maxy = 0;
+  for (int i = 0; i < map->num_vertices; i++) {
+    mapvertex_t const *v = &map->vertices[i];
+    minx = i ? MIN(minx, v->x) : v->x;
+    miny = i ? MIN(miny, v->y) : v->y;
+    maxx = i ? MAX(maxx, v->x) : v->x;
+    maxy = i ? MAX(maxy, v->y) : v->y;
+  }
+  map->blockmap.x = minx;
+  map->blockmap.y = miny;
+  map->blockmap.width = (maxx - minx) / BLOCKSIZE + 1;
+  map->blockmap.height = (maxy - miny) / BLOCKSIZE + 1;
+
+  uint32_t num_cells = map->blockmap.width * map->blockmap.height;
+  uint32_t *cell_start = realloc(map->blockmap.cell_start, (num_cells + 1) * sizeof(uint32_t));
+  if (cell_start) map->blockmap.cell_start = cell_start;
+  uint32_t *stamps = realloc(map->blockmap.line_stamps, (map->num_linedefs + 1) * sizeof(uint32_t));
+  if (stamps) map->blockmap.line_stamps = stamps;
+  if (!cell_start || !stamps) goto fail;
+  memset(cell_start, 0, (num_cells + 1) * sizeof(uint32_t));
+  memset(stamps, 0, (map->num_linedefs + 1) * sizeof(uint32_t));
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < map->num_linedefs; i++) {
+      maplinedef_t const *line = &map->linedefs[i];
+      add_line_cells(map, i, &map->vertices[line->start], &map->vertices[line->end], pass == 1);
+    }
+    if (pass == 0) {
+      for (uint32_t i = 0; i < num_cells; i++) {
+        cell_start[i + 1] += cell_start[i];
+      }
+      uint16_t *lines = realloc(map->blockmap.lines, (cell_start[num_cells] + 1) * sizeof(uint16_t));
+      if (!lines) goto fail;
+      map->blockmap.lines = lines;
+    }
+  }
+  // Filling advanced every offset to the end of its cell; shift them back
+  memmove(cell_start + 1, cell_start, num_cells * sizeof(uint32_t));
+  cell_start[0] = 0;
+
+  if (!build_corners(map)) goto fail;
+  if (!build_sector_cells(map)) goto fail;
+  return;
+
+fail:
+  printf("Error: Could not allocate blockmap\n");
+  free_blockmap(map);
+}
+
+void free_blockmap(map_data_t *map) {
+  free(map->blockmap.cell_start);
+  free(map->blockmap.lines);
+  free(map->blockmap.line_stamps);
+  free(map->blockmap.corners);
+  free(map->blockmap.sector_start);
+  free(map->blockmap.sectors);
+  free(map->blockmap.sector_lines);
+  free(map->blockmap.open_sectors);
+  free(map->blockmap.open_list);
+  memset(&map->blockmap, 0, sizeof(map->blockmap));
+}
+
+// Fills lines with every linedef crossing a cell the box overlaps, each
+// once, and returns how many there are. Stops at max_lines.
+int get_blockmap_lines(map_data_t const *map, float x1, float y1, float x2, float y2,
+                       uint16_t *lines, int max_lines) {
+  static uint32_t stamp = 0;
+  if (!map->blockmap.cell_start) return 0;
+  if (++stamp == 0) {
+    memset(map->blockmap.line_stamps, 0, (map->num_linedefs + 1) * sizeof(uint32_t));
+    stamp = 1;
+  }
+
+  int col0 = MAX(0, (int)floorf((x1 - map->blockmap.x) / BLOCKSIZE));
+  int col1 = MIN(map->blockmap.width - 1, (int)floorf((x2 - map->blockmap.x) / BLOCKSIZE));
+  int row0 = MAX(0, (int)floorf((y1 - map->blockmap.y) / BLOCKSIZE));
+  int row1 = MIN(map->blockmap.height - 1, (int)floorf((y2 - map->blockmap.y) / BLOCKSIZE));
+  int count = 0;
+  for (int row = row0; row <= row1; row++) {
+    for (int col = col0; col <= col1; col++) {
+      uint32_t cell = row * map->blockmap.width + col;
+      for (uint32_t k = map->blockmap.cell_start[cell]; k < map->blockmap.cell_start[cell + 1]; k++) {
+        uint16_t line = map->blockmap.lines[k];
+        if (map->blockmap.line_stamps[line] == stamp) continue;
+        map->blockmap.line_stamps[line] = stamp;
+        if (count == max_lines) return count;
+        lines[count++] = line;
+      }
+    }
+  }
+  return count;
+}
+
+// Whether the sector's linedefs in the point's cell keep it where the
+// reference point is
+static bool cell_entry_contains(map_data_t const *map, mapcellsector_t const *entry,
+                                int x, int y, int32_t ref_x2, int ref_y) {
+  bool inside = entry->inside;
+  for (uint32_t k = entry->first_line; k < entry[1].first_line; k++) {
+    maplinedef_t const *line = &map->linedefs[map->blockmap.sector_lines[k]];
+    mapvertex_t const *a = &map->vertices[line->start];
+    mapvertex_t const *b = &map->vertices[line->end];
+    // Across to the reference column, then down to the reference height
+    if (ray_crosses(a, b, 2 * x, y) != ray_crosses(a, b, ref_x2, y)) inside = !inside;
+    if (crosses_above(a, b, ref_x2, y) != crosses_above(a, b, ref_x2, ref_y)) inside = !inside;
+  }
+  return inside;
+}
+
+static bool sector_cells_current(map_data_t const *map) {
+  return map->blockmap.sector_start &&
+         map->blockmap.num_linedefs == map->num_linedefs &&
+         map->blockmap.num_sidedefs == map->num_sidedefs &&
+         map->blockmap.num_sectors == map->num_sectors &&
+         map->blockmap.num_corners == map->num_vertices;
+}
+
+// Cell entries of the point, or false when it is outside the grid
+static bool point_cell(map_data_t const *map, int x, int y, uint32_t *cell) {
+  int col = x - map->blockmap.x, row = y - map->blockmap.y;
+  if (col < 0 || row < 0) return false;
+  col /= BLOCKSIZE;
+  row /= BLOCKSIZE;
+  if (col >= map->blockmap.width || row >= map->blockmap.height) return false;
+  *cell = row * map->blockmap.width + col;
+  return true;
+}
+
+// Ray cast over every linedef of the map
+bool scan_point_in_sector(map_data_t const *map, int x, int y, int sector) {
+  bool inside = false;
+  for (int i = 0; i < map->num_linedefs; i++) {
+    maplinedef_t const *line = &map->linedefs[i];
+    for (int side = 0; side < 2; side++) {
+      uint16_t sidenum = line->sidenum[side];
+      if (sidenum >= map->num_sidedefs || map->sidedefs[sidenum].sector != sector) continue;
+      if (ray_crosses(&map->vertices[line->start], &map->vertices[line->end], 2 * x, y)) {
+        inside = !inside;
+      }
+    }
+  }
+  return inside;
+}
+
+// Whether the point is in the sector, or -1 when the grid is out of date
+int blockmap_point_in_sector(map_data_t const *map, int x, int y, int sector) {
+  if (!sector_cells_current(map)) return -1;
+  if (map->blockmap.open_sectors[sector]) return scan_point_in_sector(map, x, y, sector);
+  uint32_t cell;
+  if (!point_cell(map, x, y, &cell)) return false;
+  int col = cell % map->blockmap.width, row = cell / map->blockmap.width;
+  for (uint32_t e = map->blockmap.sector_start[cell]; e < map->blockmap.sector_start[cell + 1]; e++) {
+    mapcellsector_t const *entry = &map->blockmap.sectors[e];
+    if (entry->sector != sector) continue;
+    return cell_entry_contains(map, entry, x, y, reference_x2(map, col),
+                               map->blockmap.y + row * BLOCKSIZE);
+  }
+  return false;
+}
+
+// Fills sectors with every sector the point is in and returns how many
+// there are, or -1 when the grid is out of date. Stops at max_sectors.
+int get_blockmap_sectors(map_data_t const *map, int x, int y, uint16_t *sectors, int max_sectors) {
+  if (!sector_cells_current(map)) return -1;
+  int count = 0;
+  uint32_t cell;
+  if (point_cell(map, x, y, &cell)) {
+    int col = cell % map->blockmap.width, row = cell / map->blockmap.width;
+    int32_t ref_x2 = reference_x2(map, col);
+    int ref_y = map->blockmap.y + row * BLOCKSIZE;
+    for (uint32_t e = map->blockmap.sector_start[cell]; e < map->blockmap.sector_start[cell + 1]; e++) {
+      mapcellsector_t const *entry = &map->blockmap.sectors[e];
+      if (count == max_sectors) return count;
+      if (cell_entry_contains(map, entry, x, y, ref_x2, ref_y)) sectors[count++] = entry->sector;
+    }
+  }
+  for (int i = 0; i < map->blockmap.num_open; i++) {
+    if (count == max_sectors) return count;
+    uint16_t sector = map->blockmap.open_list[i];
+    if (scan_point_in_sector(map, x, y, sector)) sectors[count++] = sector;
+  }
+  return count;
+}
@@ -12,13 +12,7 @@ void draw_bsp(map_data_t const *map, viewdef_t const *viewdef) {
   extern void draw_floors(map_data_t const *, mapsector_t const *, viewdef_t const *);
   
   // Find the player's sector and start rendering from there
-  mapsector_t const *player_sector = NULL;
-  for (int i = 0; i < map->num_sectors; i++) {
-    if (point_in_sector(map, viewdef->viewpos[0], viewdef->viewpos[1], i)) {
-      player_sector = &map->sectors[i];
-      break;
-    }
-  }
+  mapsector_t const *player_sector = find_player_sector(map, viewdef->viewpos[0], viewdef->viewpos[1]);
   
   // Fall back to rendering from first sector if player sector not found
   if (!player_sector && map->num_sectors > 0) {
@@ -5,7 +5,11 @@
 #define MAX_STEP 24.0f        // Maximum step height
 #define EPSILON 0.1f          // Floating point error prevention
 #define WALL_DIST 2.0f        // Minimum wall distance
-#define MAX_CORNERS 8         // Maximum corners to handle
+#define MAX_BLOCK_LINES 1024  // Linedefs gathered per collision query
+#define MAX_SUBSTEPS 16       // Substeps per move, each at most P_RADIUS long
+#define MAX_SLIDES 3          // Walls one substep can slide along
+#define NO_HIT 2.0f           // Sweep time meaning no contact
+#define MIN_APPROACH 1e-4f    // Slower approaches count as moving along a wall
 
 // Collision result structure
 typedef struct {
@@ -17,8 +21,6 @@ typedef struct {
   bool corner;                // Corner collision flag
 } collision_t;
 
-void update_player_pos(map_data_t const *map, player_t *player, float mx, float my, int depth);
-
 /**
  * Calculate squared distance between two points
  */
@@ -29,68 +31,10 @@ float dist_sq(float x1, float y1, float x2, float y2) {
 }
 
 /**
- * Check if a vertex forms a corner
+ * Check if a vertex forms a corner, as flagged when the blockmap was built
  */
 bool is_corner(map_data_t const *map, uint16_t v_idx) {
-  mapvertex_t const *vertex = &map->vertices[v_idx];
-  
-  // Find connected linedefs
-  int conn_count = 0;
-  int conn_idx[MAX_CORNERS];
-  
-  for (int i = 0; i < map->num_linedefs && conn_count < MAX_CORNERS; i++) {
-    maplinedef_t const *line = &map->linedefs[i];
-    if (line->start == v_idx || line->end == v_idx) {
-      conn_idx[conn_count++] = i;
-    }
-  }
-  
-  // Not a corner if only one linedef is connected
-  if (conn_count <= 1) return false;
-  
-  // Check angles between connected walls
-  for (int i = 0; i < conn_count; i++) {
-    maplinedef_t const *line1 = &map->linedefs[conn_idx[i]];
-    
-    // Get direction vector of first line
-    float dx1, dy1;
-    if (line1->start == v_idx) {
-      dx1 = map->vertices[line1->end].x - vertex->x;
-      dy1 = map->vertices[line1->end].y - vertex->y;
-    } else {
-      dx1 = vertex->x - map->vertices[line1->start].x;
-      dy1 = vertex->y - map->vertices[line1->start].y;
-    }
-    
-    float len1 = sqrt(dx1*dx1 + dy1*dy1);
-    if (len1 <= EPSILON) continue;
-    dx1 /= len1;
-    dy1 /= len1;
-    
-    for (int j = i+1; j < conn_count; j++) {
-      maplinedef_t const *line2 = &map->linedefs[conn_idx[j]];
-      
-      // Get direction vector of second line
-      float dx2, dy2;
-      if (line2->start == v_idx) {
-        dx2 = map->vertices[line2->end].x - vertex->x;
-        dy2 = map->vertices[line2->end].y - vertex->y;
-      } else {
-        dx2 = vertex->x - map->vertices[line2->start].x;
-        dy2 = vertex->y - map->vertices[line2->start].y;
-      }
-      
-      float len2 = sqrt(dx2*dx2 + dy2*dy2);
-      if (len2 <= EPSILON) continue;
-      dx2 /= len2;
-      dy2 /= len2;
-      
-      // If angle is significant (dot product < 0.7), it's a corner
-      if (dx1*dx2 + dy1*dy2 < 0.7f) return true;
-    }
-  }
-  
-  return false;
+  return v_idx < map->blockmap.num_corners && map->blockmap.corners[v_idx];
 }
 
 /**
@@ -122,16 +66,19 @@ bool can_pass_wall(map_data_t const *map, maplinedef_t const *line, float player
 }
 
 /**
- * Check point-vertex collision
+ * Check point-vertex collision against the ends of nearby linedefs
  */
-void check_vertex_collision(map_data_t const *map, float x, float y, float max_dist_sq, collision_t *result) {
-  for (int i = 0; i < map->num_vertices; i++) {
+void check_vertex_collision(map_data_t const *map, uint16_t const *lines, int num_lines,
+                            float x, float y, float max_dist_sq, collision_t *result) {
+  for (int k = 0; k < num_lines * 2; k++) {
+    maplinedef_t const *line = &map->linedefs[lines[k / 2]];
+    uint16_t i = k & 1 ? line->end : line->start;
     mapvertex_t const *v = &map->vertices[i];
     float dx = x - v->x;
     float dy = y - v->y;
     float d_sq = dx*dx + dy*dy;
     
-    if (d_sq < max_dist_sq && is_corner(map, i) && d_sq < max_dist_sq) {
+    if (d_sq < max_dist_sq && is_corner(map, i)) {
       float dist = sqrt(d_sq);
       if (dist > EPSILON) {
         result->collided = true;
@@ -179,9 +126,10 @@ float closest_point_on_line(float point_x, float point_y,
     return dist_sq(point_x, point_y, line_x1, line_y1);
   }
   
-  // Find closest point on line
+  // Find closest point on line, clamped without branches so loops over
+  // many lines vectorize
   float t = ((point_x - line_x1) * dx + (point_y - line_y1) * dy) / len_sq;
-  t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+  t = fminf(fmaxf(t, 0.0f), 1.0f);
   
   *closest_x = line_x1 + t * dx;
   *closest_y = line_y1 + t * dy;
@@ -191,11 +139,13 @@ float closest_point_on_line(float point_x, float point_y,
 }
 
 /**
- * Check for collisions between a point and map line segments
+ * Check for collisions between a point and nearby map line segments
  */
-void check_line_collision(map_data_t const *map, float x, float y, float player_z,
+void check_line_collision(map_data_t const *map, uint16_t const *lines, int num_lines,
+                          float x, float y, float player_z,
                           float max_dist_sq, collision_t *result) {
-  for (int i = 0; i < map->num_linedefs; i++) {
+  for (int k = 0; k < num_lines; k++) {
+    int i = lines[k];
     maplinedef_t const *line = &map->linedefs[i];
     
     // Skip passable walls
@@ -254,11 +204,17 @@ void check_collision(map_data_t const *map, float x, float y, float player_z, co
   
   float max_dist_sq = (P_RADIUS + WALL_DIST) * (P_RADIUS + WALL_DIST) * 4.0f;
   
+  // Only linedefs in the blockmap cells within reach can touch the player
+  float reach = sqrtf(max_dist_sq);
+  uint16_t lines[MAX_BLOCK_LINES];
+  int num_lines = get_blockmap_lines(map, x - reach, y - reach, x + reach, y + reach,
+                                     lines, MAX_BLOCK_LINES);
+  
   // Check vertex collisions first
-  check_vertex_collision(map, x, y, max_dist_sq, result);
+  check_vertex_collision(map, lines, num_lines, x, y, max_dist_sq, result);
   
   // Then check line collisions
-  check_line_collision(map, x, y, player_z, max_dist_sq, result);
+  check_line_collision(map, lines, num_lines, x, y, player_z, max_dist_sq, result);
 }
 
 /**
@@ -287,64 +243,6 @@ void calc_slide(float mx, float my, float nx, float ny, float *sx, float *sy) {
   }
 }
 
-/**
- * Handle corner collision with rotated approach
- */
-void handle_corner(map_data_t const *map, player_t *player, collision_t *result,
-                   float mx, float my, int depth) {
-  float dx = player->x - result->cx;
-  float dy = player->y - result->cy;
-  float dist = sqrt(dx*dx + dy*dy);
-  
-  if (dist > EPSILON) {
-    dx /= dist;
-    dy /= dist;
-    
-    // Create vector that goes around the corner
-    float a1 = atan2(my, mx);
-    float a2 = atan2(dy, dx);
-    float diff = a1 - a2;
-    float new_angle = a2 + (diff > 0 ? 0.5f : -0.5f);
-    float len = sqrt(mx * mx + my * my);
-    
-    float new_mx = cos(new_angle) * len;
-    float new_my = sin(new_angle) * len;
-    
-    // Try modified movement
-    update_player_pos(map, player, new_mx, new_my, depth);
-  }
-}
-
-/**
- * Check for ledge transition
- */
-bool check_ledge(map_data_t const *map, player_t *player, float nx, float ny,
-                 float *mx, float *my) {
-  mapsector_t const *current = find_player_sector(map, (int)player->x, (int)player->y);
-  mapsector_t const *new_sector = find_player_sector(map, (int)(player->x + *mx),
-                                                     (int)(player->y + *my));
-  
-  if (!current || !new_sector) return false;
-  
-  // Check if stepping off ledge
-  if (current->floorheight > new_sector->floorheight) {
-    collision_t edge;
-    check_collision(map, player->x, player->y, player->z, &edge);
-    
-    if (edge.collided) {
-      float edge_dist = sqrt(dist_sq(player->x, player->y, edge.cx, edge.cy));
-      
-      // If near edge, push away slightly
-      if (edge_dist < P_RADIUS * 1.5f) {
-        *mx += edge.nx * (P_RADIUS * 0.7f);
-        *my += edge.ny * (P_RADIUS * 0.7f);
-        return true;
-      }
-    }
-  }
-  return false;
-}
-
 /**
  * Check if player can move to new sector
  */
@@ -364,64 +262,191 @@ bool can_enter_sector(mapsector_t const *current, mapsector_t const *new_sector,
 }
 
 /**
- * Update player position with collision handling
+ * Time along (dx, dy) at which a circle at (x, y) first touches the segment
+ * a-b, or NO_HIT. A circle already touching it and moving closer hits at 0.
+ * The normal at the contact is stored in nx, ny.
  */
-void update_player_pos(map_data_t const *map, player_t *player, float mx, float my, int depth) {
-  // Prevent infinite recursion
-  if (depth > 3) return;
-  
-  // Calculate new position
-  float new_x = player->x + mx;
-  float new_y = player->y + my;
-  
-  // Check sectors
-  mapsector_t const *current = find_player_sector(map, (int)player->x, (int)player->y);
-  
-  // Check for ledge transitions
-  bool modified = check_ledge(map, player, mx, my, &mx, &my);
-  if (modified) {
-    new_x = player->x + mx;
-    new_y = player->y + my;
+float sweep_circle_segment(float x, float y, float dx, float dy, float radius,
+                           float ax, float ay, float bx, float by,
+                           float *nx, float *ny) {
+  float hit = NO_HIT;
+  
+  // Against the face, if the contact falls between the ends
+  float ex = bx - ax;
+  float ey = by - ay;
+  float len_sq = ex*ex + ey*ey;
+  if (len_sq > EPSILON) {
+    float len = sqrtf(len_sq);
+    float fx = -ey / len;
+    float fy = ex / len;
+    float dist = (x - ax) * fx + (y - ay) * fy;
+    if (dist < 0) {
+      fx = -fx;
+      fy = -fy;
+      dist = -dist;
+    }
+    float approach = -(dx * fx + dy * fy);
+    if (approach > MIN_APPROACH) {
+      float t = fmaxf(0.0f, (dist - radius) / approach);
+      float cx, cy, u;
+      closest_point_on_line(x + dx * t, y + dy * t, ax, ay, bx, by, &cx, &cy, &u);
+      if (t <= 1.0f && u > 0.0f && u < 1.0f) {
+        hit = t;
+        *nx = fx;
+        *ny = fy;
+      }
+    }
   }
   
-  // Check for collisions
-  collision_t result;
-  check_collision(map, new_x, new_y, player->z, &result);
-  
-  // No collision - direct move
-  if (!result.collided) {
-    mapsector_t const *new_sector = find_player_sector(map, (int)new_x, (int)new_y);
-    
-    if (can_enter_sector(current, new_sector, player->z)) {
-      player->x = new_x;
-      player->y = new_y;
-      player->z = new_sector->floorheight + EYE_HEIGHT;
+  // Against either end
+  float move_sq = dx*dx + dy*dy;
+  for (int end = 0; end < 2 && move_sq > 0; end++) {
+    float vx = end ? bx : ax;
+    float vy = end ? by : ay;
+    float b = (x - vx) * dx + (y - vy) * dy;
+    if (b > -MIN_APPROACH) continue;
+    float c = dist_sq(x, y, vx, vy) - radius * radius;
+    float t = 0.0f;
+    if (c > 0) {
+      float disc = b*b - move_sq * c;
+      if (disc < 0) continue;
+      t = (-b - sqrtf(disc)) / move_sq;
     }
-    return;
+    if (t > 1.0f || t >= hit) continue;
+    float cx = x + dx * t - vx;
+    float cy = y + dy * t - vy;
+    float d = sqrtf(cx*cx + cy*cy);
+    if (d < EPSILON) continue;
+    hit = t;
+    *nx = cx / d;
+    *ny = cy / d;
   }
-  
-  // Handle corner collisions specially
-  if (result.corner) {
-    handle_corner(map, player, &result, mx, my, depth + 1);
-    return;
+  return hit;
+}
+
+// Walls gathered once per move, laid out for the sweep loop
+typedef struct {
+  int count;
+  uint16_t line[MAX_BLOCK_LINES];
+  float ax[MAX_BLOCK_LINES], ay[MAX_BLOCK_LINES];
+  float bx[MAX_BLOCK_LINES], by[MAX_BLOCK_LINES];
+  bool solid[MAX_BLOCK_LINES];
+} sweep_lines_t;
+
+// Slides keep the length of the move but can turn it any way, so every
+// wall within that length of the start can be reached, not only those
+// along the move
+static void gather_sweep_lines(map_data_t const *map, float x, float y, float mx, float my,
+                               float radius, sweep_lines_t *walls) {
+  float reach = sqrtf(mx*mx + my*my) + radius;
+  walls->count = get_blockmap_lines(map, x - reach, y - reach, x + reach, y + reach,
+                                    walls->line, MAX_BLOCK_LINES);
+  for (int i = 0; i < walls->count; i++) {
+    maplinedef_t const *line = &map->linedefs[walls->line[i]];
+    walls->ax[i] = map->vertices[line->start].x;
+    walls->ay[i] = map->vertices[line->start].y;
+    walls->bx[i] = map->vertices[line->end].x;
+    walls->by[i] = map->vertices[line->end].y;
+  }
+}
+
+/**
+ * Moves the player by (mx, my) within one sector transition, stopping at
+ * the first wall and sliding along it for the rest of the way
+ */
+static void sweep_player(player_t *player, sweep_lines_t const *walls, float mx, float my) {
+  float radius = P_RADIUS + WALL_DIST;
+  
+  for (int slide = 0; slide < MAX_SLIDES; slide++) {
+    float hit = NO_HIT, nx = 0, ny = 0;
+    for (int i = 0; i < walls->count; i++) {
+      if (!walls->solid[i]) continue;
+      float lnx, lny;
+      float t = sweep_circle_segment(player->x, player->y, mx, my, radius,
+                                     walls->ax[i], walls->ay[i], walls->bx[i], walls->by[i],
+                                     &lnx, &lny);
+      if (t < hit) {
+        hit = t;
+        nx = lnx;
+        ny = lny;
+      }
+    }
+    
+    // No collision - direct move
+    if (hit > 1.0f) {
+      player->x += mx;
+      player->y += my;
+      return;
+    }
+    
+    // Stop just short of the wall, then slide the rest of the way
+    float len = sqrtf(mx*mx + my*my);
+    float t = fmaxf(0.0f, hit - EPSILON / len);
+    player->x += mx * t;
+    player->y += my * t;
+    calc_slide(mx * (1.0f - hit), my * (1.0f - hit), nx, ny, &mx, &my);
+    
+    // Drop what is left of the push into the wall so the next sweep
+    // does not stop on it again
+    float into = mx * nx + my * ny;
+    if (into < 0) {
+      mx -= nx * into;
+      my -= ny * into;
+    }
+    if (mx*mx + my*my < EPSILON) return;
   }
-  
-  // Handle collision with sliding
-  float slide_x, slide_y;
-  calc_slide(mx, my, result.nx, result.ny, &slide_x, &slide_y);
-  
-  // Skip if slide vector is very small
-  float slide_len_sq = slide_x * slide_x + slide_y * slide_y;
-  if (slide_len_sq < EPSILON) return;
-  
-  // Try the slide movement recursively
-  update_player_pos(map, player, slide_x, slide_y, depth + 1);
 }
 
 /**
- * Public function to update player position with collision handling
+ * Update player position with collision handling. The move is swept
+ * against the walls in its blockmap cells, in substeps no longer than the
+ * player radius so floor heights and sector changes are checked along it.
  */
 void update_player_position_with_sliding(map_data_t const *map, player_t *player,
                                          float move_x, float move_y) {
-  update_player_pos(map, player, move_x, move_y, 0);
+  mapsector_t const *current = find_player_sector(map, (int)player->x, (int)player->y);
+  
+  // Outside the map there is nothing to collide with
+  if (!current) {
+    player->x += move_x;
+    player->y += move_y;
+    return;
+  }
+  
+  sweep_lines_t walls;
+  gather_sweep_lines(map, player->x, player->y, move_x, move_y, P_RADIUS + WALL_DIST, &walls);
+  
+  float len = sqrtf(move_x * move_x + move_y * move_y);
+  int substeps = MIN(MAX_SUBSTEPS, MAX(1, (int)ceilf(len / P_RADIUS)));
+  for (int step = 0; step < substeps; step++) {
+    // Which walls block depends on the floor the player stands on now
+    for (int i = 0; i < walls.count; i++) {
+      walls.solid[i] = !can_pass_wall(map, &map->linedefs[walls.line[i]], player->z);
+    }
+    
+    float old_x = player->x, old_y = player->y;
+    sweep_player(player, &walls, move_x / substeps, move_y / substeps);
+    
+    mapsector_t const *new_sector = find_player_sector(map, (int)player->x, (int)player->y);
+    if (!can_enter_sector(current, new_sector, player->z)) {
+      player->x = old_x;
+      player->y = old_y;
+      break;
+    }
+    player->z = new_sector->floorheight + EYE_HEIGHT;
+    current = new_sector;
+  }
+  
+  // Push out of any wall the player still overlaps, such as one that
+  // became solid when the floor under it changed
+  collision_t result;
+  check_collision(map, player->x, player->y, player->z, &result);
+  if (result.collided && result.pen > 0) {
+    float new_x = player->x + result.nx * result.pen;
+    float new_y = player->y + result.ny * result.pen;
+    if (can_enter_sector(current, find_player_sector(map, (int)new_x, (int)new_y), player->z)) {
+      player->x = new_x;
+      player->y = new_y;
+    }
+  }
 }
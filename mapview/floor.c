@@ -4,7 +4,7 @@
 #include <mapview/map.h>
 
 // Global variables to add
-extern GLuint world_prog;
+extern GLuint world_prog, flat_prog;
 
 #define MAX_EDGES 0x10000
 #define MAX_VERTICES 1024
@@ -172,7 +172,8 @@ uint32_t get_sector_vertices(map_data_t const *map,
                              uint32_t i,
                              mapvertex_t *sector_vertices)
 {
-  static bool used[MAX_EDGES];
+  // per thread, since background map loads triangulate while the editor rebuilds
+  static _Thread_local bool used[MAX_EDGES];
   
   memset(used, 0, sizeof(used));
   
@@ -239,20 +240,21 @@ static void compute_bbox(mapsector2_t *s, int numverts, mapvertex_t *verts) {
   }
 }
 
-void build_floor_vertex_buffer(map_data_t *map) {
+// Allocates one empty floor/ceiling record per sector
+void init_floor_sectors(map_data_t *map) {
   map->floors.sectors = realloc(map->floors.sectors, sizeof(mapsector2_t) * map->num_sectors);
   memset(map->floors.sectors, 0, sizeof(mapsector2_t) * map->num_sectors);
   for (uint32_t i = 0; i < map->num_sectors; i++) {
     map->floors.sectors[i].sector = &map->sectors[i];
   }
+}
+
+// Extracts and triangulates sector outlines on the CPU, no GL calls
+void build_floor_geometry(map_data_t *map) {
+  init_floor_sectors(map);
   
   map->floors.num_vertices = 0;
-  // Create VAO for walls if not already created
-  if (!map->floors.vao) {
-    glGenVertexArrays(1, &map->floors.vao);
-    glGenBuffers(1, &map->floors.vbo);
-  }
-    
+  
   for (int i = 0; i < map->num_sectors; i++) {
     // Collect all vertices for this sector
     mapvertex_t sector_vertices[MAX_VERTICES]; // Assuming max MAX_VERTICES vertices per sector
@@ -275,11 +277,12 @@ void build_floor_vertex_buffer(map_data_t *map) {
     // Set z height to floor height
     for (int j = 0; j < vertex_count; j++) {
       vertices[j].z = map->sectors[i].floorheight;
+      vertices[j].surface = i;
     }
     
     map->floors.sectors[i].floor.vertex_start = map->floors.num_vertices;
     map->floors.sectors[i].floor.vertex_count = vertex_count;
-    map->floors.sectors[i].floor.texture = get_flat_texture(map->sectors[i].floorpic);
+    map->floors.sectors[i].floor.texture = get_flat_texture_handle(map->sectors[i].floorpic);
 
     memcpy(&map->floors.vertices[map->floors.num_vertices], vertices, vertex_count * sizeof(wall_vertex_t));
     map->floors.num_vertices += vertex_count;
@@ -290,20 +293,31 @@ void build_floor_vertex_buffer(map_data_t *map) {
     
     for (int j = 0; j < vertex_count; j++) {
       vertices[j].z = map->sectors[i].ceilingheight;
+      vertices[j].surface = map->num_sectors + i;
     }
 
     map->floors.sectors[i].ceiling.vertex_start = map->floors.num_vertices;
     map->floors.sectors[i].ceiling.vertex_count = vertex_count;
-    map->floors.sectors[i].ceiling.texture = get_flat_texture(map->sectors[i].ceilingpic);
+    map->floors.sectors[i].ceiling.texture = get_flat_texture_handle(map->sectors[i].ceilingpic);
     
     memcpy(&map->floors.vertices[map->floors.num_vertices], vertices, vertex_count * sizeof(wall_vertex_t));
     map->floors.num_vertices += vertex_count;
   }
   
+}
+
+// Uploads a floor vertex stream, which may live outside map->floors.vertices
+void upload_floor_vertices(map_data_t *map, wall_vertex_t const *vertices, uint32_t count) {
+  // Create VAO for floors if not already created
+  if (!map->floors.vao) {
+    glGenVertexArrays(1, &map->floors.vao);
+    glGenBuffers(1, &map->floors.vbo);
+  }
+  
   // Upload vertex data to GPU
   glBindVertexArray(map->floors.vao);
   glBindBuffer(GL_ARRAY_BUFFER, map->floors.vbo);
-  glBufferData(GL_ARRAY_BUFFER, map->floors.num_vertices * sizeof(wall_vertex_t), map->floors.vertices, GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, count * sizeof(wall_vertex_t), vertices, GL_STATIC_DRAW);
   
   // Set up vertex attributes
   glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, sizeof(wall_vertex_t), OFFSET_OF(wall_vertex_t, x)); // Position
@@ -314,6 +328,30 @@ void build_floor_vertex_buffer(map_data_t *map) {
   glEnableVertexAttribArray(2);
   glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(wall_vertex_t), OFFSET_OF(wall_vertex_t, color)); // Normal
   glEnableVertexAttribArray(3);
+  glVertexAttribIPointer(4, 1, GL_UNSIGNED_SHORT, sizeof(wall_vertex_t), OFFSET_OF(wall_vertex_t, surface)); // Surface
+  glEnableVertexAttribArray(4);
+  
+  // Surface table: floors first, then ceilings, filled by draw_flat_batch
+  // as the sectors become visible. The copy kept in memory starts out
+  // matching it.
+  uint16_t (*surfaces)[2] = realloc(map->floors.surfaces, sizeof(uint16_t[2]) * 2 * (map->num_sectors + 1));
+  if (!surfaces) return;
+  map->floors.surfaces = surfaces;
+  memset(surfaces, 0, sizeof(uint16_t[2]) * 2 * (map->num_sectors + 1));
+  if (!map->floors.surfaces_buf) {
+    glGenBuffers(1, &map->floors.surfaces_buf);
+    glGenTextures(1, &map->floors.surfaces_tex);
+  }
+  glBindBuffer(GL_TEXTURE_BUFFER, map->floors.surfaces_buf);
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(uint16_t[2]) * 2 * map->num_sectors, surfaces, GL_DYNAMIC_DRAW);
+  glBindTexture(GL_TEXTURE_BUFFER, map->floors.surfaces_tex);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RG16UI, map->floors.surfaces_buf);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void build_floor_vertex_buffer(map_data_t *map) {
+  build_floor_geometry(map);
+  upload_floor_vertices(map, map->floors.vertices, map->floors.num_vertices);
 }
 
 int sectors_drawn = 0;
@@ -326,69 +364,94 @@ void draw_wall_ids(map_data_t const *map,
                    mapsector_t const *sector,
                    viewdef_t const *viewdef);
 
-//
-// draw_portals
-// Recursively traverse connected sectors through two-sided linedefs (portals).
-// This function implements portal-based rendering for maps without BSP data.
-//
-// IMPORTANT FIX (2026-01):
-// This function had two critical bugs that caused sectors to drop off during movement:
-// 1. Missing frame tracking: Neighbor sectors were not checked for already being drawn,
-//    causing redundant traversal and potential incorrect culling.
-// 2. Wrong sector heights: The frustum check used the current sector's heights instead
-//    of the neighbor sector's heights, causing incorrect portal rejection when sectors
-//    had different floor/ceiling heights (very common in DOOM maps).
-//
-void draw_portals(map_data_t const *map,
-                  mapsector_t const *sector,
-                  viewdef_t const *viewdef,
-                  void(*func)(map_data_t const *,
-                              mapsector_t const *,
-                              viewdef_t const *))
+// A sector waiting to be traversed and the screen window it is seen through
+typedef struct {
+  uint16_t sector;
+  float window[4];  // NDC x0, y0, x1, y1
+} portal_visit_t;
+
+static portal_visit_t *portal_stack = NULL;
+static int portal_stack_size = 0;
+
+static bool push_portal_visit(int count, uint16_t sector, float const window[4]) {
+  if (count == portal_stack_size) {
+    int size = MAX(64, portal_stack_size * 2);
+    portal_visit_t *stack = realloc(portal_stack, size * sizeof(portal_visit_t));
+    if (!stack) return false;
+    portal_stack = stack;
+    portal_stack_size = size;
+  }
+  portal_stack[count].sector = sector;
+  memcpy(portal_stack[count].window, window, sizeof(float[4]));
+  return true;
+}
+
+static bool is_sky(mapsector_t const *sector) {
+  return !strncmp(sector->ceilingpic, "F_SKY", 5);
+}
+
+// Narrows window to the screen extent of the opening between two sectors
+// along a linedef. Returns false when nothing is left of it. An opening
+// that reaches behind the eye can't be bounded on screen, so it leaves the
+// window as it is.
+static bool clip_portal_window(viewdef_t const *viewdef,
+                               mapvertex_t const *a, mapvertex_t const *b,
+                               mapsector_t const *front, mapsector_t const *back,
+                               float window[4])
 {
+  float bottom = MAX(front->floorheight, back->floorheight);
+  float top = MIN(front->ceilingheight, back->ceilingheight);
+  // upper walls under a sky are not drawn, so the higher sky shows through
+  if (is_sky(front) || is_sky(back)) {
+    top = MAX(front->ceilingheight, back->ceilingheight);
+  }
+  if (top <= bottom) return false;
   
-  for (int i = 0; i < map->num_linedefs; i++) {
-    maplinedef_t const *linedef = &map->linedefs[i];
-    mapvertex_t const *a = &map->vertices[linedef->start];
-    mapvertex_t const *b = &map->vertices[linedef->end];
-    // Skip one-sided linedefs (0xFFFF = no sidedef, standard DOOM format)
-    if (linedef->sidenum[0] == 0xFFFF || linedef->sidenum[1] == 0xFFFF)
-      continue;
-    for (int j = 0; j < 2; j++) {
-      if (map->sidedefs[linedef->sidenum[j]].sector == sector - map->sectors) {
-        // Bounds check the neighboring sidedef index
-        uint16_t neighbor_sidedef_idx = linedef->sidenum[!j];
-        if (neighbor_sidedef_idx >= map->num_sidedefs)
-          continue;
-        
-        // Get the neighboring sector
-        uint32_t neighbor_sector_idx = map->sidedefs[neighbor_sidedef_idx].sector;
-        
-        // Bounds check to prevent buffer overflow
-        if (neighbor_sector_idx >= map->num_sectors)
-          continue;
-        
-        // FIX #1: Check if neighbor sector was already drawn this frame
-        // This prevents redundant traversal and ensures each sector is visited once per frame
-        // Note: frame fields are initialized to 0 via memset in build_floor_vertex_buffer()
-        if (map->floors.sectors[neighbor_sector_idx].frame == viewdef->frame)
-          continue;
-        
-        // FIX #2: Check frustum using proper 3D math for the linedef quad
-        // The linedef forms a 4-pointed polygon in 3D space with floor and ceiling heights
-        // Using the current sector's heights would incorrectly reject portals when sectors
-        // have different floor/ceiling heights (e.g., stairs, lifts, different room heights)
-        mapsector_t const *n = &map->sectors[neighbor_sector_idx];
-        if (linedef_in_frustum(viewdef->frustum, *a, *b, n->floorheight, n->ceilingheight)) {
-          func(map, n, viewdef);
-        }
-      }
-    }
+  vec4 corners[4] = {
+    { a->x, a->y, bottom, 1 }, { a->x, a->y, top, 1 },
+    { b->x, b->y, bottom, 1 }, { b->x, b->y, top, 1 },
+  };
+  float extent[4] = { INFINITY, INFINITY, -INFINITY, -INFINITY };
+  for (int i = 0; i < 4; i++) {
+    vec4 clip;
+    glm_mat4_mulv((vec4 *)viewdef->mvp, corners[i], clip);
+    if (clip[3] < 1.0f) return true;
+    float x = clip[0] / clip[3], y = clip[1] / clip[3];
+    extent[0] = MIN(extent[0], x);
+    extent[1] = MIN(extent[1], y);
+    extent[2] = MAX(extent[2], x);
+    extent[3] = MAX(extent[3], y);
   }
+  window[0] = MAX(window[0], extent[0]);
+  window[1] = MAX(window[1], extent[1]);
+  window[2] = MIN(window[2], extent[2]);
+  window[3] = MIN(window[3], extent[3]);
+  return window[0] < window[2] && window[1] < window[3];
 }
 
-#if 0
+// Grows seen to also cover window. Returns false when it already did.
+static bool merge_portal_window(float seen[4], float const window[4]) {
+  if (window[0] >= seen[0] && window[1] >= seen[1] &&
+      window[2] <= seen[2] && window[3] <= seen[3])
+    return false;
+  seen[0] = MIN(seen[0], window[0]);
+  seen[1] = MIN(seen[1], window[1]);
+  seen[2] = MAX(seen[2], window[2]);
+  seen[3] = MAX(seen[3], window[3]);
+  return true;
+}
 
+//
+// draw_portals
+// Traverse connected sectors through two-sided linedefs (portals), starting
+// at sector, and call func once for every sector that can be seen. Each
+// sector carries the screen window it is seen through; a portal narrows it
+// to its own projected extent and sectors left with an empty window are
+// dropped. A sector reached again through a window it has not been seen
+// through yet grows its window to the union of both and is traversed again
+// through that, but func runs only on the first visit.
+// The traversal uses an explicit stack, so map size does not limit depth.
+//
 void draw_portals(map_data_t const *map,
                   mapsector_t const *sector,
                   viewdef_t const *viewdef,
@@ -396,79 +459,154 @@ void draw_portals(map_data_t const *map,
                               mapsector_t const *,
                               viewdef_t const *))
 {
-  vec2 eye = { viewdef->player.x, viewdef->player.y };
-//  vec2 dir, forward;
-  vec2 left = { viewdef->player.points[0][0], viewdef->player.points[0][1] };
-  vec2 right = { viewdef->player.points[1][0], viewdef->player.points[1][1] };
-  
-  vec2 left2 = { viewdef->player.points2[0][0], viewdef->player.points2[0][1] };
-  vec2 right2 = { viewdef->player.points2[1][0], viewdef->player.points2[1][1] };
-
-//  glm_vec2_add(left, right, dir);
-//  glm_vec2_scale(dir, 0.5f, dir);
-//  glm_vec2_sub(dir, eye, dir);
-//  if (glm_vec2_norm(dir) == 0.0f)
-//    return;
-//  glm_vec2_normalize_to(dir, forward);
-
-  for (int i = 0; i < map->num_linedefs; i++) {
-    maplinedef_t const *ld = &map->linedefs[i];
-    if (ld->sidenum[0] == 0xFFFF || ld->sidenum[1] == 0xFFFF)
-      continue;
+  static float const full_window[4] = { -1, -1, 1, 1 };
+  uint16_t first = (uint16_t)(sector - map->sectors);
+  mapsector2_t *start = &map->floors.sectors[first];
+  
+  if (start->frame != viewdef->frame) {
+    start->frame = viewdef->frame;
+    memcpy(start->window, full_window, sizeof(full_window));
+    func(map, sector, viewdef);
+  }
+  if (!map->topology.portal_start || !push_portal_visit(0, first, full_window)) return;
+  
+  for (int count = 1; count > 0;) {
+    portal_visit_t visit = portal_stack[--count];
+    mapsector_t const *current = &map->sectors[visit.sector];
     
-    for (int j = 0; j < 2; j++) {
-      if (map->sidedefs[ld->sidenum[j]].sector != (int)(sector - map->sectors))
+    for (uint32_t k = map->topology.portal_start[visit.sector]; k < map->topology.portal_start[visit.sector + 1]; k++) {
+      mapportal_t portal = map->topology.portals[k];
+      maplinedef_t const *linedef = &map->linedefs[portal.linedef];
+      mapvertex_t const *a = &map->vertices[linedef->start];
+      mapvertex_t const *b = &map->vertices[linedef->end];
+      mapsector_t const *n = &map->sectors[portal.sector];
+      mapsector2_t *next = &map->floors.sectors[portal.sector];
+      
+      // Check the linedef quad against the frustum with the neighbor's heights,
+      // the current sector's would wrongly reject steps, lifts and the like
+      if (!linedef_in_frustum(viewdef->frustum, *a, *b, n->floorheight, n->ceilingheight))
         continue;
-      if (map->walls.sections[ld->sidenum[!j]].frame == viewdef->frame)
+      
+      float window[4];
+      memcpy(window, visit.window, sizeof(window));
+      if (!clip_portal_window(viewdef, a, b, current, n, window))
         continue;
-      vec2 a = { map->vertices[ld->start].x, map->vertices[ld->start].y };
-      vec2 b = { map->vertices[ld->end].x,   map->vertices[ld->end].y };
-      vec2 ab, lr, new_left, new_right;
-
-      glm_vec2_sub(a, b, ab);
-      glm_vec2_sub(left, right, lr);
-
-      if (glm_vec2_dot(ab, lr) < 0) {
-        vec2 tmp;
-        glm_vec2_copy(a, tmp);
-        glm_vec2_copy(b, a);
-        glm_vec2_copy(tmp, b);
+      
+      if (next->frame == viewdef->frame) {
+        // Already seen; go on only if this window shows more of it
+        if (!merge_portal_window(next->window, window))
+          continue;
+      } else {
+        next->frame = viewdef->frame;
+        memcpy(next->window, window, sizeof(window));
+        func(map, n, viewdef);
       }
+      // Traverse through the whole merged window, later windows are only
+      // skipped when they fall inside it
+      if (!push_portal_visit(count, portal.sector, next->window)) return;
+      count++;
+    }
+  }
+}
 
-      // Frustum clipping: calculate intersection points (if any)
-      glm_vec2_sub(a, eye, new_left);
-      glm_vec2_sub(b, eye, new_right);
+static uint16_t *visible_sectors = NULL;
+static int num_visible_sectors = 0;
 
-      // Check if linedef is in front of eye using signed area (triangle winding)
-      if (glm_vec2_cross(new_left, right) > 0 ||
-          glm_vec2_cross(new_right, left) < 0)
-        continue;
-      
-      if (glm_vec2_cross(new_left, left2) < 0) {
-        glm_vec2_copy(left2, new_left);
-      }
-      
-      if (glm_vec2_cross(new_right, right2) > 0) {
-        glm_vec2_copy(right2, new_right);
-      }
-      
-      if (glm_vec2_eqv_eps(new_left, new_right)) {
-        continue;
+// Multi-draw ranges of draw_flat_batch
+static GLint *flat_first = NULL;
+static GLsizei *flat_size = NULL;
+static int max_flat_ranges = 0;
+
+// Brings the surface entries of the listed sectors up to date with their
+// flat layers and light. Only entries that changed, when a flat got its
+// layer or the light changed, are written and uploaded.
+static void update_flat_surfaces(map_data_t const *map, uint16_t const *sectors, int count, bool ceilings) {
+  extern int pixel;
+  uint32_t dirty_start = UINT32_MAX, dirty_end = 0;
+  for (int side = 0; side < (ceilings ? 2 : 1); side++) {
+    for (int i = 0; i < count; i++) {
+      int s = sectors[i];
+      mapsector2_t const *sec = &map->floors.sectors[s];
+      float light = map->sectors[s].lightlevel / 255.0f;
+      int layer = get_flat_layer(side ? sec->ceiling.texture : sec->floor.texture);
+      bool lit = side ? CHECK_PIXEL(pixel, CEILING, s) : CHECK_PIXEL(pixel, FLOOR, s);
+      uint16_t entry[2] = {
+        layer < 0 ? 0xFFFF : layer,
+        (uint16_t)((lit ? HIGHLIGHT(light) : light) * 255),
+      };
+      uint32_t row = side * map->num_sectors + s;
+      if (memcmp(map->floors.surfaces[row], entry, sizeof(entry))) {
+        memcpy(map->floors.surfaces[row], entry, sizeof(entry));
+        dirty_start = MIN(dirty_start, row);
+        dirty_end = MAX(dirty_end, row + 1);
       }
-      
-      // Prepare recursive view
-      viewdef_t subview = *viewdef;
-      subview.portal = i;
-      glm_vec2_copy(new_left, subview.player.points[0]);
-      glm_vec2_copy(new_right, subview.player.points[1]);
-      
-      map->walls.sections[ld->sidenum[!j]].frame = viewdef->frame;
+    }
+  }
+  if (dirty_start < dirty_end) {
+    glBindBuffer(GL_TEXTURE_BUFFER, map->floors.surfaces_buf);
+    glBufferSubData(GL_TEXTURE_BUFFER, sizeof(uint16_t[2]) * dirty_start,
+                    sizeof(uint16_t[2]) * (dirty_end - dirty_start), map->floors.surfaces[dirty_start]);
+  }
+}
 
-      func(map, &map->sectors[map->sidedefs[ld->sidenum[!j]].sector], &subview);
+// Draws the floors of the listed sectors, and their ceilings if asked to,
+// with one draw call per side. Leaves flat_prog bound; the caller sets its
+// matrix and view position.
+void draw_flat_batch(map_data_t const *map, uint16_t const *sectors, int count, bool ceilings) {
+  if (!count || !map->floors.surfaces_buf || !map->floors.surfaces) return;
+  
+  if (count > max_flat_ranges) {
+    GLint *first = realloc(flat_first, sizeof(GLint) * count);
+    if (first) flat_first = first;
+    GLsizei *size = realloc(flat_size, sizeof(GLsizei) * count);
+    if (size) flat_size = size;
+    if (!first || !size) return;
+    max_flat_ranges = count;
+  }
+  
+  update_flat_surfaces(map, sectors, count, ceilings);
+  
+  glBindVertexArray(map->floors.vao);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_BUFFER, map->floors.surfaces_tex);
+  glActiveTexture(GL_TEXTURE0);
+  bind_palette_textures();
+  glBindTexture(GL_TEXTURE_2D_ARRAY, get_flat_array());
+  
+  for (int side = 0; side < (ceilings ? 2 : 1); side++) {
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+      mapsector2_t const *sec = &map->floors.sectors[sectors[i]];
+      wall_section_t const *surface = side ? &sec->ceiling : &sec->floor;
+      if (!surface->vertex_count) continue;
+      flat_first[n] = surface->vertex_start;
+      flat_size[n++] = surface->vertex_count;
     }
+    glCullFace(side ? GL_FRONT : GL_BACK);
+    glMultiDrawArrays(GL_TRIANGLES, flat_first, flat_size, n);
   }
+  glCullFace(GL_BACK);
+}
+
+visengine_t vis_engine = VIS_PORTALS;
+
+// Records a visible sector for the flat batch
+static void record_sector(map_data_t const *map,
+                          mapsector_t const *sector,
+                          viewdef_t const *viewdef)
+{
+  sectors_drawn++;
+  visible_sectors[num_visible_sectors++] = (uint16_t)(sector - map->sectors);
+}
+
+// Records the flats and walls of a sector found visible by draw_portals
+static void draw_sector(map_data_t const *map,
+                        mapsector_t const *sector,
+                        viewdef_t const *viewdef)
+{
+  record_sector(map, sector, viewdef);
+  draw_walls(map, sector, viewdef);
 }
-#endif
 
 // Main function to draw floors and ceilings
 void draw_floors(map_data_t const *map,
@@ -482,62 +620,36 @@ void draw_floors(map_data_t const *map,
       return;
     }
   }
-  if (map->floors.sectors[sector-map->sectors].frame == viewdef->frame)
-    return;
-
-  sectors_drawn++;
+  
+  uint16_t *visible = realloc(visible_sectors, sizeof(uint16_t) * map->num_sectors);
+  if (!visible) return;
+  visible_sectors = visible;
+  num_visible_sectors = 0;
     
   glDisable(GL_BLEND);
-  glBindVertexArray(map->floors.vao);
-  
-  // Set MVP matrix uniform
-  glUniformMatrix4fv(world_prog_mvp, 1, GL_FALSE, viewdef->mvp[0]);
-  glUniform3fv(world_prog_viewPos, 1, viewdef->viewpos);
-  
-  mapsector2_t *sec = &map->floors.sectors[sector-map->sectors];
-  sec->frame = viewdef->frame;
-  
-  // Use flat color based on sector light level
-  float light = sector->lightlevel / 255.0f;
-  
-  extern int pixel;
-  glCullFace(GL_BACK);
-  if (CHECK_PIXEL(pixel, FLOOR, sector - map->sectors)) {
-    draw_textured_surface(&sec->floor, HIGHLIGHT(light), GL_TRIANGLES);
-  } else {
-    draw_textured_surface(&sec->floor, light, GL_TRIANGLES);
+  begin_wall_batch(map);
+  // The BSP walk hands out only the walls it sees; maps without node
+  // lumps fall back to portals
+  if (vis_engine != VIS_BSP || !render_bsp_view(map, viewdef, record_sector, draw_wall_side)) {
+    draw_portals(map, sector, viewdef, draw_sector);
   }
-  glCullFace(GL_FRONT);
-  if (CHECK_PIXEL(pixel, CEILING, sector - map->sectors)) {
-    draw_textured_surface(&sec->ceiling, HIGHLIGHT(light), GL_TRIANGLES);
-  } else {
-    draw_textured_surface(&sec->ceiling, light, GL_TRIANGLES);
-  }
-  glCullFace(GL_BACK);
   
-  draw_walls(map, sector, viewdef);
-
-  draw_portals(map, sector, viewdef, draw_floors);
+  draw_wall_batch(map, viewdef);
+  glUseProgram(flat_prog);
+  glUniformMatrix4fv(flat_prog_mvp, 1, GL_FALSE, viewdef->mvp[0]);
+  glUniform3fv(flat_prog_viewPos, 1, viewdef->viewpos);
+  glUniform1i(flat_prog_unlit, false);
+  draw_flat_batch(map, visible_sectors, num_visible_sectors, true);
+  glUseProgram(world_prog);
 }
 
-void
-draw_floor_ids(map_data_t const *map,
-               mapsector_t const *sector,
-               viewdef_t const *viewdef)
+static void
+draw_sector_ids(map_data_t const *map,
+                mapsector_t const *sector,
+                viewdef_t const *viewdef)
 {
-  if (!sector) {
-    if (map->sectors) {
-      sector = map->sectors;
-    } else {
-      return;
-    }
-  }
-  if (map->floors.sectors[sector-map->sectors].frame == viewdef->frame)
-    return;
-
   uint32_t i = (uint32_t)(sector - map->sectors);
   mapsector2_t *sec = &map->floors.sectors[sector-map->sectors];
-  sec->frame = viewdef->frame;
   
   glDisable(GL_BLEND);
   glBindVertexArray(map->floors.vao);
@@ -553,7 +665,19 @@ draw_floor_ids(map_data_t const *map,
   glBindTexture(GL_TEXTURE_2D, 0);
   
   draw_wall_ids(map, sector, viewdef);
-
-  draw_portals(map, sector, viewdef, draw_floor_ids);
 }
 
+void
+draw_floor_ids(map_data_t const *map,
+               mapsector_t const *sector,
+               viewdef_t const *viewdef)
+{
+  if (!sector) {
+    if (map->sectors) {
+      sector = map->sectors;
+    } else {
+      return;
+    }
+  }
+  draw_portals(map, sector, viewdef, draw_sector_ids);
+}
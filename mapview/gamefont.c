@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <mapview/map.h>
 #include <mapview/gamefont.h>
 
 #define CONSOLE_FONT_HEIGHT 8
@@ -40,10 +41,7 @@ static const char* FONT_LUMPS_PREFIX = "STCFN";
 extern GLuint white_tex;
 
 // Forward declarations for WAD file functions
-extern int find_lump_num(const char* name);
-extern void* cache_lump_num(int lump);
-extern void* cache_lump(const char* name);
-extern GLuint load_sprite_texture(void *data, int* width, int* height, int* offsetx, int* offsety);
+extern GLuint load_sprite_texture(lumpview_t const *lump, int* width, int* height, int* offsetx, int* offsety);
 
 // Forward declarations
 static bool load_font_char(int font, int char_code);
@@ -58,13 +56,15 @@ static bool load_font_char(int font, int char_code) {
   int width, height, leftoffset, topoffset;
   
 #ifdef HEXEN
-  int texture = load_sprite_texture(cache_lump_num(font+char_code-32), &width, &height, &leftoffset, &topoffset);
+  lumpview_t lump = view_lump_num(font+char_code-32);
 #else
   // Construct font lump name (e.g., "STCFN065" for 'A')
   char lump_name[16];
   snprintf(lump_name, sizeof(lump_name), "%s%03d", FONT_LUMPS_PREFIX, char_code);
-  int texture = load_sprite_texture(cache_lump(lump_name), &width, &height, &leftoffset, &topoffset);
+  lumpview_t lump = view_lump(lump_name);
 #endif
+  int texture = load_sprite_texture(&lump, &width, &height, &leftoffset, &topoffset);
+  release_lump_view(&lump);
   
   // Store character data
   gamefont_state.font[char_code].texture = texture;
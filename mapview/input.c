@@ -7,6 +7,9 @@
 extern bool running;
 extern bool mode;
 
+#define MAX_POINT_SECTORS 64  // Overlapping sectors considered at one point
+#define MAX_CATCHUP_TICS 8    // Tics run in one call after a stall
+
 // Check if a point is inside a sector's bounding box
 static inline bool point_in_bbox(mapsector2_t const* sector, int x, int y) {
   return !(x < sector->bbox[BOXLEFT] || x > sector->bbox[BOXRIGHT] ||
@@ -87,19 +90,11 @@ bool point_in_sector(map_data_t const* map, int x, int y, int secidx) {
     return false;
   }
   
-  // Perform detailed ray-casting test
-  int inside = 0;
-  for (int i = 0; i < map->num_linedefs; i++) {
-    maplinedef_t const* line = &map->linedefs[i];
-    for (int s = 0; s < 2; s++) {
-      int sidenum = line->sidenum[s];
-      if (sidenum == 0xFFFF) continue;
-      if (map->sidedefs[sidenum].sector != secidx) continue;
-      mapvertex_t const* a = &map->vertices[line->start];
-      mapvertex_t const* b = &map->vertices[line->end];
-      if (((a->y>y)!=(b->y>y))&&(x<(b->x-a->x)*(y-a->y)/(b->y-a->y)+a->x))
-        inside = !inside;
-    }
+  // Test the linedefs in the point's blockmap cell, or all of them while
+  // the blockmap is out of date
+  int inside = blockmap_point_in_sector(map, x, y, secidx);
+  if (inside < 0) {
+    return scan_point_in_sector(map, x, y, secidx);
   }
   return inside;
 }
@@ -131,13 +126,21 @@ mapsector_t const *find_player_sector(map_data_t const *map, int x, int y) {
     int px = x;
     int py = y;
   
-    for (int i = 0; i < map->num_sectors; i++) {
-      if (point_in_sector(map, px, py, i)) {
-        // If this is a higher sector than what we've found so far, remember it
-        if (!highest_sector || map->sectors[i].floorheight > highest_floor) {
-          highest_sector = &map->sectors[i];
-          highest_floor = map->sectors[i].floorheight;
-        }
+    uint16_t sectors[MAX_POINT_SECTORS];
+    int count = get_blockmap_sectors(map, px, py, sectors, MAX_POINT_SECTORS);
+    if (count < 0) {
+      // Blockmap is out of date, test every sector
+      count = 0;
+      for (int i = 0; i < map->num_sectors && count < MAX_POINT_SECTORS; i++) {
+        if (point_in_sector(map, px, py, i)) sectors[count++] = i;
+      }
+    }
+  
+    for (int i = 0; i < count; i++) {
+      // If this is a higher sector than what we've found so far, remember it
+      if (!highest_sector || map->sectors[sectors[i]].floorheight > highest_floor) {
+        highest_sector = &map->sectors[sectors[i]];
+        highest_floor = map->sectors[sectors[i]].floorheight;
       }
     }
 //  }
@@ -225,28 +228,70 @@ void handle_scroll(int wheel[], map_data_t *map) {
 //  }
 }
 
-void game_tick(game_t *game) {
-  uint32_t current_time = (uint32_t)axGetMilliseconds();
-  float delta_time = (current_time - game->last_time) / 1000.0f;
-  game->last_time = current_time;
+// Tics due after elapsed milliseconds of the simulation clock
+uint32_t tics_elapsed(uint32_t elapsed) {
+  return (uint32_t)((uint64_t)elapsed * TICRATE / 1000);
+}
 
-  player_t *player = &game->player;
-  // Apply mouse rotation if relative mode is enabled
-  if (true) {
-    // Horizontal mouse movement controls yaw (left/right rotation)
-    player->angle += player->mouse_x_rel * sensitivity_x;
-    
-    // Keep angle within 0-360 range
-    if (player->angle < 0) player->angle += 360;
-    if (player->angle >= 360) player->angle -= 360;
-    
-    // Vertical mouse movement controls pitch (up/down looking)
-    player->pitch -= player->mouse_y_rel * sensitivity_y;
-    
-    // Clamp pitch to prevent flipping over
-    if (player->pitch > 89.0f) player->pitch = 89.0f;
-    if (player->pitch < -89.0f) player->pitch = -89.0f;
+// How far the clock is into the tic after the last one due, from 0 to 1
+float tic_fraction(uint32_t elapsed) {
+  return (float)((uint64_t)elapsed * TICRATE % 1000) / 1000.0f;
+}
+
+// Restarts the simulation clock, such as when the player is placed on a
+// new map, so no tics are owed for the time before
+void reset_game_clock(game_t *game) {
+  game->last_time = (uint32_t)axGetMilliseconds();
+  game->start_time = game->last_time;
+  game->gametic = 0;
+  game->prev_player = game->player;
+}
+
+// Player for drawing, moved between the last two tics by how far the
+// clock is into the next one. Look angles are taken as they are, since
+// the mouse and the look axes turn the player every frame.
+void get_view_player(game_t const *game, player_t *view) {
+  player_t const *prev = &game->prev_player;
+  *view = game->player;
+  float dx = view->x - prev->x, dy = view->y - prev->y;
+  // Farther than a tic can move means the player was placed, not moved
+  if (dx * dx + dy * dy > (MAX_SPEED / TICRATE) * (MAX_SPEED / TICRATE) * 4) {
+    return;
   }
+  float f = tic_fraction(game->last_time - game->start_time);
+  view->x = prev->x + dx * f;
+  view->y = prev->y + dy * f;
+  view->z = prev->z + (view->z - prev->z) * f;
+}
+
+// Degrees a look axis turns the view in ms, one step of it per tic
+static float look_turn(float axis, float sensitivity, uint32_t ms) {
+  return axis * sensitivity * TICRATE * ms / 1000.0f;
+}
+
+// Turns the player by the look axes for the time since the last frame.
+// This runs every frame rather than in player_tic, so the view does not
+// turn in steps at TICRATE.
+static void player_look(player_t *player, uint32_t ms) {
+  ms = MIN(ms, MAX_CATCHUP_TICS * 1000 / TICRATE);
+  
+  // Horizontal axis controls yaw (left/right rotation)
+  player->angle = fmodf(player->angle + look_turn(player->mouse_x_rel, sensitivity_x, ms), 360);
+  if (player->angle < 0) player->angle += 360;
+  
+  // Vertical axis controls pitch (up/down looking)
+  player->pitch -= look_turn(player->mouse_y_rel, sensitivity_y, ms);
+  
+  // Clamp pitch to prevent flipping over
+  if (player->pitch > 89.0f) player->pitch = 89.0f;
+  if (player->pitch < -89.0f) player->pitch = -89.0f;
+}
+
+// One fixed step of player physics
+static void player_tic(game_t *game) {
+  float const delta_time = 1.0f / TICRATE;
+
+  player_t *player = &game->player;
   
   // Convert player angle to radians for movement calculations
   float angle_rad = player->angle * M_PI / 180.0;
@@ -302,9 +347,27 @@ void game_tick(game_t *game) {
   
   // Update position
   
-  if (player->vel_x != 0 && player->vel_y != 0) {
-      player->x += player->vel_x * delta_time;
-      player->y += player->vel_y * delta_time;
-//    update_player_position_with_sliding(&game->map, player, player->vel_x * delta_time, player->vel_y * delta_time);
+  if (player->vel_x != 0 || player->vel_y != 0) {
+    update_player_position_with_sliding(&game->map, player, player->vel_x * delta_time, player->vel_y * delta_time);
+  }
+}
+
+// Turns the view for this frame, then runs the tics due by now at
+// TICRATE, whatever the paint rate is
+void game_tick(game_t *game) {
+  uint32_t now = (uint32_t)axGetMilliseconds();
+  player_look(&game->player, now - game->last_time);
+  game->last_time = now;
+  uint32_t due = tics_elapsed(game->last_time - game->start_time);
+  
+  // After a stall, drop the backlog rather than running it all at once
+  if (due - game->gametic > MAX_CATCHUP_TICS) {
+    game->gametic = due - MAX_CATCHUP_TICS;
+  }
+  
+  while (game->gametic != due) {
+    game->prev_player = game->player;
+    player_tic(game);
+    game->gametic++;
   }
 }
@@ -0,0 +1,110 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <mapview/map.h>
+
+// Background map loading.
+//
+// A load runs in three stages. The worker thread reads the map lumps
+// (LOAD_PARSING), then builds wall sections, sector outlines and floor
+// triangles or restores them from the map cache (LOAD_BUILDING). It then
+// parks in LOAD_UPLOADING until the main thread, which owns the GL
+// context, polls the loader and uploads the vertex streams.
+//
+// The loader is shared by the worker and the caller and freed by whichever
+// lets go last, so cancelling never waits for the worker to notice.
+
+struct maploader_s {
+  char name[64];
+  map_data_t map;
+  mapcache_t cache;
+  bool from_cache;
+  atomic_int state;
+  atomic_bool cancelled;
+  atomic_int refs;
+};
+
+static bool is_cancelled(maploader_t *loader) {
+  return atomic_load(&loader->cancelled);
+}
+
+static void release_loader(maploader_t *loader) {
+  if (atomic_fetch_sub(&loader->refs, 1) != 1) return;
+  close_map_cache(&loader->cache);
+  free_map_data(&loader->map);
+  free(loader);
+}
+
+static void *map_load_worker(void *arg) {
+  maploader_t *loader = arg;
+  map_data_t *map = &loader->map;
+  loadstate_t result = LOAD_FAILED;
+
+  if (load_map_data(map, loader->name) && !is_cancelled(loader)) {
+    atomic_store(&loader->state, LOAD_BUILDING);
+    loader->from_cache = open_map_cache(map, loader->name, &loader->cache);
+    if (!loader->from_cache) {
+      build_wall_geometry(map);
+      if (!is_cancelled(loader)) build_floor_geometry(map);
+      // the blockmap came with the wall sections, so things are located through its cells
+      for (int i = 0; i < map->num_things && !is_cancelled(loader); i++) {
+        assign_thing_sector(map, &map->things[i]);
+      }
+      if (!is_cancelled(loader)) save_map_cache(map, loader->name);
+    }
+    result = LOAD_UPLOADING;
+  }
+
+  atomic_store(&loader->state, is_cancelled(loader) ? LOAD_CANCELLED : result);
+  release_loader(loader);
+  return NULL;
+}
+
+// Starts loading map_name on a worker thread. Poll the returned loader
+// from the main thread until it leaves the loading states, then release it.
+maploader_t *start_map_load(const char *map_name) {
+  maploader_t *loader = calloc(1, sizeof(maploader_t));
+  if (!loader) return NULL;
+  snprintf(loader->name, sizeof(loader->name), "%s", map_name);
+  atomic_init(&loader->state, LOAD_PARSING);
+  atomic_init(&loader->cancelled, false);
+  atomic_init(&loader->refs, 2);
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, map_load_worker, loader) != 0) {
+    printf("Error: Could not start loader thread for %s\n", map_name);
+    free(loader);
+    return NULL;
+  }
+  pthread_detach(thread);
+  return loader;
+}
+
+// Returns the current stage of the load. Once the worker is done this
+// moves the map into out and uploads its vertex buffers, so it must be
+// called on the thread that owns the GL context.
+loadstate_t poll_map_load(maploader_t *loader, map_data_t *out) {
+  loadstate_t state = atomic_load(&loader->state);
+  if (state != LOAD_UPLOADING) return state;
+
+  memcpy(out, &loader->map, sizeof(map_data_t));
+  memset(&loader->map, 0, sizeof(map_data_t));
+  if (loader->from_cache) {
+    upload_wall_vertices(out, loader->cache.wall_vertices, loader->cache.num_wall_vertices);
+    upload_floor_vertices(out, loader->cache.floor_vertices, loader->cache.num_floor_vertices);
+    close_map_cache(&loader->cache);
+  } else {
+    upload_wall_vertices(out, out->walls.vertices, out->walls.num_vertices);
+    upload_floor_vertices(out, out->floors.vertices, out->floors.num_vertices);
+  }
+
+  atomic_store(&loader->state, LOAD_READY);
+  return LOAD_READY;
+}
+
+// Drops the caller's hold on the loader. A load that has not been picked
+// up yet is cancelled; the worker stops at its next checkpoint.
+void release_map_load(maploader_t *loader) {
+  if (!loader) return;
+  atomic_store(&loader->cancelled, true);
+  release_loader(loader);
+}
@@ -36,26 +36,26 @@ static void init_windows(hinstance_t hinstance) {
 
 bool gem_init(int argc, char *argv[], hinstance_t hinstance) {
   if (argc < 2) {
-    printf("Usage: doom-ed <wad_file>\n");
+    printf("Usage: doom-ed <iwad_file> [pwad_file ...]\n");
     return false;
   }
 
-  const char *filename = argv[1];
-
-  if (!init_wad(filename)) {
-    printf("Error: Could not open file %s\n", filename);
+  // argv[1] is the IWAD, every following file is a PWAD layered on top
+  if (!init_wad_stack((const char **)&argv[1], argc - 1)) {
+    printf("Error: Could not open WAD files\n");
     return false;
   }
 
-  if (!cache_lump("PLAYPAL")) {
+  extern palette_entry_t *palette;
+  palette = cache_lump("PLAYPAL");
+  if (!palette) {
     printf("Error: Required lump not found (PLAYPAL)\n");
     return false;
   }
-  extern palette_entry_t *palette;
-  palette = cache_lump("PLAYPAL");
 
   ui_joystick_init();
   init_resources();
+  update_palette_textures();
   init_floor_shader();
   init_sky_geometry();
   init_radial_menu();
@@ -2,6 +2,7 @@
 #define __MAP__
 
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
@@ -36,6 +37,7 @@ if ((map)->name) free((map)->name); \
 #define EYE_HEIGHT 48 // Typical eye height in Doom is 41 units above floor
 #define MAX_WALL_VERTICES 50000  // Adjust based on map complexity
 #define P_RADIUS 12.0f        // Player radius
+#define BLOCKSIZE 128         // Blockmap cell size in map units
 #define PALETTE_WIDTH 24
 #define NOTEX_SIZE 64
 #define SPRITE_SCALE 2
@@ -78,6 +80,14 @@ enum {
 #define FRICTION     1200.0f
 #define MAX_SPEED    300.0f
 
+// Simulation and paint rates, override with -DTICRATE=n or -DMAX_FPS=n
+#ifndef TICRATE
+#define TICRATE      35       // Player physics steps per second, as in Doom
+#endif
+#ifndef MAX_FPS
+#define MAX_FPS      120      // Paints per second while the game window is focused
+#endif
+
 // Lump order in a map WAD: each map needs a couple of lumps
 // to provide a complete scene geometry description.
 enum
@@ -121,6 +131,7 @@ typedef struct {
   int16_t x, y, z;    // Position
   int16_t u, v;       // Texture coordinates
   int8_t nx, ny, nz;  // Normal
+  uint16_t surface;   // Floors: row in the flat surface table, see draw_floors
   int32_t color;
 } wall_vertex_t;
 
@@ -132,11 +143,22 @@ typedef struct {
   uint16_t height;
 } mapside_texture_t;
 
+// Stable reference to a texture registry entry, 0 for none
+typedef uint32_t texhandle_t;
+
+// Array texture holding resident wall textures of one size class
+typedef struct {
+  uint32_t texture;
+  uint16_t width;
+  uint16_t height;
+  int layers;
+} texpage_t;
+
 // Helper struct for tracking wall sections
 typedef struct {
   uint32_t vertex_start;  // Starting index in the vertex buffer
   uint32_t vertex_count;  // Count of vertices
-  mapside_texture_t const *texture;  // Texture to use
+  texhandle_t texture;    // Texture to use
 } wall_section_t;
 
 // WAD header structure
@@ -153,6 +175,35 @@ typedef struct {
   lumpname_t name;           // Name of the lump, null-terminated
 } filelump_t;
 
+// Marker-delimited lump namespaces (S_START/S_END, F_START/F_END, ...)
+typedef enum {
+  NS_GLOBAL,
+  NS_SPRITES,
+  NS_FLATS,
+  NS_PATCHES,
+} lumpns_t;
+
+// Read-only window onto a lump's bytes. In mmap mode data points straight
+// into the mapped WAD; otherwise it is the lump cache's copy. The view holds
+// a cache reference until release_lump_view.
+typedef struct {
+  uint8_t const *data;
+  uint32_t size;
+  int lump;
+} lumpview_t;
+
+#define MAX_WAD_FILES 16  // IWAD plus PWADs
+#define LUMP_CACHE_BUDGET (64 << 20)  // heap bytes kept for released lumps
+
+typedef struct {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t purges;
+  size_t bytes_resident;   // heap bytes held by cached lumps
+  size_t bytes_purgeable;  // of which unreferenced and on the LRU list
+  size_t budget;
+} lumpcache_stats_t;
+
 // Patch header structure
 typedef struct {
   int16_t width;              // Width of the patch
@@ -239,6 +290,35 @@ typedef struct {
   int16_t tag;               // Tag number
 } mapsector_t;
 
+// Linedef piece from the SEGS lump, split by the node builder
+typedef struct {
+  uint16_t v1;               // Start vertex
+  uint16_t v2;               // End vertex
+  uint16_t angle;            // Direction as a binary angle
+  uint16_t linedef;          // Linedef this seg is part of
+  uint16_t side;             // 0 along the linedef's front, 1 its back
+  uint16_t offset;           // Distance along the linedef to the start
+} mapseg_t;
+
+// Convex subsector from the SSECTORS lump, a run of segs
+typedef struct {
+  uint16_t numsegs;
+  uint16_t firstseg;
+} mapsubsector_t;
+
+// Subtree references with this bit set are subsectors
+#define NF_SUBSECTOR 0x8000
+
+// BSP node from the NODES lump
+typedef struct {
+  int16_t x;                 // Partition line start
+  int16_t y;
+  int16_t dx;                // Partition line direction
+  int16_t dy;
+  int16_t bbox[2][4];        // Bounding boxes of the right and left child
+  uint16_t children[2];      // Right (front) and left (back) child
+} mapnode_t;
+
 // Wall section references
 typedef struct {
   mapsidedef_t *def;
@@ -255,8 +335,30 @@ typedef struct {
   wall_section_t ceiling;
   uint32_t frame;
   int16_t  bbox[4];
+  float    window[4];  // screen rect the sector was seen through this frame
 } mapsector2_t;
 
+// A linedef side facing into a sector; side 0 is the front
+typedef struct {
+  uint16_t linedef;
+  uint16_t side;
+} mapsideref_t;
+
+// A two-sided linedef leading out of a sector into a neighbouring one
+typedef struct {
+  uint16_t linedef;
+  uint16_t sector;
+} mapportal_t;
+
+// A sector overlapping a blockmap cell: whether the cell's reference point
+// is inside it, and its linedefs in the cell, which run up to the next
+// entry's first_line
+typedef struct {
+  uint16_t sector;
+  uint16_t inside;
+  uint32_t first_line;
+} mapcellsector_t;
+
 // Palette structure
 typedef struct {
   uint8_t r;
@@ -279,12 +381,20 @@ typedef struct {
   DEFINE_COLLECTION(mapsidedef_t, sidedefs);
   DEFINE_COLLECTION(mapthing_t, things);
   DEFINE_COLLECTION(mapsector_t, sectors);
+  DEFINE_COLLECTION(mapseg_t, segs);
+  DEFINE_COLLECTION(mapsubsector_t, subsectors);
+  DEFINE_COLLECTION(mapnode_t, nodes);
+  // Vertices the segs index: the map's vertices when the nodes were built
+  // plus the points where segs were split
+  DEFINE_COLLECTION(mapvertex_t, node_vertices);
 
   struct {
     mapsidedef2_t *sections;
     wall_vertex_t vertices[MAX_WALL_VERTICES];
     uint32_t num_vertices;
     uint32_t vao, vbo;
+    uint32_t surfaces_buf, surfaces_tex;  // per-quad page layer, size and light
+    uint16_t (*surfaces)[4];  // what surfaces_buf holds, see draw_wall_batch
   } walls;
   
   struct {
@@ -292,9 +402,52 @@ typedef struct {
     wall_vertex_t vertices[MAX_WALL_VERTICES];
     uint32_t num_vertices;
     uint32_t vao, vbo;
+    uint32_t surfaces_buf, surfaces_tex;  // per-surface flat layer and light
+    uint16_t (*surfaces)[2];  // what surfaces_buf holds, see draw_flat_batch
   } floors;
+  
+  // Sector adjacency in compressed rows: the entries of sector i are
+  // [start[i], start[i + 1]). Rebuilt with the wall sections.
+  struct {
+    uint32_t *side_start;
+    mapsideref_t *sides;
+    uint32_t *portal_start;
+    mapportal_t *portals;
+  } topology;
+  
+  // Linedefs crossing each BLOCKSIZE cell in compressed rows, row-major
+  // from the lower left corner, the sectors overlapping each cell, and
+  // whether each vertex is a corner for collision. Rebuilt with the wall
+  // sections.
+  struct {
+    int16_t x, y;              // Lower left corner of the first cell
+    int width, height;         // Size in cells
+    uint32_t *cell_start;
+    uint16_t *lines;
+    uint32_t *line_stamps;     // Query marks, one per linedef
+    bool *corners;
+    int num_corners;
+    uint32_t *sector_start;    // Entries of each cell, same rows as cell_start
+    mapcellsector_t *sectors;  // Ends with an entry closing the last line run
+    uint16_t *sector_lines;
+    bool *open_sectors;        // Boundary does not close, located by a full scan
+    uint16_t *open_list;
+    int num_open;
+    int num_linedefs, num_sidedefs, num_sectors;  // Map size when built
+  } blockmap;
 } map_data_t;
 
+// Precompiled geometry read back from the on-disk map cache
+typedef struct {
+  void *base;
+  size_t size;
+  bool mapped;
+  wall_vertex_t const *wall_vertices;
+  wall_vertex_t const *floor_vertices;
+  uint32_t num_wall_vertices;
+  uint32_t num_floor_vertices;
+} mapcache_t;
+
 typedef struct {
   mat4 mvp;
   vec4 frustum[6];
@@ -305,11 +458,16 @@ typedef struct {
   uint32_t time;
 } viewdef_t;
 
-// Collection to store loaded textures
+// Collection to store loaded textures, hashed by name and grown on demand
 typedef struct texture_cache_s {
   int num_textures;
+  int capacity;
   texname_t selected;
-  mapside_texture_t textures[1];
+  mapside_texture_t *textures;
+  struct texslot_s *slots;  // residency state, parallel to textures
+  int32_t *buckets;         // open-addressed name index, -1 when empty
+  uint32_t mask;
+  uint32_t id;              // registry tag carried in texhandle_t
 } texture_cache_t;
 
 typedef enum {
@@ -355,10 +513,29 @@ typedef struct {
   mapvertex_t sn;
 } editor_state_t;
 
+// Stages of a background map load, see loader.c. LOAD_READY is zero so a
+// blank map counts as loaded.
+typedef enum {
+  LOAD_READY,
+  LOAD_PARSING,
+  LOAD_BUILDING,
+  LOAD_UPLOADING,
+  LOAD_FAILED,
+  LOAD_CANCELLED,
+} loadstate_t;
+
+typedef struct maploader_s maploader_t;
+
 typedef struct {
   int episode;
   int level;
   uint32_t last_time;
+  uint32_t start_time;    // Clock time of the first tic
+  uint32_t gametic;       // Tics simulated since start_time
+  player_t prev_player;   // Player before the latest tic, for interpolation
+  char mapname[64];
+  maploader_t *loader;  // set while the map is still loading
+  loadstate_t load_state;
   map_data_t map;
   player_t player;
   editor_state_t state;
@@ -401,12 +578,28 @@ filelump_t *find_lump(const char* name);
 void *cache_lump(const char* name);
 void *cache_lump_num(uint16_t i);
 int find_lump_num(const char* name);
+int find_lump_num_ns(const char* name, lumpns_t ns);
+int next_lump_in_ns(int i, lumpns_t ns);
+int get_num_wad_files(void);
 char const *get_lump_name(int i);
+uint32_t get_lump_size(int i);
+lumpview_t view_lump(const char* name);
+lumpview_t view_lump_num(int i);
+void release_lump_view(lumpview_t *view);
+void *acquire_lump(const char* name);
+void *acquire_lump_num(int i);
+void release_lump_num(int i);
+void set_lump_cache_budget(size_t bytes);
+void get_lump_cache_stats(lumpcache_stats_t *stats);
+bool lump_view_has(lumpview_t const *view, uint32_t offset, uint32_t length);
 
 int allocate_mapside_textures(void);
 int allocate_flat_textures(void);
+void request_texture(mapside_texture_t const *tex);
+void request_texture_image(mapside_texture_t const *tex);
+bool update_texture_residency(void);
+void prefetch_map_textures(map_data_t const *map);
 
-uint8_t* load_patch(void* patch_lump, int* width, int* height);
 void compute_sector_bbox(map_data_t *map, int sector_index);
 void compute_all_sector_bboxes(map_data_t *map);
 bool point_in_sector(map_data_t const* map, int x, int y, int sector_index);
@@ -414,14 +607,64 @@ void assign_thing_sector(map_data_t const *map, mapthing_t *thing);
 mapsector_t const *find_player_sector(map_data_t const* map, int x, int y);
 mapside_texture_t const *get_texture(const char* name);
 mapside_texture_t const *get_flat_texture(const char* name);
+texhandle_t get_texture_handle(const char* name);
+texhandle_t get_flat_texture_handle(const char* name);
+mapside_texture_t const *get_texture_by_handle(texhandle_t handle);
+uint32_t get_flat_array(void);
+int get_flat_layer(texhandle_t handle);
+int get_num_wall_pages(void);
+texpage_t const *get_wall_page(int page);
+int get_wall_layer(texhandle_t handle, int *page);
 void build_wall_vertex_buffer(map_data_t *map);
 void build_floor_vertex_buffer(map_data_t *map);
-void draw_textured_surface(wall_section_t const *surface, float light, int mode);
+void init_wall_sections(map_data_t *map);
+void build_sector_topology(map_data_t *map);
+void free_sector_topology(map_data_t *map);
+void build_blockmap(map_data_t *map);
+void free_blockmap(map_data_t *map);
+int get_blockmap_lines(map_data_t const *map, float x1, float y1, float x2, float y2,
+                       uint16_t *lines, int max_lines);
+int get_blockmap_sectors(map_data_t const *map, int x, int y, uint16_t *sectors, int max_sectors);
+int blockmap_point_in_sector(map_data_t const *map, int x, int y, int sector);
+bool scan_point_in_sector(map_data_t const *map, int x, int y, int sector);
+void init_floor_sectors(map_data_t *map);
+void build_wall_geometry(map_data_t *map);
+void build_floor_geometry(map_data_t *map);
+void upload_wall_vertices(map_data_t *map, wall_vertex_t const *vertices, uint32_t count);
+void upload_floor_vertices(map_data_t *map, wall_vertex_t const *vertices, uint32_t count);
+void draw_flat_batch(map_data_t const *map, uint16_t const *sectors, int count, bool ceilings);
+void update_palette_textures(void);
+void bind_palette_textures(void);
+void begin_wall_batch(map_data_t const *map);
+void draw_wall_batch(map_data_t const *map, viewdef_t const *viewdef);
 void draw_textured_surface_id(wall_section_t const *surface, uint32_t id, int mode);
 void draw_bsp(map_data_t const *map, viewdef_t const *viewdef);
+void draw_wall_side(map_data_t const *map, uint16_t linedef, int side);
+
+// Visibility engine used by draw_floors
+typedef enum {
+  VIS_PORTALS,   // Sector portal traversal with screen windows
+  VIS_BSP,       // BSP walk with solid wall occlusion, needs node lumps
+} visengine_t;
+
+extern visengine_t vis_engine;
+
+// Partition search effort of build_map_nodes
+typedef enum {
+  NODEBUILD_FAST,      // Small candidate sample, for previews while editing
+  NODEBUILD_THOROUGH,  // Large candidate sample, for release
+} nodebuild_mode_t;
+bool render_bsp_view(map_data_t const *map, viewdef_t const *viewdef,
+                     void (*add_sector)(map_data_t const *, mapsector_t const *, viewdef_t const *),
+                     void (*add_side)(map_data_t const *, uint16_t linedef, int side));
 
 void update_player_position_with_sliding(map_data_t const *map, player_t *player,
                                          float move_x, float move_y);
+void game_tick(game_t *game);
+void reset_game_clock(game_t *game);
+void get_view_player(game_t const *game, player_t *view);
+uint32_t tics_elapsed(uint32_t elapsed);
+float tic_fraction(uint32_t elapsed);
 
 void fill_rect(uint32_t color, irect16_t r);
 void draw_rect(int tex, irect16_t r);
@@ -436,6 +679,16 @@ int get_flat_texture_index(char const* name);
 float dist_sq(float x1, float y1, float x2, float y2);
 
 map_data_t load_map(const char* map_name);
+bool load_map_data(map_data_t *map, const char* map_name);
+maploader_t *start_map_load(const char *map_name);
+loadstate_t poll_map_load(maploader_t *loader, map_data_t *out);
+void release_map_load(maploader_t *loader);
+void parallel_for(int count, void (*job)(int index, void *parm), void *parm);
+int get_num_workers(void);
+bool build_map_nodes(map_data_t *map, nodebuild_mode_t mode);
+bool open_map_cache(map_data_t *map, const char *map_name, mapcache_t *cache);
+void close_map_cache(mapcache_t *cache);
+bool save_map_cache(map_data_t const *map, const char *map_name);
 void find_all_maps(void (*proc)(const char *, void *), void *parm);
 void print_map_info(map_data_t* map);
 void free_map_data(map_data_t* map);
@@ -445,6 +698,7 @@ void new_map(void);
 void open_map(const char *mapname);
 
 bool init_wad(const char *filename);
+bool init_wad_stack(const char **filenames, int count);
 void shutdown_wad(void);
 
 void handle_windows(void);
@@ -468,5 +722,12 @@ extern int ui_prog_tex0_size;
 extern int ui_prog_tex0;
 extern int ui_prog_color;
 
+extern int flat_prog_mvp;
+extern int flat_prog_viewPos;
+extern int flat_prog_unlit;
+
+extern int wall_prog_mvp;
+extern int wall_prog_viewPos;
+
 
 #endif
@@ -0,0 +1,324 @@
+#include <sys/stat.h>
+#include <mapview/map.h>
+
+// Precompiled map geometry cache.
+//
+// After a map has been built, its wall and floor vertex streams, section
+// tables, sector bboxes and thing sectors are written to one file named
+// after a hash of the map lumps. Reopening the same map maps that file
+// and uploads the vertex streams straight from it, skipping sector loop
+// extraction and triangulation.
+//
+// File layout, all in host byte order:
+//   mapcache_header_t
+//   wall_vertex_t       walls[num_wall_vertices]
+//   wall_vertex_t       floors[num_floor_vertices]
+//   mapcache_side_t     sides[num_sidedefs]
+//   mapcache_sector_t   sectors[num_sectors]
+//   int16_t             thing_sectors[num_things]
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPCACHE_USE_MMAP
+#include <sys/mman.h>
+#endif
+
+#define MAPCACHE_MAGIC "DMAP"
+#define MAPCACHE_VERSION 3
+
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  uint32_t num_wall_vertices;
+  uint32_t num_floor_vertices;
+  uint32_t num_sidedefs;
+  uint32_t num_sectors;
+  uint32_t num_things;
+  uint32_t vertex_size;
+} mapcache_header_t;
+
+typedef struct {
+  uint32_t vertex_start;
+  uint32_t vertex_count;
+} mapcache_section_t;
+
+typedef struct {
+  mapcache_section_t upper, lower, mid;
+} mapcache_side_t;
+
+typedef struct {
+  mapcache_section_t floor, ceiling;
+  int16_t bbox[4];
+} mapcache_sector_t;
+
+static uint64_t fnv1a64(uint64_t hash, void const *data, size_t size) {
+  uint8_t const *bytes = data;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Hashes the map lumps the geometry is derived from. Which wall textures
+// exist is hashed too, since a missing mid texture means no mid section.
+static uint64_t map_cache_key(map_data_t const *map, const char *map_name) {
+  static const int lumps[] = { ML_THINGS, ML_LINEDEFS, ML_SIDEDEFS, ML_VERTEXES, ML_SECTORS };
+  uint32_t version[2] = { MAPCACHE_VERSION, sizeof(wall_vertex_t) };
+  uint64_t hash = fnv1a64(0xcbf29ce484222325ULL, version, sizeof(version));
+
+  int map_index = find_lump_num(map_name);
+  if (map_index < 0) return 0;
+  for (int i = 0; i < sizeof(lumps) / sizeof(*lumps); i++) {
+    lumpview_t view = view_lump_num(map_index + lumps[i]);
+    hash = fnv1a64(hash, &view.size, sizeof(view.size));
+    if (view.data) hash = fnv1a64(hash, view.data, view.size);
+    release_lump_view(&view);
+  }
+
+  for (int i = 0; i < map->num_sidedefs; i++) {
+    mapsidedef_t const *side = &map->sidedefs[i];
+    uint8_t present = (get_texture_index(side->toptexture) >= 0 ? 1 : 0) |
+                      (get_texture_index(side->bottomtexture) >= 0 ? 2 : 0) |
+                      (get_texture_index(side->midtexture) >= 0 ? 4 : 0);
+    hash = fnv1a64(hash, &present, 1);
+  }
+  return hash;
+}
+
+static void map_cache_path(char *path, size_t size, uint64_t key) {
+  char const *dir = getenv("DOOMED_CACHE_DIR");
+  char const *home = getenv("HOME");
+  if (dir) {
+    snprintf(path, size, "%s", dir);
+  } else if (home) {
+    snprintf(path, size, "%s/.cache/doom-ed", home);
+  } else {
+    snprintf(path, size, ".mapcache");
+  }
+  size_t len = strlen(path);
+  snprintf(path + len, size - len, "/%016llx.map", (unsigned long long)key);
+}
+
+// Creates every missing directory leading up to the file at path
+static void make_parent_dirs(char const *path) {
+  char tmp[512];
+  snprintf(tmp, sizeof(tmp), "%s", path);
+  for (char *p = tmp + 1; *p; p++) {
+    if (*p != '/') continue;
+    *p = '\0';
+    mkdir(tmp, 0755);
+    *p = '/';
+  }
+}
+
+static size_t map_cache_size(mapcache_header_t const *h) {
+  return sizeof(mapcache_header_t) +
+         sizeof(wall_vertex_t) * (h->num_wall_vertices + h->num_floor_vertices) +
+         sizeof(mapcache_side_t) * h->num_sidedefs +
+         sizeof(mapcache_sector_t) * h->num_sectors +
+         sizeof(int16_t) * h->num_things;
+}
+
+static bool section_fits(mapcache_section_t const *s, uint32_t num_vertices) {
+  return s->vertex_start <= num_vertices && s->vertex_count <= num_vertices - s->vertex_start;
+}
+
+static void restore_section(wall_section_t *out, mapcache_section_t const *in,
+                            texhandle_t texture) {
+  out->vertex_start = in->vertex_start;
+  out->vertex_count = in->vertex_count;
+  out->texture = in->vertex_count ? texture : 0;
+}
+
+// Maps the cache file for this map and, if it matches, restores sections,
+// bboxes and thing sectors into map. The vertex streams stay mapped in
+// cache until close_map_cache, so they can be uploaded without a copy.
+bool open_map_cache(map_data_t *map, const char *map_name, mapcache_t *cache) {
+  memset(cache, 0, sizeof(mapcache_t));
+
+  uint64_t key = map_cache_key(map, map_name);
+  if (!key) return false;
+
+  char path[512];
+  map_cache_path(path, sizeof(path), key);
+  FILE *file = fopen(path, "rb");
+  if (!file) return false;
+
+  fseek(file, 0, SEEK_END);
+  size_t size = (size_t)ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (size < sizeof(mapcache_header_t)) {
+    fclose(file);
+    return false;
+  }
+
+  uint8_t *base = NULL;
+#ifdef MAPCACHE_USE_MMAP
+  void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+  if (mapped != MAP_FAILED) {
+    base = mapped;
+    cache->mapped = true;
+  }
+#endif
+  if (!base) {
+    base = malloc(size);
+    if (!base || fread(base, 1, size, file) != size) {
+      free(base);
+      fclose(file);
+      return false;
+    }
+  }
+  fclose(file);
+  cache->base = base;
+  cache->size = size;
+
+  mapcache_header_t const *h = (mapcache_header_t const *)base;
+  if (memcmp(h->magic, MAPCACHE_MAGIC, 4) != 0 ||
+      h->version != MAPCACHE_VERSION ||
+      h->vertex_size != sizeof(wall_vertex_t) ||
+      h->key != key ||
+      h->num_sidedefs != map->num_sidedefs ||
+      h->num_sectors != map->num_sectors ||
+      h->num_things != map->num_things ||
+      h->num_wall_vertices > MAX_WALL_VERTICES ||
+      h->num_floor_vertices > MAX_WALL_VERTICES ||
+      map_cache_size(h) != size) {
+    printf("Warning: Ignoring stale map cache %s\n", path);
+    close_map_cache(cache);
+    return false;
+  }
+
+  uint8_t const *p = base + sizeof(mapcache_header_t);
+  cache->wall_vertices = (wall_vertex_t const *)p;
+  cache->num_wall_vertices = h->num_wall_vertices;
+  p += sizeof(wall_vertex_t) * h->num_wall_vertices;
+  cache->floor_vertices = (wall_vertex_t const *)p;
+  cache->num_floor_vertices = h->num_floor_vertices;
+  p += sizeof(wall_vertex_t) * h->num_floor_vertices;
+  mapcache_side_t const *sides = (mapcache_side_t const *)p;
+  p += sizeof(mapcache_side_t) * h->num_sidedefs;
+  mapcache_sector_t const *sectors = (mapcache_sector_t const *)p;
+  p += sizeof(mapcache_sector_t) * h->num_sectors;
+  int16_t const *thing_sectors = (int16_t const *)p;
+
+  for (uint32_t i = 0; i < h->num_sidedefs; i++) {
+    mapcache_side_t const *side = &sides[i];
+    if (!section_fits(&side->upper, h->num_wall_vertices) ||
+        !section_fits(&side->lower, h->num_wall_vertices) ||
+        !section_fits(&side->mid, h->num_wall_vertices)) {
+      close_map_cache(cache);
+      return false;
+    }
+  }
+  for (uint32_t i = 0; i < h->num_sectors; i++) {
+    if (!section_fits(&sectors[i].floor, h->num_floor_vertices) ||
+        !section_fits(&sectors[i].ceiling, h->num_floor_vertices)) {
+      close_map_cache(cache);
+      return false;
+    }
+  }
+
+  init_wall_sections(map);
+  for (uint32_t i = 0; i < h->num_sidedefs; i++) {
+    mapsidedef2_t *section = &map->walls.sections[i];
+    restore_section(&section->upper_section, &sides[i].upper, get_texture_handle(section->def->toptexture));
+    restore_section(&section->lower_section, &sides[i].lower, get_texture_handle(section->def->bottomtexture));
+    restore_section(&section->mid_section, &sides[i].mid, get_texture_handle(section->def->midtexture));
+  }
+  map->walls.num_vertices = h->num_wall_vertices;
+
+  init_floor_sectors(map);
+  for (uint32_t i = 0; i < h->num_sectors; i++) {
+    mapsector2_t *sector = &map->floors.sectors[i];
+    restore_section(&sector->floor, &sectors[i].floor, get_flat_texture_handle(map->sectors[i].floorpic));
+    restore_section(&sector->ceiling, &sectors[i].ceiling, get_flat_texture_handle(map->sectors[i].ceilingpic));
+    memcpy(sector->bbox, sectors[i].bbox, sizeof(sector->bbox));
+  }
+  map->floors.num_vertices = h->num_floor_vertices;
+
+  for (uint32_t i = 0; i < h->num_things; i++) {
+    map->things[i].height = thing_sectors[i];
+  }
+
+  return true;
+}
+
+void close_map_cache(mapcache_t *cache) {
+#ifdef MAPCACHE_USE_MMAP
+  if (cache->mapped) {
+    munmap(cache->base, cache->size);
+    memset(cache, 0, sizeof(mapcache_t));
+    return;
+  }
+#endif
+  free(cache->base);
+  memset(cache, 0, sizeof(mapcache_t));
+}
+
+static void store_section(mapcache_section_t *out, wall_section_t const *in) {
+  out->vertex_start = in->vertex_start;
+  out->vertex_count = in->vertex_count;
+}
+
+// Writes the geometry built by build_wall_geometry/build_floor_geometry.
+// The file is written under a temporary name and renamed into place, so
+// a crash never leaves a truncated cache behind.
+bool save_map_cache(map_data_t const *map, const char *map_name) {
+  uint64_t key = map_cache_key(map, map_name);
+  if (!key || !map->walls.sections || !map->floors.sectors) return false;
+
+  char path[512], tmp_path[520];
+  map_cache_path(path, sizeof(path), key);
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  make_parent_dirs(path);
+
+  FILE *file = fopen(tmp_path, "wb");
+  if (!file) {
+    printf("Warning: Could not write map cache %s\n", tmp_path);
+    return false;
+  }
+
+  mapcache_header_t h = {0};
+  memcpy(h.magic, MAPCACHE_MAGIC, 4);
+  h.version = MAPCACHE_VERSION;
+  h.key = key;
+  h.num_wall_vertices = map->walls.num_vertices;
+  h.num_floor_vertices = map->floors.num_vertices;
+  h.num_sidedefs = map->num_sidedefs;
+  h.num_sectors = map->num_sectors;
+  h.num_things = map->num_things;
+  h.vertex_size = sizeof(wall_vertex_t);
+
+  bool ok = fwrite(&h, sizeof(h), 1, file) == 1;
+  ok = ok && fwrite(map->walls.vertices, sizeof(wall_vertex_t), h.num_wall_vertices, file) == h.num_wall_vertices;
+  ok = ok && fwrite(map->floors.vertices, sizeof(wall_vertex_t), h.num_floor_vertices, file) == h.num_floor_vertices;
+
+  for (uint32_t i = 0; ok && i < h.num_sidedefs; i++) {
+    mapsidedef2_t const *section = &map->walls.sections[i];
+    mapcache_side_t side;
+    store_section(&side.upper, &section->upper_section);
+    store_section(&side.lower, &section->lower_section);
+    store_section(&side.mid, &section->mid_section);
+    ok = fwrite(&side, sizeof(side), 1, file) == 1;
+  }
+  for (uint32_t i = 0; ok && i < h.num_sectors; i++) {
+    mapsector2_t const *sector2 = &map->floors.sectors[i];
+    mapcache_sector_t sector;
+    store_section(&sector.floor, &sector2->floor);
+    store_section(&sector.ceiling, &sector2->ceiling);
+    memcpy(sector.bbox, sector2->bbox, sizeof(sector.bbox));
+    ok = fwrite(&sector, sizeof(sector), 1, file) == 1;
+  }
+  for (uint32_t i = 0; ok && i < h.num_things; i++) {
+    int16_t sector = map->things[i].height;
+    ok = fwrite(&sector, sizeof(sector), 1, file) == 1;
+  }
+
+  ok = (fclose(file) == 0) && ok;
+  if (!ok || rename(tmp_path, path) != 0) {
+    printf("Warning: Could not write map cache %s\n", path);
+    remove(tmp_path);
+    return false;
+  }
+  return true;
+}
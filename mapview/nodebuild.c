@@ -0,0 +1,345 @@
+#ifdef TEST_MODE
+#include <tests/map_test.h>
+#else
+#include <mapview/map.h>
+#endif
+#include <math.h>
+
+// BSP node builder.
+//
+// Every linedef side becomes a seg, then the seg set is cut by partition
+// lines taken from the segs themselves until each leaf is convex. Segs
+// crossing a partition are split at a new vertex. A partition is picked
+// by scoring candidates on splits and balance; candidates are scored in
+// parallel since they only read the seg set.
+//
+// Segs index node_vertices, which starts as a copy of the map's vertices
+// and gets the split points appended, so editing the map's vertices never
+// invalidates what the nodes point at. Output is in the vanilla layout,
+// children before parents, with the root node last.
+
+// One split costs as much as this many segs of imbalance
+#define SPLIT_COST 8
+
+// Partition candidates scored per node
+#define FAST_CANDIDATES 32
+#define THOROUGH_CANDIDATES 2048
+
+// Seg classifications per node worth spreading over threads
+#define PARALLEL_WORK (1 << 16)
+
+// Endpoints this close to a partition count as on it; split points are
+// rounded to the integer grid, so anything finer would split again
+#define ON_LINE_EPSILON 0.5
+
+typedef struct {
+  uint16_t v1, v2;
+  uint16_t linedef;
+  uint16_t side;
+} buildseg_t;
+
+typedef enum {
+  SEG_FRONT,
+  SEG_BACK,
+  SEG_SPLIT,
+} segclass_t;
+
+typedef struct {
+  map_data_t const *map;
+  mapvertex_t *vertices;
+  int num_vertices, max_vertices;
+  mapseg_t *segs;
+  int num_segs, max_segs;
+  mapsubsector_t *subsectors;
+  int num_subsectors, max_subsectors;
+  mapnode_t *nodes;
+  int num_nodes, max_nodes;
+  int max_candidates;
+} nodebuilder_t;
+
+// Candidate scoring job shared with the worker threads
+typedef struct {
+  nodebuilder_t const *nb;
+  buildseg_t const *segs;
+  int count;
+  int const *candidates;
+  int *costs;
+} partition_job_t;
+
+static bool grow(void **items, int *max_items, int count, size_t size) {
+  if (count < *max_items) return true;
+  int new_max = MAX(*max_items * 2, 256);
+  void *resized = realloc(*items, new_max * size);
+  if (!resized) return false;
+  *items = resized;
+  *max_items = new_max;
+  return true;
+}
+
+// Signed distance of (x, y) from the partition through p, positive on the
+// front (right) side as R_PointOnSide sees it
+static double point_side(mapvertex_t const *p1, mapvertex_t const *p2, double x, double y) {
+  double dx = p2->x - p1->x, dy = p2->y - p1->y;
+  return (dy * (x - p1->x) - dx * (y - p1->y)) / sqrt(dx * dx + dy * dy);
+}
+
+// Classifies a seg against the partition running along another seg
+static segclass_t classify_seg(mapvertex_t const *vertices, buildseg_t const *partition,
+                               buildseg_t const *seg, double *a, double *b) {
+  mapvertex_t const *p1 = &vertices[partition->v1], *p2 = &vertices[partition->v2];
+  mapvertex_t const *s1 = &vertices[seg->v1], *s2 = &vertices[seg->v2];
+  *a = point_side(p1, p2, s1->x, s1->y);
+  *b = point_side(p1, p2, s2->x, s2->y);
+  if (fabs(*a) <= ON_LINE_EPSILON && fabs(*b) <= ON_LINE_EPSILON) {
+    // On the partition: segs running along it are in front
+    double dot = (double)(s2->x - s1->x) * (p2->x - p1->x) + (double)(s2->y - s1->y) * (p2->y - p1->y);
+    return dot > 0 ? SEG_FRONT : SEG_BACK;
+  }
+  if (*a >= -ON_LINE_EPSILON && *b >= -ON_LINE_EPSILON) return SEG_FRONT;
+  if (*a <= ON_LINE_EPSILON && *b <= ON_LINE_EPSILON) return SEG_BACK;
+  return SEG_SPLIT;
+}
+
+// Cost of partitioning along segs[partition], or -1 if it leaves one side
+// empty and so does not divide the set
+static int partition_cost(nodebuilder_t const *nb, buildseg_t const *segs, int count, int partition) {
+  int front = 0, back = 0, splits = 0;
+  for (int i = 0; i < count; i++) {
+    double a, b;
+    switch (classify_seg(nb->vertices, &segs[partition], &segs[i], &a, &b)) {
+      case SEG_FRONT: front++; break;
+      case SEG_BACK: back++; break;
+      case SEG_SPLIT: splits++; front++; back++; break;
+    }
+  }
+  if (!front || !back) return -1;
+  return splits * SPLIT_COST + abs(front - back);
+}
+
+static void score_partition(int index, void *parm) {
+  partition_job_t *job = parm;
+  job->costs[index] = partition_cost(job->nb, job->segs, job->count, job->candidates[index]);
+}
+
+// Scores every n-th seg as a partition and returns the best one, or -1
+static int pick_partition(nodebuilder_t const *nb, buildseg_t const *segs, int count,
+                          int max_candidates, int *candidates, int *costs) {
+  int num_candidates = MIN(count, max_candidates);
+  for (int i = 0; i < num_candidates; i++) {
+    candidates[i] = (int)((int64_t)i * count / num_candidates);
+  }
+  partition_job_t job = { nb, segs, count, candidates, costs };
+  if ((int64_t)count * num_candidates >= PARALLEL_WORK) {
+    parallel_for(num_candidates, score_partition, &job);
+  } else {
+    for (int i = 0; i < num_candidates; i++) {
+      score_partition(i, &job);
+    }
+  }
+  int best = -1;
+  for (int i = 0; i < num_candidates; i++) {
+    if (costs[i] >= 0 && (best < 0 || costs[i] < costs[best])) best = i;
+  }
+  return best < 0 ? -1 : candidates[best];
+}
+
+static int add_vertex_at(nodebuilder_t *nb, double x, double y) {
+  if (nb->num_vertices > 0xFFFF) return -1;
+  if (!grow((void **)&nb->vertices, &nb->max_vertices, nb->num_vertices, sizeof(mapvertex_t))) return -1;
+  nb->vertices[nb->num_vertices] = (mapvertex_t){ (int16_t)lround(x), (int16_t)lround(y) };
+  return nb->num_vertices++;
+}
+
+static void add_bbox(int16_t bbox[4], mapvertex_t const *v) {
+  bbox[BOXTOP] = MAX(bbox[BOXTOP], v->y);
+  bbox[BOXBOTTOM] = MIN(bbox[BOXBOTTOM], v->y);
+  bbox[BOXLEFT] = MIN(bbox[BOXLEFT], v->x);
+  bbox[BOXRIGHT] = MAX(bbox[BOXRIGHT], v->x);
+}
+
+// Emits a convex seg set as a subsector and returns its child reference
+static int add_subsector(nodebuilder_t *nb, buildseg_t const *segs, int count) {
+  if (nb->num_subsectors >= NF_SUBSECTOR || nb->num_segs + count > 0xFFFF) return -1;
+  if (!grow((void **)&nb->subsectors, &nb->max_subsectors, nb->num_subsectors, sizeof(mapsubsector_t))) return -1;
+  while (nb->num_segs + count > nb->max_segs) {
+    if (!grow((void **)&nb->segs, &nb->max_segs, nb->max_segs, sizeof(mapseg_t))) return -1;
+  }
+  nb->subsectors[nb->num_subsectors] = (mapsubsector_t){ count, nb->num_segs };
+  for (int i = 0; i < count; i++) {
+    buildseg_t const *seg = &segs[i];
+    maplinedef_t const *linedef = &nb->map->linedefs[seg->linedef];
+    mapvertex_t const *v1 = &nb->vertices[seg->v1];
+    mapvertex_t const *v2 = &nb->vertices[seg->v2];
+    // Offsets run from the start of the side, which is the linedef's end for the back side
+    mapvertex_t const *origin = &nb->vertices[seg->side ? linedef->end : linedef->start];
+    double angle = atan2(v2->y - v1->y, v2->x - v1->x);
+    nb->segs[nb->num_segs++] = (mapseg_t){
+      .v1 = seg->v1,
+      .v2 = seg->v2,
+      .angle = (uint16_t)(int32_t)lround(angle * 32768.0 / M_PI),
+      .linedef = seg->linedef,
+      .side = seg->side,
+      .offset = (uint16_t)lround(hypot(v1->x - origin->x, v1->y - origin->y)),
+    };
+  }
+  return NF_SUBSECTOR | nb->num_subsectors++;
+}
+
+// Builds the subtree for segs, which it frees, and returns its child
+// reference or -1 on failure. bbox receives the bounds of the segs.
+static int build_node(nodebuilder_t *nb, buildseg_t *segs, int count, int16_t bbox[4]) {
+  bbox[BOXTOP] = bbox[BOXRIGHT] = INT16_MIN;
+  bbox[BOXBOTTOM] = bbox[BOXLEFT] = INT16_MAX;
+  for (int i = 0; i < count; i++) {
+    add_bbox(bbox, &nb->vertices[segs[i].v1]);
+    add_bbox(bbox, &nb->vertices[segs[i].v2]);
+  }
+
+  int result = -1;
+  int *candidates = malloc(sizeof(int) * MIN(count, nb->max_candidates) * 2);
+  buildseg_t *sides[2] = { NULL, NULL };
+  if (!candidates) goto done;
+  int *costs = candidates + MIN(count, nb->max_candidates);
+
+  int partition = pick_partition(nb, segs, count, nb->max_candidates, candidates, costs);
+  if (partition < 0 && count > nb->max_candidates) {
+    // The sample may have missed the only lines that divide the set
+    free(candidates);
+    candidates = malloc(sizeof(int) * count * 2);
+    if (!candidates) goto done;
+    partition = pick_partition(nb, segs, count, count, candidates, candidates + count);
+  }
+  free(candidates);
+  candidates = NULL;
+  if (partition < 0) {
+    result = add_subsector(nb, segs, count);
+    goto done;
+  }
+
+  // Divide the set; a split adds one seg to each side
+  buildseg_t line = segs[partition];
+  int num_sides[2] = { 0, 0 };
+  sides[0] = malloc(sizeof(buildseg_t) * count * 2);
+  sides[1] = malloc(sizeof(buildseg_t) * count * 2);
+  if (!sides[0] || !sides[1]) goto done;
+  for (int i = 0; i < count; i++) {
+    double a, b;
+    buildseg_t seg = segs[i];
+    segclass_t cls = classify_seg(nb->vertices, &line, &seg, &a, &b);
+    if (cls == SEG_SPLIT) {
+      mapvertex_t const *s1 = &nb->vertices[seg.v1], *s2 = &nb->vertices[seg.v2];
+      double t = a / (a - b);
+      double x = s1->x + t * (s2->x - s1->x), y = s1->y + t * (s2->y - s1->y);
+      mapvertex_t rounded = { (int16_t)lround(x), (int16_t)lround(y) };
+      if ((rounded.x == s1->x && rounded.y == s1->y) || (rounded.x == s2->x && rounded.y == s2->y)) {
+        // The split point snaps onto an end, so the seg lies on one side
+        cls = fabs(a) > fabs(b) ? (a > 0 ? SEG_FRONT : SEG_BACK) : (b > 0 ? SEG_FRONT : SEG_BACK);
+      } else {
+        int v = add_vertex_at(nb, x, y);
+        if (v < 0) goto done;
+        buildseg_t head = seg, tail = seg;
+        head.v2 = tail.v1 = v;
+        sides[a > 0 ? 0 : 1][num_sides[a > 0 ? 0 : 1]++] = head;
+        sides[b > 0 ? 0 : 1][num_sides[b > 0 ? 0 : 1]++] = tail;
+        continue;
+      }
+    }
+    int side = cls == SEG_FRONT ? 0 : 1;
+    sides[side][num_sides[side]++] = seg;
+  }
+  free(segs);
+  segs = NULL;
+
+  mapnode_t node = {
+    .x = nb->vertices[line.v1].x,
+    .y = nb->vertices[line.v1].y,
+    .dx = nb->vertices[line.v2].x - nb->vertices[line.v1].x,
+    .dy = nb->vertices[line.v2].y - nb->vertices[line.v1].y,
+  };
+  for (int side = 0; side < 2; side++) {
+    buildseg_t *child = sides[side];
+    sides[side] = NULL;
+    int ref = build_node(nb, child, num_sides[side], node.bbox[side]);
+    if (ref < 0) goto done;
+    node.children[side] = ref;
+  }
+
+  if (nb->num_nodes >= NF_SUBSECTOR - 1) goto done;
+  if (!grow((void **)&nb->nodes, &nb->max_nodes, nb->num_nodes, sizeof(mapnode_t))) goto done;
+  nb->nodes[nb->num_nodes] = node;
+  result = nb->num_nodes++;
+
+done:
+  free(candidates);
+  free(sides[0]);
+  free(sides[1]);
+  free(segs);
+  return result;
+}
+
+// Rebuilds the map's SEGS, SSECTORS and NODES from its linedefs. Fast mode
+// scores a small sample of partitions per node for interactive previews,
+// thorough mode a much larger one for release builds. Needs no GL, so it
+// can run on any thread; on failure the previous nodes are kept.
+bool build_map_nodes(map_data_t *map, nodebuild_mode_t mode) {
+  nodebuilder_t nb = {
+    .map = map,
+    .max_candidates = mode == NODEBUILD_THOROUGH ? THOROUGH_CANDIDATES : FAST_CANDIDATES,
+  };
+
+  // Every linedef side with a valid sidedef becomes a seg
+  buildseg_t *segs = malloc(sizeof(buildseg_t) * (map->num_linedefs * 2 + 1));
+  nb.max_vertices = map->num_vertices + 1;
+  nb.vertices = malloc(sizeof(mapvertex_t) * nb.max_vertices);
+  if (!segs || !nb.vertices) {
+    free(segs);
+    goto fail;
+  }
+  memcpy(nb.vertices, map->vertices, sizeof(mapvertex_t) * map->num_vertices);
+  nb.num_vertices = map->num_vertices;
+
+  int count = 0;
+  for (int i = 0; i < map->num_linedefs; i++) {
+    maplinedef_t const *linedef = &map->linedefs[i];
+    if (linedef->start >= map->num_vertices || linedef->end >= map->num_vertices) continue;
+    mapvertex_t const *a = &map->vertices[linedef->start];
+    mapvertex_t const *b = &map->vertices[linedef->end];
+    if (a->x == b->x && a->y == b->y) continue;
+    if (linedef->sidenum[0] < map->num_sidedefs) {
+      segs[count++] = (buildseg_t){ linedef->start, linedef->end, i, 0 };
+    }
+    if (linedef->sidenum[1] < map->num_sidedefs) {
+      segs[count++] = (buildseg_t){ linedef->end, linedef->start, i, 1 };
+    }
+  }
+  if (!count) {
+    free(segs);
+    goto fail;
+  }
+
+  int16_t bbox[4];
+  int root = build_node(&nb, segs, count, bbox);
+  if (root < 0) goto fail;
+
+  CLEAR_COLLECTION(map, node_vertices);
+  CLEAR_COLLECTION(map, segs);
+  CLEAR_COLLECTION(map, subsectors);
+  CLEAR_COLLECTION(map, nodes);
+  map->node_vertices = nb.vertices;
+  map->num_node_vertices = nb.num_vertices;
+  map->segs = nb.segs;
+  map->num_segs = nb.num_segs;
+  map->subsectors = nb.subsectors;
+  map->num_subsectors = nb.num_subsectors;
+  map->nodes = nb.nodes;
+  map->num_nodes = nb.num_nodes;
+  return true;
+
+fail:
+  printf("Error: Could not build nodes for %d linedefs\n", map->num_linedefs);
+  free(nb.vertices);
+  free(nb.segs);
+  free(nb.subsectors);
+  free(nb.nodes);
+  return false;
+}
@@ -0,0 +1,56 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#ifdef TEST_MODE
+#include <tests/map_test.h>
+#else
+#include <mapview/map.h>
+#endif
+
+// Fan-out helper for CPU-only startup work such as texture composition.
+// Threads are created per call; the callers run a few times at startup,
+// where thread creation is noise next to the work itself.
+
+#define MAX_WORKERS 64
+
+typedef struct {
+  void (*job)(int index, void *parm);
+  void *parm;
+  int count;
+  atomic_int next;
+} parallel_task_t;
+
+static void *parallel_worker(void *arg) {
+  parallel_task_t *task = arg;
+  for (int i = atomic_fetch_add(&task->next, 1); i < task->count;
+       i = atomic_fetch_add(&task->next, 1)) {
+    task->job(i, task->parm);
+  }
+  return NULL;
+}
+
+int get_num_workers(void) {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  return (int)MAX(1, MIN(cores, MAX_WORKERS));
+}
+
+// Calls job(i, parm) for every i in [0, count) spread over all cores and
+// returns once every call has finished. Jobs run on other threads, so
+// they must not touch GL or unguarded globals.
+void parallel_for(int count, void (*job)(int index, void *parm), void *parm) {
+  parallel_task_t task = { job, parm, count };
+  atomic_init(&task.next, 0);
+
+  pthread_t threads[MAX_WORKERS];
+  int num_threads = 0;
+  int wanted = MIN(get_num_workers(), count) - 1;  // the caller works too
+  while (num_threads < wanted &&
+         pthread_create(&threads[num_threads], NULL, parallel_worker, &task) == 0) {
+    num_threads++;
+  }
+
+  parallel_worker(&task);
+  for (int i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
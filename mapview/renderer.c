@@ -52,6 +52,104 @@ const char* fs_src = "#version 150 core\n"
 "  if(outColor.a < 0.1) discard;\n"
 "}";
 
+// World textures hold PLAYPAL indices. The fragment shaders run them
+// through COLORMAP, picking the row from sector light and distance the way
+// Doom's software renderer does, then look the colour up in PLAYPAL.
+#define LIGHT_SHADER_SRC \
+"uniform sampler2D palette;\n" \
+"uniform sampler2D colormap;\n" \
+"vec4 shade(uint index, float lightlevel, float dist) {\n" \
+"  float startmap = (15.0 - floor(lightlevel / 16.0)) * 4.0;\n" \
+"  int level = int(clamp(startmap - 1280.0 / (dist + 16.0), 0.0, 31.0));\n" \
+"  uint mapped = uint(texelFetch(colormap, ivec2(int(index), level), 0).r * 255.0 + 0.5);\n" \
+"  return vec4(texelFetch(palette, ivec2(int(mapped), 0), 0).rgb, 1.0);\n" \
+"}\n"
+
+// Floors and ceilings sample every flat from one array texture. Each
+// vertex names its surface; the surface table holds the flat layer and
+// sector light, so visible flats go out in one draw call per side.
+const char* flat_vs_src = "#version 150 core\n"
+"in vec3 pos;\n"
+"in vec2 uv;\n"
+"in uint surface;\n"
+"out vec2 tex;\n"
+"out vec3 fragPos;\n"
+"flat out uint layer;\n"
+"flat out float light;\n"
+"uniform mat4 mvp;\n"
+"uniform usamplerBuffer surfaces;\n"
+"void main() {\n"
+"  uvec2 entry = texelFetch(surfaces, int(surface)).rg;\n"
+"  tex = uv;\n"
+"  fragPos = pos;\n"
+"  layer = entry.r;\n"
+"  light = float(entry.g);\n"
+"  gl_Position = mvp * vec4(pos, 1.0);\n"
+"}";
+
+const char* flat_fs_src = "#version 150 core\n"
+"in vec2 tex;\n"
+"in vec3 fragPos;\n"
+"flat in uint layer;\n"
+"flat in float light;\n"
+"out vec4 outColor;\n"
+"uniform vec3 viewPos;\n"
+"uniform bool unlit;\n"
+"uniform sampler2DArray flats;\n"
+LIGHT_SHADER_SRC
+"void main() {\n"
+"  if (layer == 0xFFFFu) { outColor = vec4(0, 1, 1, 1); return; }\n"
+"  ivec2 texel = ivec2(mod(floor(tex), 64.0));\n"
+"  uint index = uint(texelFetch(flats, ivec3(texel, int(layer)), 0).r * 255.0 + 0.5);\n"
+"  outColor = unlit ? shade(index, 255.0, 0.0) : shade(index, light, distance(viewPos, fragPos));\n"
+"}";
+
+// Walls are quads, so the surface table is indexed by gl_VertexID / 4.
+// Entries hold the layer in the bound page, the sector light and the
+// texture size; textures sit in the corner of larger layers, so the
+// shader wraps coordinates itself.
+const char* wall_vs_src = "#version 150 core\n"
+"in vec3 pos;\n"
+"in vec2 uv;\n"
+"in vec3 norm;\n"
+"out vec2 tex;\n"
+"out vec3 fragPos;\n"
+"flat out uint layer;\n"
+"flat out float light;\n"
+"flat out vec2 size;\n"
+"uniform mat4 mvp;\n"
+"uniform usamplerBuffer surfaces;\n"
+"void main() {\n"
+"  uvec4 entry = texelFetch(surfaces, gl_VertexID / 4);\n"
+"  tex = uv;\n"
+"  fragPos = pos;\n"
+"  layer = entry.r;\n"
+"  light = float(entry.g);\n"
+"  // Doom's fake contrast: walls along the axes are a light step apart\n"
+"  if (abs(norm.x) < 0.01) light -= 16.0;\n"
+"  else if (abs(norm.y) < 0.01) light += 16.0;\n"
+"  size = vec2(entry.ba);\n"
+"  gl_Position = mvp * vec4(pos, 1.0);\n"
+"}";
+
+const char* wall_fs_src = "#version 150 core\n"
+"in vec2 tex;\n"
+"in vec3 fragPos;\n"
+"flat in uint layer;\n"
+"flat in float light;\n"
+"flat in vec2 size;\n"
+"out vec4 outColor;\n"
+"uniform vec3 viewPos;\n"
+"uniform sampler2DArray page;\n"
+LIGHT_SHADER_SRC
+"void main() {\n"
+"  if (layer == 0xFFFFu) { outColor = vec4(0, 1, 1, 1); return; }\n"
+"  ivec2 texel = ivec2(mod(floor(tex), size));\n"
+"  vec2 entry = texelFetch(page, ivec3(texel, int(layer)), 0).rg;\n"
+"  if (entry.g < 0.5) discard;\n"
+"  outColor = shade(uint(entry.r * 255.0 + 0.5), light, distance(viewPos, fragPos));\n"
+"}";
+
 const char* fs_unlit_src = "#version 150 core\n"
 "in vec2 tex;\n"
 "in vec4 col;\n"
@@ -71,8 +169,51 @@ GLuint compile(GLenum type, const char* src) {
 
 GLuint make_1bit_tex(void *data, int width, int height);
 
+// PLAYPAL and COLORMAP as lookup textures for the world shaders
+static GLuint palette_tex, colormap_tex;
+
+#define NUM_COLORMAPS 34
+
+// Uploads the current PLAYPAL and COLORMAP. Call again after the palette
+// changes; nothing else has to be re-uploaded.
+void update_palette_textures(void) {
+  if (!palette_tex) {
+    glGenTextures(1, &palette_tex);
+    glGenTextures(1, &colormap_tex);
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  
+  glBindTexture(GL_TEXTURE_2D, palette_tex);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, 256, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, palette);
+  
+  // Without a COLORMAP every light level maps indices to themselves
+  static uint8_t identity[NUM_COLORMAPS * 256];
+  lumpview_t colormap = view_lump("COLORMAP");
+  uint8_t const *rows = colormap.data;
+  if (!rows || colormap.size < sizeof(identity)) {
+    for (int i = 0; i < (int)sizeof(identity); i++) identity[i] = i & 0xff;
+    rows = identity;
+  }
+  glBindTexture(GL_TEXTURE_2D, colormap_tex);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, 256, NUM_COLORMAPS, 0, GL_RED, GL_UNSIGNED_BYTE, rows);
+  release_lump_view(&colormap);
+}
+
+// Binds the palette lookups to the units the world shaders expect
+void bind_palette_textures(void) {
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, palette_tex);
+  glActiveTexture(GL_TEXTURE3);
+  glBindTexture(GL_TEXTURE_2D, colormap_tex);
+  glActiveTexture(GL_TEXTURE0);
+}
+
 // Global variables
-GLuint world_prog, ui_prog;
+GLuint world_prog, ui_prog, flat_prog, wall_prog;
 GLuint white_tex, black_tex, selection_tex, no_tex;
 
 int world_prog_mvp;
@@ -86,6 +227,13 @@ int ui_prog_tex0_size;
 int ui_prog_tex0;
 int ui_prog_color;
 
+int flat_prog_mvp;
+int flat_prog_viewPos;
+int flat_prog_unlit;
+
+int wall_prog_mvp;
+int wall_prog_viewPos;
+
 bool mode = false;
 unsigned frame = 0;
 
@@ -140,6 +288,48 @@ bool init_resources(void) {
   ui_prog_tex0 = glGetUniformLocation(ui_prog, "tex0");
   ui_prog_color = glGetUniformLocation(ui_prog, "color");
 
+  vs = compile(GL_VERTEX_SHADER, flat_vs_src);
+  fs = compile(GL_FRAGMENT_SHADER, flat_fs_src);
+  flat_prog = glCreateProgram();
+  glAttachShader(flat_prog, vs);
+  glAttachShader(flat_prog, fs);
+  glBindAttribLocation(flat_prog, 0, "pos");
+  glBindAttribLocation(flat_prog, 1, "uv");
+  glBindAttribLocation(flat_prog, 2, "norm");
+  glBindAttribLocation(flat_prog, 4, "surface");
+  glLinkProgram(flat_prog);
+  glUseProgram(flat_prog);
+  glUniform1i(glGetUniformLocation(flat_prog, "flats"), 0);
+  glUniform1i(glGetUniformLocation(flat_prog, "surfaces"), 1);
+  glUniform1i(glGetUniformLocation(flat_prog, "palette"), 2);
+  glUniform1i(glGetUniformLocation(flat_prog, "colormap"), 3);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+  
+  flat_prog_mvp = glGetUniformLocation(flat_prog, "mvp");
+  flat_prog_viewPos = glGetUniformLocation(flat_prog, "viewPos");
+  flat_prog_unlit = glGetUniformLocation(flat_prog, "unlit");
+
+  vs = compile(GL_VERTEX_SHADER, wall_vs_src);
+  fs = compile(GL_FRAGMENT_SHADER, wall_fs_src);
+  wall_prog = glCreateProgram();
+  glAttachShader(wall_prog, vs);
+  glAttachShader(wall_prog, fs);
+  glBindAttribLocation(wall_prog, 0, "pos");
+  glBindAttribLocation(wall_prog, 1, "uv");
+  glBindAttribLocation(wall_prog, 2, "norm");
+  glLinkProgram(wall_prog);
+  glUseProgram(wall_prog);
+  glUniform1i(glGetUniformLocation(wall_prog, "page"), 0);
+  glUniform1i(glGetUniformLocation(wall_prog, "surfaces"), 1);
+  glUniform1i(glGetUniformLocation(wall_prog, "palette"), 2);
+  glUniform1i(glGetUniformLocation(wall_prog, "colormap"), 3);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+  
+  wall_prog_mvp = glGetUniformLocation(wall_prog, "mvp");
+  wall_prog_viewPos = glGetUniformLocation(wall_prog, "viewPos");
+
   glEnable(GL_CULL_FACE);
   glCullFace(GL_BACK);
   
@@ -6,95 +6,338 @@
 #include <mapview/map.h>
 #include <mapview/sprites.h>
 
-#define MAX_SPRITES 10000
+// Sprites live in fixed-size blocks so the pointers handed out by
+// find_sprite stay valid while the registry grows
+#define SPRITE_BLOCK_SIZE 256
+#define SPRITE_PAGE_SIZE 1024
+#define SPRITE_PADDING 1
+
+// One RGBA atlas page, filled shelf by shelf as sprites become resident
+typedef struct {
+  GLuint texture;
+  int width, height;
+  int x, y, shelf;
+} sprite_page_t;
 
 // Sprite system state
 typedef struct {
-  sprite_t all_sprites[MAX_SPRITES];
+  sprite_t **blocks;
+  int num_blocks;
   int num_sprites;
+  // open-addressed name index over the first 4 and 6 characters, which is
+  // what find_sprite and find_sprite6 match on
+  int32_t *by_prefix4, *by_prefix6;
+  uint32_t mask;
+  sprite_page_t *pages;
+  int num_pages;
+  int open_page;
+  GLuint program, vao, vbo;
   GLuint crosshair_texture; // Custom crosshair texture (if needed)
 } sprite_system_t;
 
-sprite_system_t g_sprite_system = {0};
+sprite_system_t g_sprite_system = { .open_page = -1 };
+
+// Sprite header structure (same as patch_t)
+typedef struct {
+  int16_t width;      // width of the sprite
+  int16_t height;     // height of the sprite
+  int16_t leftoffset; // left offset of sprite
+  int16_t topoffset;  // top offset of sprite
+  int32_t columnofs[]; // column offsets (flexible array member)
+} spriteheader_t;
 
 // Forward declarations
-GLuint compile_shader(GLenum type, const char* src);
-GLuint load_sprite_texture(void *data, int* width, int* height, int* offsetx, int* offsety);
+GLuint compile(GLenum type, const char* src);
+GLuint load_sprite_texture(lumpview_t const *lump, int* width, int* height, int* offsetx, int* offsety);
+GLuint upload_sprite_texture(uint8_t const *tex_data, int width, int height);
 GLuint generate_crosshair_texture(int size);
+static uint8_t *decode_sprite(lumpview_t const *lump, int* width, int* height, int* offsetx, int* offsety);
+
+// Screen-space quad that samples a sprite's rectangle of its atlas page
+const char* sprite_vs_src = "#version 150 core\n"
+"in vec2 position;\n"
+"out vec2 tex;\n"
+"uniform mat4 projection;\n"
+"uniform vec2 offset;\n"
+"uniform vec2 scale;\n"
+"uniform vec4 uvrect;\n"
+"void main() {\n"
+"  tex = mix(uvrect.xy, uvrect.zw, position);\n"
+"  gl_Position = projection * vec4(offset + position * scale, 0.0, 1.0);\n"
+"}";
+
+const char* sprite_fs_src = "#version 150 core\n"
+"in vec2 tex;\n"
+"out vec4 outColor;\n"
+"uniform sampler2D tex0;\n"
+"uniform float alpha;\n"
+"void main() {\n"
+"  outColor = texture(tex0, tex);\n"
+"  outColor.a *= alpha;\n"
+"}";
+
+static float sprite_quad[] = { 0, 0,  0, 1,  1, 1,  1, 0 };
+
+// Sprites by registration order, index in [0, get_num_sprites())
+sprite_t *get_sprite(int index) {
+  sprite_system_t* sys = &g_sprite_system;
+  return &sys->blocks[index / SPRITE_BLOCK_SIZE][index % SPRITE_BLOCK_SIZE];
+}
+
+int get_num_sprites(void) {
+  return g_sprite_system.num_sprites;
+}
+
+static uint32_t sprite_name_hash(const char *name, int len) {
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < len && name[i]; i++) {
+    hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static int lookup_sprite(int32_t const *buckets, const char *name, int len) {
+  sprite_system_t* sys = &g_sprite_system;
+  if (!buckets) return -1;
+  for (uint32_t h = sprite_name_hash(name, len) & sys->mask; buckets[h] >= 0; h = (h + 1) & sys->mask) {
+    if (strncmp(get_sprite(buckets[h])->name, name, len) == 0) {
+      return buckets[h];
+    }
+  }
+  return -1;
+}
+
+// The first sprite registered under a prefix keeps it, the same one the
+// old front-to-back scan found
+static void index_sprite_prefix(int32_t *buckets, int index, int len) {
+  sprite_system_t* sys = &g_sprite_system;
+  const char *name = get_sprite(index)->name;
+  uint32_t h = sprite_name_hash(name, len) & sys->mask;
+  for (; buckets[h] >= 0; h = (h + 1) & sys->mask) {
+    if (strncmp(get_sprite(buckets[h])->name, name, len) == 0) return;
+  }
+  buckets[h] = index;
+}
+
+static void index_sprite(int index) {
+  index_sprite_prefix(g_sprite_system.by_prefix4, index, 4);
+  index_sprite_prefix(g_sprite_system.by_prefix6, index, 6);
+}
+
+// Keeps the buckets at least twice the sprite count, reindexing in
+// registration order when they grow
+static bool reserve_sprite_index(int count) {
+  sprite_system_t* sys = &g_sprite_system;
+  if (sys->by_prefix4 && (uint32_t)count * 2 <= sys->mask + 1) return true;
+  uint32_t size = 512;
+  while (size < (uint32_t)count * 2) size *= 2;
+  int32_t *by_prefix4 = malloc(size * sizeof(int32_t));
+  int32_t *by_prefix6 = malloc(size * sizeof(int32_t));
+  if (!by_prefix4 || !by_prefix6) {
+    printf("Error: Could not grow sprite index to %u buckets\n", size);
+    free(by_prefix4);
+    free(by_prefix6);
+    return false;
+  }
+  memset(by_prefix4, 0xff, size * sizeof(int32_t));
+  memset(by_prefix6, 0xff, size * sizeof(int32_t));
+  free(sys->by_prefix4);
+  free(sys->by_prefix6);
+  sys->by_prefix4 = by_prefix4;
+  sys->by_prefix6 = by_prefix6;
+  sys->mask = size - 1;
+  for (int i = 0; i < sys->num_sprites; i++) {
+    index_sprite(i);
+  }
+  return true;
+}
+
+// Appends a blank sprite to the registry and returns it, or NULL when out
+// of memory. Call index_sprite once its name is set.
+static sprite_t *new_sprite(void) {
+  sprite_system_t* sys = &g_sprite_system;
+  if (!reserve_sprite_index(sys->num_sprites + 1)) return NULL;
+  if (sys->num_sprites == sys->num_blocks * SPRITE_BLOCK_SIZE) {
+    sprite_t **blocks = realloc(sys->blocks, (sys->num_blocks + 1) * sizeof(sprite_t *));
+    if (!blocks) return NULL;
+    sys->blocks = blocks;
+    if (!(blocks[sys->num_blocks] = malloc(SPRITE_BLOCK_SIZE * sizeof(sprite_t)))) return NULL;
+    sys->num_blocks++;
+  }
+  sprite_t *sprite = get_sprite(sys->num_sprites++);
+  memset(sprite, 0, sizeof(sprite_t));
+  sprite->lump = -1;
+  return sprite;
+}
+
+// Registers a sprite lump by its header only; the pixels are decoded the
+// first time the sprite is drawn. Returns the sprite index or -1.
+static int register_sprite(int lump_num, const char *name) {
+  lumpview_t lump = view_lump_num(lump_num);
+  spriteheader_t const *header = (spriteheader_t const *)lump.data;
+  sprite_t *sprite = NULL;
+  if (lump_view_has(&lump, 0, sizeof(spriteheader_t)) && header->width > 0 && header->height > 0 &&
+      (sprite = new_sprite())) {
+    strncpy(sprite->name, name, 8);
+    sprite->lump = lump_num;
+    sprite->width = header->width;
+    sprite->height = header->height;
+    sprite->offsetx = header->leftoffset;
+    sprite->offsety = header->topoffset;
+    index_sprite(g_sprite_system.num_sprites - 1);
+  }
+  release_lump_view(&lump);
+  return sprite ? g_sprite_system.num_sprites - 1 : -1;
+}
 
 int load_sprite(const char *name) {
-  int width, height, offsetx, offsety;
-  GLuint texture = load_sprite_texture(cache_lump(name), &width, &height, &offsetx, &offsety);
-  if (texture) {
-    sprite_t* sprite = &g_sprite_system.all_sprites[g_sprite_system.num_sprites];
-    strncpy(sprite->name, name, 16);
-    sprite->texture = texture;
-    sprite->width = width;
-    sprite->height = height;
-    sprite->offsetx = offsetx;
-    sprite->offsety = offsety;
-//    printf("Loaded sprite: %s (%dx%d)\n", sprite_lump->name, width, height);
-    return g_sprite_system.num_sprites++;
-  } else {
-    return -1;
+  int existing = lookup_sprite(g_sprite_system.by_prefix6, name, 6);
+  if (existing >= 0 && strncmp(get_sprite(existing)->name, name, 8) == 0) {
+    return existing;
+  }
+  // Prefer the sprite namespace, so a graphic outside S_START/S_END with
+  // the same name does not shadow the sprite
+  int lump_num = find_lump_num_ns(name, NS_SPRITES);
+  if (lump_num < 0) lump_num = find_lump_num(name);
+  if (lump_num < 0) return -1;
+  return register_sprite(lump_num, name);
+}
+
+static sprite_page_t *new_sprite_page(int width, int height) {
+  sprite_system_t* sys = &g_sprite_system;
+  sprite_page_t *pages = realloc(sys->pages, (sys->num_pages + 1) * sizeof(sprite_page_t));
+  uint8_t *blank = calloc(width * height, 4);
+  if (!pages || !blank) {
+    printf("Error: Could not allocate %dx%d sprite page\n", width, height);
+    if (pages) sys->pages = pages;
+    free(blank);
+    return NULL;
   }
+  sys->pages = pages;
+  sprite_page_t *page = &pages[sys->num_pages++];
+  memset(page, 0, sizeof(sprite_page_t));
+  page->width = width;
+  page->height = height;
+  page->texture = upload_sprite_texture(blank, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  free(blank);
+  return page;
+}
+
+// Finds room for a width x height sprite on the open page, starting a new
+// shelf or page when it is full. Sprites larger than a page get a page of
+// their own.
+static sprite_page_t *place_sprite(int width, int height, int *x, int *y) {
+  sprite_system_t* sys = &g_sprite_system;
+  int w = width + SPRITE_PADDING, h = height + SPRITE_PADDING;
+  if (w > SPRITE_PAGE_SIZE || h > SPRITE_PAGE_SIZE) {
+    *x = *y = 0;
+    return new_sprite_page(width, height);
+  }
+  sprite_page_t *page = sys->open_page >= 0 ? &sys->pages[sys->open_page] : NULL;
+  if (page && page->x + w > page->width) {
+    page->x = 0;
+    page->y += page->shelf;
+    page->shelf = 0;
+  }
+  if (!page || page->y + h > page->height) {
+    if (!(page = new_sprite_page(SPRITE_PAGE_SIZE, SPRITE_PAGE_SIZE))) return NULL;
+    sys->open_page = sys->num_pages - 1;
+  }
+  *x = page->x;
+  *y = page->y;
+  page->x += w;
+  page->shelf = MAX(page->shelf, h);
+  return page;
+}
+
+// Sprites start out as headers only. The pixels are decoded and packed
+// into an atlas page the first time a lookup hands the sprite out.
+void make_sprite_resident(sprite_t *sprite) {
+  if (!sprite || sprite->texture || sprite->lump < 0) return;
+  int width, height, offsetx, offsety, x, y;
+  lumpview_t lump = view_lump_num(sprite->lump);
+  uint8_t *tex_data = decode_sprite(&lump, &width, &height, &offsetx, &offsety);
+  release_lump_view(&lump);
+  sprite->lump = -1;
+  sprite_page_t *page = tex_data ? place_sprite(width, height, &x, &y) : NULL;
+  if (page) {
+    glBindTexture(GL_TEXTURE_2D, page->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, tex_data);
+    sprite->texture = page->texture;
+    sprite->uv[0] = (float)x / page->width;
+    sprite->uv[1] = (float)y / page->height;
+    sprite->uv[2] = (float)(x + width) / page->width;
+    sprite->uv[3] = (float)(y + height) / page->height;
+  }
+  free(tex_data);
+}
+
+static bool init_sprite_program(void) {
+  sprite_system_t* sys = &g_sprite_system;
+  if (sys->program) return true;
+  
+  GLuint vertex_shader = compile(GL_VERTEX_SHADER, sprite_vs_src);
+  GLuint fragment_shader = compile(GL_FRAGMENT_SHADER, sprite_fs_src);
+  sys->program = glCreateProgram();
+  glAttachShader(sys->program, vertex_shader);
+  glAttachShader(sys->program, fragment_shader);
+  glBindAttribLocation(sys->program, 0, "position");
+  glLinkProgram(sys->program);
+  glDeleteShader(vertex_shader);
+  glDeleteShader(fragment_shader);
+  
+  GLint success;
+  glGetProgramiv(sys->program, GL_LINK_STATUS, &success);
+  if (!success) {
+    char infoLog[512];
+    glGetProgramInfoLog(sys->program, 512, NULL, infoLog);
+    printf("Sprite shader program linking failed: %s\n", infoLog);
+    return false;
+  }
+  
+  glGenVertexArrays(1, &sys->vao);
+  glBindVertexArray(sys->vao);
+  glGenBuffers(1, &sys->vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, sys->vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(sprite_quad), sprite_quad, GL_STATIC_DRAW);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+  return true;
 }
 
 // Initialize the sprite system
 bool init_sprites(void) {
   sprite_system_t* sys = &g_sprite_system;
-    
-  // Find and preload weapon sprites (starting with SHT)
-  sys->num_sprites = 0;
   
-  int s_start = find_lump_num("S_START");
-  int s_end = find_lump_num("S_END");
-  if (s_start >= 0 && s_end >= 0 && s_start < s_end) {
-    // Iterate through all sprites
-    for (int i = s_start + 1; i < s_end; i++) {
-      load_sprite(get_lump_name(i));
-    }
+  cleanup_sprites();
+  init_sprite_program();
+  
+  // Register all sprites of every loaded WAD; only their headers are read
+  for (int i = next_lump_in_ns(-1, NS_SPRITES); i >= 0; i = next_lump_in_ns(i, NS_SPRITES)) {
+    register_sprite(i, get_lump_name(i));
   }
 
-//  // If no sprite markers, try loading directly by name
-//  int shotgun_sprite = find_lump("SHTGA0");
-//  if (shotgun_sprite >= 0) {
-//    load_sprite(wad_file, &directory[shotgun_sprite]);
-//  }
-//  
-//  // Try loading crosshair directly
-//  int crosshair_sprite = find_lump("CROSA0");
-//  if (crosshair_sprite >= 0) {
-//    load_sprite(wad_file, &directory[crosshair_sprite]);
-//  }
-//  
-//  int stbar_lump = find_lump("STBAR");
-//  if (stbar_lump >= 0) {
-//    load_sprite(wad_file, &directory[stbar_lump]);
-//  }
-  
-  
   // Initialize the crosshair texture to 0 (will be generated on demand if needed)
   sys->crosshair_texture = 0;
   
   return sys->num_sprites > 0;
 }
 
-// Sprite header structure (same as patch_t)
-typedef struct {
-  int16_t width;      // width of the sprite
-  int16_t height;     // height of the sprite
-  int16_t leftoffset; // left offset of sprite
-  int16_t topoffset;  // top offset of sprite
-  int32_t columnofs[]; // column offsets (flexible array member)
-} spriteheader_t;
-
-// Load a sprite texture from memory
-GLuint load_sprite_texture(void *data, int* width, int* height, int* offsetx, int* offsety) {
-  if (!data) return 0;
+// Decodes a sprite lump to a fresh RGBA buffer. No GL calls, so it runs
+// on the worker pool.
+static uint8_t *decode_sprite(lumpview_t const *lump, int* width, int* height, int* offsetx, int* offsety) {
+  if (!lump->data || !lump_view_has(lump, 0, sizeof(spriteheader_t))) return NULL;
   
   // Cast to sprite structure for header access
-  spriteheader_t* sprite_header = data;
+  spriteheader_t const* sprite_header = (spriteheader_t const*)lump->data;
+  
+  if (sprite_header->width <= 0 || sprite_header->height <= 0 ||
+      !lump_view_has(lump, 0, sizeof(spriteheader_t) + sprite_header->width * sizeof(int32_t))) {
+    return NULL;
+  }
   
   // Get dimensions and offsets
   *width = sprite_header->width;
@@ -105,34 +348,33 @@ GLuint load_sprite_texture(void *data, int* width, int* height, int* offsetx, in
   // Allocate memory for texture data (RGBA)
   uint8_t* tex_data = calloc(sprite_header->width * sprite_header->height * 4, 1);
   if (!tex_data) {
-    return 0;
+    return NULL;
   }
   
   // Column offsets are directly accessible in the sprite header
-  int32_t* columnofs = sprite_header->columnofs;
-  
-  // Base address for byte calculations
-  uint8_t* sprite_bytes = (uint8_t*)data;
+  int32_t const* columnofs = sprite_header->columnofs;
   
   // Process each column
   for (int x = 0; x < sprite_header->width; x++) {
     // Calculate position of this column's data
-    uint8_t* column_data = sprite_bytes + columnofs[x];
+    uint32_t ofs = columnofs[x];
     
-    // Process each post
-    while (1) {
-      uint8_t top_delta = *column_data++;
+    // Process each post, stopping at anything that would read past the lump
+    while (lump_view_has(lump, ofs, 1)) {
+      uint8_t top_delta = lump->data[ofs];
       
       if (top_delta == 0xFF) break; // End of column
       
-      uint8_t length = *column_data++;
+      // top_delta, length, dummy byte, pixels, dummy byte
+      if (!lump_view_has(lump, ofs, 4)) break;
+      uint8_t length = lump->data[ofs + 1];
+      if (!lump_view_has(lump, ofs + 3, length + 1)) break;
       
-      // Skip dummy byte
-      column_data++;
+      uint8_t const *pixels = lump->data + ofs + 3;
       
       // Read pixel data
-      for (int y = 0; y < length; y++) {
-        uint8_t color_index = *column_data++;
+      for (int y = 0; y < length && top_delta + y < sprite_header->height; y++) {
+        uint8_t color_index = pixels[y];
         
         int pos = ((top_delta + y) * sprite_header->width + x) * 4;
         tex_data[pos] = palette[color_index].r;
@@ -141,11 +383,14 @@ GLuint load_sprite_texture(void *data, int* width, int* height, int* offsetx, in
         tex_data[pos + 3] = (color_index == 247) ? 0 : 255; // 247 is transparent in DOOM sprites
       }
       
-      // Skip dummy byte
-      column_data++;
+      ofs += length + 4;
     }
   }
   
+  return tex_data;
+}
+
+GLuint upload_sprite_texture(uint8_t const *tex_data, int width, int height) {
   // Create OpenGL texture
   GLuint texture_id;
   glGenTextures(1, &texture_id);
@@ -156,44 +401,32 @@ GLuint load_sprite_texture(void *data, int* width, int* height, int* offsetx, in
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   
   // Upload texture data
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, sprite_header->width, sprite_header->height,
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height,
                0, GL_RGBA, GL_UNSIGNED_BYTE, tex_data);
   
-  // Free temporary data
+  return texture_id;
+}
+
+// Load a sprite texture from a lump view
+GLuint load_sprite_texture(lumpview_t const *lump, int* width, int* height, int* offsetx, int* offsety) {
+  uint8_t *tex_data = decode_sprite(lump, width, height, offsetx, offsety);
+  if (!tex_data) return 0;
+  GLuint texture_id = upload_sprite_texture(tex_data, *width, *height);
   free(tex_data);
-  
   return texture_id;
 }
 
 // Helper function to find sprite in cache
 sprite_t* find_sprite(const char* name) {
-  sprite_system_t* sys = &g_sprite_system;
-  
-  for (int i = 0; i < sys->num_sprites; i++) {
-    if (strncmp(sys->all_sprites[i].name, name, 4) == 0) {
-      return &sys->all_sprites[i];
-    }
-  }
-  
-//  for (int i = 0; i < sys->num_sprites; i++) {
-//    if (strncmp(sys->all_sprites[i].name, name, 4) == 0) {
-//      return &sys->all_sprites[i];
-//    }
-//  }
-  
-  return NULL;
+  int index = lookup_sprite(g_sprite_system.by_prefix4, name, 4);
+  if (index < 0) return NULL;
+  make_sprite_resident(get_sprite(index));
+  return get_sprite(index);
 }
 
 sprite_t* find_sprite6(const char* name) {
-  sprite_system_t* sys = &g_sprite_system;
-  
-  for (int i = 0; i < sys->num_sprites; i++) {
-    if (strncmp(sys->all_sprites[i].name, name, 6) == 0) {
-      return &sys->all_sprites[i];
-    }
-  }
-  
-  return NULL;
+  int index = lookup_sprite(g_sprite_system.by_prefix6, name, 6);
+  return index >= 0 ? get_sprite(index) : NULL;
 }
 
 // Find lump from file (helper function)
@@ -260,14 +493,10 @@ GLuint generate_crosshair_texture(int size) {
   return texture;
 }
 
-// Draw a sprite at the specified screen position
-void draw_sprite(const char* name, float x, float y, float scale, float alpha) {
-  sprite_t* sprite = find_sprite(name);
-  
-  if (!sprite) {
-    printf("Sprite not found: %s\n", name);
-    return;
-  }
+// Draws the sprite's atlas rectangle over x, y, w, h in the current
+// sprite projection
+static void draw_sprite_quad(sprite_t const *sprite, float x, float y, float w, float h, float alpha) {
+  sprite_system_t* sys = &g_sprite_system;
   
   // Enable blending for transparency
   glEnable(GL_BLEND);
@@ -277,21 +506,22 @@ void draw_sprite(const char* name, float x, float y, float scale, float alpha) {
   glDisable(GL_DEPTH_TEST);
   
   // Use sprite shader program
-  glUseProgram(get_sprite_prog());
+  glUseProgram(sys->program);
   
   // Set uniforms
-//  glUniformMatrix4fv(glGetUniformLocation(sys->program, "projection"), 1, GL_FALSE, (const float*)sys->projection);
-  glUniform2f(glGetUniformLocation(get_sprite_prog(), "offset"), x-sprite->offsetx*scale, y-sprite->offsety*scale);
-  glUniform2f(glGetUniformLocation(get_sprite_prog(), "scale"), sprite->width * scale, sprite->height * scale);
-  glUniform1f(glGetUniformLocation(get_sprite_prog(), "alpha"), alpha);
+  glUniformMatrix4fv(glGetUniformLocation(sys->program, "projection"), 1, GL_FALSE, get_sprite_matrix());
+  glUniform2f(glGetUniformLocation(sys->program, "offset"), x, y);
+  glUniform2f(glGetUniformLocation(sys->program, "scale"), w, h);
+  glUniform4fv(glGetUniformLocation(sys->program, "uvrect"), 1, sprite->uv);
+  glUniform1f(glGetUniformLocation(sys->program, "alpha"), alpha);
   
-  // Bind sprite texture
+  // Bind the atlas page
   glActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_2D, sprite->texture);
-  glUniform1i(glGetUniformLocation(get_sprite_prog(), "tex0"), 0);
+  glUniform1i(glGetUniformLocation(sys->program, "tex0"), 0);
   
   // Bind VAO and draw
-  glBindVertexArray(get_sprite_vao());
+  glBindVertexArray(sys->vao);
   glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
   
   // Reset state
@@ -299,6 +529,25 @@ void draw_sprite(const char* name, float x, float y, float scale, float alpha) {
   glDisable(GL_BLEND);
 }
 
+// Draw a sprite at the specified screen position
+void draw_sprite(const char* name, float x, float y, float scale, float alpha) {
+  sprite_t* sprite = find_sprite(name);
+  
+  if (!sprite) {
+    printf("Sprite not found: %s\n", name);
+    return;
+  }
+  
+  draw_sprite_quad(sprite, x-sprite->offsetx*scale, y-sprite->offsety*scale,
+                   sprite->width * scale, sprite->height * scale, alpha);
+}
+
+// Draws a sprite stretched over r, for windows that lay sprites out
+// themselves instead of going through their offsets
+void draw_sprite_rect(sprite_t const *sprite, irect16_t r) {
+  draw_sprite_quad(sprite, r.x, r.y, r.w, r.h, 1);
+}
+
 void get_weapon_wobble_offset(int* offset_x, int* offset_y, float speed) {
   unsigned ticks = (unsigned)axGetMilliseconds();
   float time = ticks / 1000.0f;
@@ -387,15 +636,16 @@ void draw_crosshair(float k) {
       }
       
       // Add it to our sprite cache
-      if (sys->num_sprites < MAX_SPRITES) {
-        sprite_t* new_sprite = &sys->all_sprites[sys->num_sprites];
-        strncpy(new_sprite->name, "CROSSH", 16);
-        new_sprite->texture = sys->crosshair_texture;
-        new_sprite->width = CROSSHAIR_SIZE;
-        new_sprite->height = CROSSHAIR_SIZE;
-        new_sprite->offsetx = CROSSHAIR_SIZE/2;
-        new_sprite->offsety = CROSSHAIR_SIZE/2;
-        sys->num_sprites++;
+      sprite_t* crosshair = new_sprite();
+      if (crosshair) {
+        strncpy(crosshair->name, "CROSSH", 16);
+        crosshair->texture = sys->crosshair_texture;
+        crosshair->width = CROSSHAIR_SIZE;
+        crosshair->height = CROSSHAIR_SIZE;
+        crosshair->offsetx = CROSSHAIR_SIZE/2;
+        crosshair->offsety = CROSSHAIR_SIZE/2;
+        crosshair->uv[2] = crosshair->uv[3] = 1;
+        index_sprite(sys->num_sprites - 1);
         
         printf("Generated crosshair sprite (16x16)\n");
       }
@@ -444,12 +694,23 @@ void draw_crosshair(float k) {
 void cleanup_sprites(void) {
   sprite_system_t* sys = &g_sprite_system;
   
-  // Delete textures
-  for (int i = 0; i < sys->num_sprites; i++) {
-    glDeleteTextures(1, &sys->all_sprites[i].texture);
+  // Delete the atlas pages; sprites only borrow their textures
+  for (int i = 0; i < sys->num_pages; i++) {
+    glDeleteTextures(1, &sys->pages[i].texture);
   }
-    
-  // Reset sprite count
+  if (sys->crosshair_texture) {
+    glDeleteTextures(1, &sys->crosshair_texture);
+    sys->crosshair_texture = 0;
+  }
+  free(sys->pages);
+  sys->pages = NULL;
+  sys->num_pages = 0;
+  sys->open_page = -1;
+  
+  // Reset sprite count; the blocks and index are kept for reuse
   sys->num_sprites = 0;
+  if (sys->by_prefix4) {
+    memset(sys->by_prefix4, 0xff, (sys->mask + 1) * sizeof(int32_t));
+    memset(sys->by_prefix6, 0xff, (sys->mask + 1) * sizeof(int32_t));
+  }
 }
-
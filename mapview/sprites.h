@@ -4,15 +4,18 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <mapview/gl_compat.h>
+#include <ui/ui.h>
 
 // Sprite cache structure
 typedef struct {
   char name[16];         // Sprite name (e.g., "SHTGA0")
-  GLuint texture;        // OpenGL texture ID
+  GLuint texture;        // Atlas page holding the sprite, 0 until resident
+  float uv[4];           // Sprite rectangle on the page (u0, v0, u1, v1)
   int width;             // Sprite width
   int height;            // Sprite height
   int offsetx;           // X offset for centering
   int offsety;           // Y offset for centering
+  int lump;              // Lump to decode on first use, -1 once uploaded
 } sprite_t;
 
 typedef struct player_s player_t;
@@ -26,6 +29,9 @@ void init_intermission(void);
 // Draw a sprite at the specified screen position
 void draw_sprite(const char* name, float x, float y, float scale, float alpha);
 
+// Draw a sprite scaled to fill a rectangle
+void draw_sprite_rect(sprite_t const *sprite, irect16_t r);
+
 // Draw the weapon sprite at the bottom center of screen
 void draw_weapon(player_t const *player, float aspect);
 
@@ -41,6 +47,9 @@ int find_lump_from_file(FILE* wad_file, const char* name);
 
 int load_sprite(const char *name);
 sprite_t* find_sprite(const char* name);
+sprite_t* get_sprite(int index);
+int get_num_sprites(void);
+void make_sprite_resident(sprite_t *sprite);
 void set_projection(int x, int y, int w, int h);
 
 // things
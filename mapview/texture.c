@@ -1,9 +1,10 @@
 #include <mapview/gl_compat.h>
+#include <pthread.h>
 #include <string.h>
 #include <ctype.h>
+#include <strings.h>
 #include <mapview/map.h>
 
-#define MAX_TEXTURES 256
 #define MAX_TEXDIR 8
 
 // PNAMES lump structure
@@ -67,134 +68,345 @@ void set_selected_flat_texture(const char *str) {
 // Convenience function to get flat texture
 mapside_texture_t const *get_flat_texture(const char* name);
 result_t win_textures(window_t *win, uint32_t msg, uint32_t wparam, void *lparam);
+void free_texture_cache(texture_cache_t* cache);
 
-uint8_t* load_patch(void* patch_lump, int* width, int* height) {
-  if (!patch_lump) return NULL;
+// Residency bookkeeping for one registry entry, see request_texture
+enum { TEX_PENDING, TEX_REQUESTED, TEX_RESIDENT };
+
+struct texslot_s {
+  struct maptexture_s const *def;  // wall textures
+  int lump;                        // flats
+  uint8_t state;                   // page layer residency
+  bool want_image;                 // 2D RGBA copy asked for by the UI
+  int16_t page;                    // page holding a copy (0 for flats), -1 for none
+  uint16_t layer;
+};
+typedef struct texslot_s texslot_t;
+
+// Registries tag their handles in the top byte
+enum { TEXREG_WALLS = 1, TEXREG_FLATS = 2 };
+#define HANDLE_INDEX_BITS 24
+
+/*
+ Texture registry. Entries live in a growable array with an open-addressed
+ name index, so lookups are O(1) and case-insensitive like the engine's.
+ Growing may move entries, so anything kept across fills stores a
+ texhandle_t (registry tag plus index + 1, 0 for none) instead of a
+ pointer.
+ */
+
+static uint32_t texture_name_hash(const char *name) {
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < sizeof(texname_t) && name[i]; i++) {
+    hash = (hash ^ (uint8_t)toupper(name[i])) * 16777619u;
+  }
+  return hash;
+}
+
+static void index_registry_entry(texture_cache_t *cache, int index) {
+  uint32_t b = texture_name_hash(cache->textures[index].name) & cache->mask;
+  while (cache->buckets[b] >= 0) b = (b + 1) & cache->mask;
+  cache->buckets[b] = index;
+}
+
+static bool grow_registry(texture_cache_t *cache) {
+  int capacity = cache->capacity ? cache->capacity * 2 : 256;
+  mapside_texture_t *textures = realloc(cache->textures, sizeof(mapside_texture_t) * capacity);
+  if (!textures) return false;
+  cache->textures = textures;
+  texslot_t *slots = realloc(cache->slots, sizeof(texslot_t) * capacity);
+  if (!slots) return false;
+  cache->slots = slots;
+  // twice as many buckets as entries keeps probe chains short
+  int32_t *buckets = malloc(sizeof(int32_t) * capacity * 2);
+  if (!buckets) return false;
+  free(cache->buckets);
+  cache->buckets = buckets;
+  cache->mask = capacity * 2 - 1;
+  cache->capacity = capacity;
+  memset(cache->buckets, 0xff, sizeof(int32_t) * capacity * 2);
+  for (int i = 0; i < cache->num_textures; i++) {
+    index_registry_entry(cache, i);
+  }
+  return true;
+}
+
+static int find_registry_index(texture_cache_t const *cache, const char *name) {
+  if (!cache || !cache->buckets || !name) return -1;
+  for (uint32_t b = texture_name_hash(name) & cache->mask;; b = (b + 1) & cache->mask) {
+    int32_t i = cache->buckets[b];
+    if (i < 0) return -1;
+    if (strncasecmp(cache->textures[i].name, name, sizeof(texname_t)) == 0) return i;
+  }
+}
+
+// Appends a blank entry called name and returns its index, -1 if out of memory
+static int add_registry_entry(texture_cache_t *cache, const char *name) {
+  if (cache->num_textures == cache->capacity && !grow_registry(cache)) {
+    printf("Error: Out of memory for texture %.8s\n", name);
+    return -1;
+  }
+  int i = cache->num_textures++;
+  memset(&cache->textures[i], 0, sizeof(mapside_texture_t));
+  memset(&cache->slots[i], 0, sizeof(texslot_t));
+  strncpy(cache->textures[i].name, name, sizeof(texname_t));
+  index_registry_entry(cache, i);
+  return i;
+}
+
+static void clear_registry(texture_cache_t *cache) {
+  cache->num_textures = 0;
+  if (cache->buckets) {
+    memset(cache->buckets, 0xff, sizeof(int32_t) * (cache->mask + 1));
+  }
+}
+
+static texture_cache_t *registry_from_handle(texhandle_t handle) {
+  switch (handle >> HANDLE_INDEX_BITS) {
+    case TEXREG_WALLS: return texture_cache;
+    case TEXREG_FLATS: return flat_cache;
+    default: return NULL;
+  }
+}
+
+static texhandle_t make_handle(texture_cache_t const *cache, int index) {
+  if (!cache || index < 0) return 0;
+  return (cache->id << HANDLE_INDEX_BITS) | (uint32_t)(index + 1);
+}
+
+// Resolves a handle from get_texture_handle/get_flat_texture_handle. The
+// pointer is only valid until the registry is refilled.
+mapside_texture_t const *get_texture_by_handle(texhandle_t handle) {
+  texture_cache_t *cache = registry_from_handle(handle);
+  int index = (int)(handle & ((1 << HANDLE_INDEX_BITS) - 1)) - 1;
+  if (!cache || index < 0 || index >= cache->num_textures) return NULL;
+  return &cache->textures[index];
+}
+
+// Shown in place of textures that have not been composed yet
+static GLuint placeholder = 0;
+
+static GLuint get_placeholder_texture(void) {
+  if (placeholder) return placeholder;
+  static const uint8_t checker[] = {
+    96, 96, 96, 255,   32, 32, 32, 255,
+    32, 32, 32, 255,   96, 96, 96, 255,
+  };
+  glGenTextures(1, &placeholder);
+  glBindTexture(GL_TEXTURE_2D, placeholder);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 2, 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, checker);
+  return placeholder;
+}
+
+static bool is_resident(mapside_texture_t const *tex) {
+  return tex->texture && tex->texture != placeholder;
+}
+
+static int find_patch_lump(const char *patch_name) {
+  int lump_num = find_lump_num_ns(patch_name, NS_PATCHES);
+  return lump_num >= 0 ? lump_num : find_lump_num(patch_name);
+}
+
+// A patch decoded to palette indices. Columns are stored back to back,
+// matching the post layout, and mask marks which pixels a post covered;
+// everything else is a hole the texture behind shows through.
+typedef struct {
+  int16_t width;
+  int16_t height;
+  uint8_t *pixels;  // width * height indices, column-major
+  uint8_t *mask;    // 1 where the patch is opaque
+} decodedpatch_t;
+
+static void free_decoded_patch(decodedpatch_t *patch) {
+  free(patch->pixels);
+  memset(patch, 0, sizeof(decodedpatch_t));
+}
+
+static bool decode_patch(lumpview_t const *lump, decodedpatch_t *out) {
+  memset(out, 0, sizeof(decodedpatch_t));
+  if (!lump->data || !lump_view_has(lump, 0, offsetof(patch_t, columnofs))) return false;
   
   // Cast to patch structure for header access
-  patch_t* header = (patch_t*)patch_lump;
-  
-  *width = header->width;
-  *height = header->height;
+  patch_t const* header = (patch_t const*)lump->data;
   
-  // Allocate memory for the patch data (RGBA)
-  uint8_t* patch_data = calloc(*width * *height * 4, 1);
-  if (!patch_data) {
-    return NULL;
+  if (header->width <= 0 || header->height <= 0 ||
+      !lump_view_has(lump, 0, offsetof(patch_t, columnofs) + header->width * sizeof(int32_t))) {
+    return false;
   }
   
-  // Column offsets are directly accessible in the patch header
-  int32_t* columnofs = header->columnofs;
+  // Indices and mask share one allocation
+  size_t count = (size_t)header->width * header->height;
+  out->pixels = calloc(count * 2, 1);
+  if (!out->pixels) return false;
+  out->mask = out->pixels + count;
+  out->width = header->width;
+  out->height = header->height;
   
-  // Base address for byte calculations
-  uint8_t* lump_bytes = (uint8_t*)patch_lump;
+  // Column offsets are directly accessible in the patch header
+  int32_t const* columnofs = header->columnofs;
   
   // Process each column
   for (int x = 0; x < header->width; x++) {
-    // Calculate position of this column's data
-    uint8_t* column_data = lump_bytes + columnofs[x];
+    uint8_t *column = out->pixels + x * header->height;
+    uint8_t *mask = out->mask + x * header->height;
+    uint32_t ofs = columnofs[x];
     
-    // Process posts in this column
-    while (1) {
-      uint8_t topdelta = *column_data++;
+    // Process posts in this column, stopping at anything that would
+    // read past the end of the lump
+    while (lump_view_has(lump, ofs, 1)) {
+      uint8_t topdelta = lump->data[ofs];
       
       // 0xFF indicates end of column
       if (topdelta == 0xFF) break;
       
-      uint8_t length = *column_data++;
-      
-      // Skip unused byte (padding)
-      column_data++;
+      // topdelta, length, padding, pixels, padding
+      if (!lump_view_has(lump, ofs, 4)) break;
+      uint8_t length = lump->data[ofs + 1];
+      if (!lump_view_has(lump, ofs + 3, length + 1)) break;
       
-      // Read post data
-      for (int y = 0; y < length; y++) {
-        uint8_t color = *column_data++;
-        
-        // Store in RGBA format (alpha set to opaque)
-        int pos = ((topdelta + y) * header->width + x) * 4;
-        patch_data[pos] = color;     // R (temporarily storing color index)
-        patch_data[pos + 1] = color; // G (you might want to map to palette later)
-        patch_data[pos + 2] = color; // B (you might want to map to palette later)
-        patch_data[pos + 3] = 255;   // A (opaque)
+      int count = MIN(length, header->height - topdelta);
+      if (count > 0) {
+        memcpy(column + topdelta, lump->data + ofs + 3, count);
+        memset(mask + topdelta, 1, count);
       }
       
-      // Skip unused byte (padding)
-      column_data++;
+      ofs += length + 4;
     }
   }
   
-  return patch_data;
+  return true;
+}
+
+// Patches decoded while composing TEXTURE1..n, one slot per PNAMES entry.
+// Wall patches are shared by many textures, so each one is decoded once
+// instead of once per reference. The patches a batch needs are decoded
+// up front, after which composition only reads the cache.
+enum { PATCH_UNUSED, PATCH_WANTED, PATCH_READY, PATCH_MISSING };
+
+static struct {
+  decodedpatch_t *slots;
+  uint8_t *state;
+  int count;
+} patch_cache = {0};
+
+static bool open_patch_cache(int count) {
+  patch_cache.slots = calloc(count, sizeof(decodedpatch_t));
+  patch_cache.state = calloc(count, 1);
+  if (!patch_cache.slots || !patch_cache.state) {
+    free(patch_cache.slots);
+    free(patch_cache.state);
+    memset(&patch_cache, 0, sizeof(patch_cache));
+    return false;
+  }
+  patch_cache.count = count;
+  return true;
+}
+
+static void close_patch_cache(void) {
+  for (int i = 0; i < patch_cache.count; i++) {
+    free_decoded_patch(&patch_cache.slots[i]);
+  }
+  free(patch_cache.slots);
+  free(patch_cache.state);
+  memset(&patch_cache, 0, sizeof(patch_cache));
+}
+
+static void want_patches(maptexture_t const *tex_def) {
+  for (int i = 0; i < tex_def->patchcount; i++) {
+    int16_t patch = tex_def->patches[i].patch;
+    if (patch >= 0 && patch < patch_cache.count && patch_cache.state[patch] == PATCH_UNUSED) {
+      patch_cache.state[patch] = PATCH_WANTED;
+    }
+  }
+}
+
+static void decode_patch_job(int index, void *parm) {
+  mappatchnames_t const *pnames = parm;
+  if (patch_cache.state[index] != PATCH_WANTED) return;
+  
+  char const *patch_name = pnames->name[index];
+  lumpview_t patch_lump = view_lump_num(find_patch_lump(patch_name));
+  if (!patch_lump.data) {
+    printf("Warning: Could not find patch: %.8s\n", patch_name);
+  }
+  bool ok = decode_patch(&patch_lump, &patch_cache.slots[index]);
+  release_lump_view(&patch_lump);
+  patch_cache.state[index] = ok ? PATCH_READY : PATCH_MISSING;
 }
 
-// Create a GL texture from the given texture definition and patches
-GLuint
-create_texture_from_definition(maptexture_t* tex_def,
-                               mappatchnames_t* pnames)
+static decodedpatch_t const *get_decoded_patch(int index) {
+  if (index < 0 || index >= patch_cache.count) return NULL;
+  if (patch_cache.state[index] != PATCH_READY) return NULL;
+  return &patch_cache.slots[index];
+}
+
+// Composes a texture definition into a fresh buffer of palette index and
+// coverage pairs. No GL calls, so it runs on the worker pool.
+static uint8_t *
+compose_texture(maptexture_t const* tex_def,
+                mappatchnames_t const* pnames)
 {
   int width = tex_def->width;
   int height = tex_def->height;
   
-  // Allocate memory for the composed texture (RGBA)
-  uint8_t* texture_data = calloc(width * height * 4, 1);
-  if (!texture_data) return 0;
+  // Allocate memory for the composed texture (index, coverage)
+  uint8_t* texture_data = calloc(width * height * 2, 1);
+  if (!texture_data) return NULL;
   
   // Process each patch in the texture
   for (int i = 0; i < tex_def->patchcount; i++) {
-    mappatch_t* patch_ref = &tex_def->patches[i];
+    mappatch_t const* patch_ref = &tex_def->patches[i];
     
     // Get patch name from PNAMES
     if (patch_ref->patch >= pnames->nummappatches) {
       free(texture_data);
-      return 0;
+      return NULL;
     }
     
-    char* patch_name = pnames->name[patch_ref->patch];
+    decodedpatch_t const *patch = get_decoded_patch(patch_ref->patch);
+    if (!patch) continue;
     
-    // Find patch lump
-    void *patch_lump = cache_lump(patch_name);
-    if (!patch_lump) {
-      printf("Warning: Could not find patch: %s\n", patch_name);
-      continue;
-    }
-
-    // Load patch data
-    int patch_width, patch_height;
-    uint8_t* patch_data = load_patch(patch_lump, &patch_width, &patch_height);
-    if (!patch_data) continue;
-    
-    // Composite patch into texture at specified position
+    // Clip the patch to the texture once, then copy opaque runs column by column
     int originx = patch_ref->originx;
     int originy = patch_ref->originy;
+    int x0 = MAX(0, -originx), x1 = MIN(patch->width, width - originx);
+    int y0 = MAX(0, -originy), y1 = MIN(patch->height, height - originy);
     
-    for (int y = 0; y < patch_height; y++) {
-      int tex_y = originy + y;
-      if (tex_y < 0 || tex_y >= height) continue;
+    for (int x = x0; x < x1; x++) {
+      uint8_t const *column = patch->pixels + x * patch->height;
+      uint8_t const *mask = patch->mask + x * patch->height;
       
-      for (int x = 0; x < patch_width; x++) {
-        int tex_x = originx + x;
-        if (tex_x < 0 || tex_x >= width) continue;
-        
-        int patch_pos = (y * patch_width + x) * 4;
-        int tex_pos = (tex_y * width + tex_x) * 4;
-        
-        // Only copy if pixel is opaque (has alpha = 255)
-        if (patch_data[patch_pos + 3] == 255) {
-          uint8_t color_index = patch_data[patch_pos];
-          
-          // Convert color index to RGB using palette
-          texture_data[tex_pos] = palette[color_index].r;
-          texture_data[tex_pos + 1] = palette[color_index].g;
-          texture_data[tex_pos + 2] = palette[color_index].b;
-          texture_data[tex_pos + 3] = 255; // Opaque
-//          texture_data[tex_pos + 3] = color_index > 220 ? 0 : 255;
-        }
+      for (int y = y0; y < y1; y++) {
+        if (!mask[y]) continue;
+        uint8_t *pixel = texture_data + ((originy + y) * width + originx + x) * 2;
+        pixel[0] = column[y];
+        pixel[1] = 255; // Opaque
       }
     }
-    
-    free(patch_data);
   }
   
-  // Create OpenGL texture
+  return texture_data;
+}
+
+// Expands palette indices to RGBA for the 2D textures the browser windows
+// draw; the world renderer never needs them. stride is 2 for index and coverage pairs, 1 for opaque indices.
+static uint8_t *expand_indexed(uint8_t const *pixels, int count, int stride) {
+  uint8_t *rgba = malloc(count * 4);
+  if (!rgba) return NULL;
+  for (int i = 0; i < count; i++) {
+    palette_entry_t const *color = &palette[pixels[i * stride]];
+    rgba[i * 4 + 0] = color->r;
+    rgba[i * 4 + 1] = color->g;
+    rgba[i * 4 + 2] = color->b;
+    rgba[i * 4 + 3] = stride == 2 ? pixels[i * 2 + 1] : 255;
+  }
+  return rgba;
+}
+
+// Create OpenGL texture for a wall or a flat
+static GLuint upload_texture(uint8_t const *data, int width, int height) {
   GLuint tex;
   glGenTextures(1, &tex);
   glBindTexture(GL_TEXTURE_2D, tex);
@@ -202,14 +414,519 @@ create_texture_from_definition(maptexture_t* tex_def,
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
   
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture_data);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
   
   glGenerateMipmap(GL_TEXTURE_2D);
   
-  free(texture_data);
   return tex;
 }
 
+// The world renderer samples palette indices and resolves colour and
+// light through PLAYPAL and COLORMAP in the shader (see renderer.c), so
+// its copies of textures and flats hold indices rather than RGBA.
+static void requeue_resident(texture_cache_t *cache);
+
+// Layers of an array texture not handed out yet. Entries get a layer when
+// they are first made resident; until then they show layer 0, which every
+// array keeps for a checker.
+typedef struct {
+  uint16_t *layers;
+  int count;
+} freelayers_t;
+
+static bool init_free_layers(freelayers_t *list, int layers) {
+  list->count = 0;
+  list->layers = malloc(sizeof(uint16_t) * layers);
+  if (!list->layers) return false;
+  // Taken from the end, so low layers go first
+  for (int i = layers - 1; i > 0; i--) {
+    list->layers[list->count++] = (uint16_t)i;
+  }
+  return true;
+}
+
+static void release_free_layers(freelayers_t *list) {
+  free(list->layers);
+  list->layers = NULL;
+  list->count = 0;
+}
+
+// Entries that are or are about to be resident need a layer, except skies,
+// which have no source here and are drawn on their own
+static bool wants_layer(texslot_t const *slot) {
+  return slot->state != TEX_PENDING && (slot->def || slot->lump >= 0);
+}
+
+static int max_array_layers(void) {
+  static GLint max_layers = 0;
+  if (!max_layers) {
+    max_layers = 256;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+  }
+  return max_layers;
+}
+
+// Layers for an array of count entries and the fallback, with room to
+// spare so the next few requests do not rebuild it
+static int array_layers(int count) {
+  int layers = 8;
+  while (layers < count + 1) layers <<= 1;
+  return MIN(layers, max_array_layers());
+}
+
+// Fills layer 0 of the bound array with the fallback checker, two greys
+// from the PLAYPAL grey ramp. stride is 2 for wall texels, which add a
+// coverage byte, and 1 for flats.
+static void upload_fallback_layer(int width, int height, int stride) {
+  uint8_t *checker = malloc(width * height * stride);
+  if (!checker) return;
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      uint8_t *texel = checker + (y * width + x) * stride;
+      texel[0] = (((x >> 3) ^ (y >> 3)) & 1) ? 108 : 100;
+      if (stride == 2) texel[1] = 255;
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0, width, height, 1,
+                  stride == 2 ? GL_RG : GL_RED, GL_UNSIGNED_BYTE, checker);
+  free(checker);
+}
+
+// Every flat is 64x64, so flats also live in one R8 array texture that
+// the floor renderer samples by layer.
+static GLuint flat_array = 0;
+static int flat_array_layers = 0;
+static freelayers_t flat_free = {0};
+
+static void upload_flat_layer(int layer, uint8_t const *indices) {
+  glBindTexture(GL_TEXTURE_2D_ARRAY, flat_array);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, 64, 64, 1, GL_RED, GL_UNSIGNED_BYTE, indices);
+}
+
+// Recreates the flat array with room for the flats that are resident or
+// requested. Their layers are handed out again, so resident flats are
+// queued to be converted again.
+static void build_flat_array(void) {
+  if (flat_array) glDeleteTextures(1, &flat_array);
+  flat_array = 0;
+  flat_array_layers = 0;
+  release_free_layers(&flat_free);
+  if (!flat_cache || !flat_cache->num_textures) return;
+  
+  int count = 0;
+  for (int i = 0; i < flat_cache->num_textures; i++) {
+    flat_cache->slots[i].page = -1;
+    count += wants_layer(&flat_cache->slots[i]);
+  }
+  if (count >= max_array_layers()) {
+    printf("Warning: Only %d of %d flats fit in the flat array\n", max_array_layers() - 1, count);
+  }
+  int layers = array_layers(count);
+  if (!init_free_layers(&flat_free, layers)) return;
+  flat_array_layers = layers;
+  
+  glGenTextures(1, &flat_array);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, flat_array);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, 64, 64, flat_array_layers, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+  upload_fallback_layer(64, 64, 1);
+  requeue_resident(flat_cache);
+}
+
+// Wall textures are also copied into array pages, one page per size
+// class (both sides rounded up to a power of two), so visible walls can be
+// drawn with one multi-draw per page. Each texture sits at the corner of
+// its layer and the wall shader wraps texture coordinates itself. Texels
+// are RG8: palette index and coverage.
+static texpage_t *wall_pages = NULL;
+static freelayers_t *wall_free = NULL;
+static int num_wall_pages = 0;
+
+static int page_size_class(int size) {
+  int pow2 = 8;
+  while (pow2 < size) pow2 <<= 1;
+  return pow2;
+}
+
+static void upload_wall_layer(texslot_t const *slot, mapside_texture_t const *tex, uint8_t const *texels) {
+  glBindTexture(GL_TEXTURE_2D_ARRAY, wall_pages[slot->page].texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, slot->layer, tex->width, tex->height, 1,
+                  GL_RG, GL_UNSIGNED_BYTE, texels);
+}
+
+// Page of the texture's size class with a free layer left, -1 if none.
+// taken, if given, counts layers already promised from each page.
+static int find_wall_page(mapside_texture_t const *tex, int const *taken) {
+  int width = page_size_class(tex->width), height = page_size_class(tex->height);
+  for (int i = 0; i < num_wall_pages; i++) {
+    if (wall_pages[i].width == width && wall_pages[i].height == height &&
+        wall_free[i].count > (taken ? taken[i] : 0)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Sorts the wall textures that are resident or requested into pages by
+// size class and queues the resident ones to be composed again into their
+// new layers
+static void build_wall_pages(void) {
+  for (int i = 0; i < num_wall_pages; i++) {
+    glDeleteTextures(1, &wall_pages[i].texture);
+    release_free_layers(&wall_free[i]);
+  }
+  free(wall_pages);
+  free(wall_free);
+  wall_pages = NULL;
+  wall_free = NULL;
+  num_wall_pages = 0;
+  if (!texture_cache || !texture_cache->num_textures) return;
+  
+  // There are far fewer size classes than textures. Count the textures of
+  // each class in its layers first.
+  texpage_t *classes = calloc(texture_cache->num_textures, sizeof(texpage_t));
+  if (!classes) return;
+  int num_classes = 0;
+  for (int i = 0; i < texture_cache->num_textures; i++) {
+    texslot_t *slot = &texture_cache->slots[i];
+    slot->page = -1;
+    if (!wants_layer(slot)) continue;
+    mapside_texture_t const *tex = &texture_cache->textures[i];
+    int width = page_size_class(tex->width), height = page_size_class(tex->height);
+    int c = 0;
+    while (c < num_classes && (classes[c].width != width || classes[c].height != height)) {
+      c++;
+    }
+    if (c == num_classes) {
+      classes[num_classes++] = (texpage_t){ 0, width, height, 0 };
+    }
+    classes[c].layers++;
+  }
+  
+  // Every page gives up layer 0 to the fallback
+  int max_pages = 0;
+  for (int c = 0; c < num_classes; c++) {
+    max_pages += (classes[c].layers + max_array_layers() - 2) / (max_array_layers() - 1);
+  }
+  wall_pages = calloc(max_pages, sizeof(texpage_t));
+  wall_free = calloc(max_pages, sizeof(freelayers_t));
+  
+  for (int c = 0; c < num_classes && wall_pages && wall_free; c++) {
+    for (int left = classes[c].layers; left > 0;) {
+      texpage_t *page = &wall_pages[num_wall_pages];
+      *page = (texpage_t){ 0, classes[c].width, classes[c].height, array_layers(left) };
+      if (!init_free_layers(&wall_free[num_wall_pages], page->layers)) break;
+      glGenTextures(1, &page->texture);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, page->texture);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RG8, page->width, page->height, page->layers, 0,
+                   GL_RG, GL_UNSIGNED_BYTE, NULL);
+      upload_fallback_layer(page->width, page->height, 2);
+      num_wall_pages++;
+      left -= page->layers - 1;
+    }
+  }
+  free(classes);
+  requeue_resident(texture_cache);
+}
+
+int get_num_wall_pages(void) {
+  return num_wall_pages;
+}
+
+texpage_t const *get_wall_page(int page) {
+  return page >= 0 && page < num_wall_pages ? &wall_pages[page] : NULL;
+}
+
+// Layer of a wall texture handle within its page, -1 if there are no
+// pages. Textures not uploaded yet get the fallback layer of a page of
+// their size class, or of the first page if their class has none yet.
+int get_wall_layer(texhandle_t handle, int *page) {
+  mapside_texture_t const *tex = get_texture_by_handle(handle);
+  if (!tex || handle >> HANDLE_INDEX_BITS != TEXREG_WALLS || !num_wall_pages) return -1;
+  texslot_t const *slot = &texture_cache->slots[tex - texture_cache->textures];
+  if (slot->page >= 0) {
+    *page = slot->page;
+    return slot->layer;
+  }
+  int width = page_size_class(tex->width), height = page_size_class(tex->height);
+  *page = 0;
+  for (int i = 0; i < num_wall_pages; i++) {
+    if (wall_pages[i].width == width && wall_pages[i].height == height) {
+      *page = i;
+      break;
+    }
+  }
+  return 0;
+}
+
+uint32_t get_flat_array(void) {
+  return flat_array;
+}
+
+// Layer of a flat handle in the flat array, -1 if there is no array.
+// Flats not uploaded yet get the fallback layer.
+int get_flat_layer(texhandle_t handle) {
+  mapside_texture_t const *tex = get_texture_by_handle(handle);
+  if (!tex || handle >> HANDLE_INDEX_BITS != TEXREG_FLATS || !flat_array) return -1;
+  texslot_t const *slot = &flat_cache->slots[tex - flat_cache->textures];
+  return slot->page < 0 ? 0 : slot->layer;
+}
+
+// Lazy residency. Filling a cache only records where each entry's pixels
+// come from. get_texture and the handle lookups ask for the page layer
+// the world renderer samples; the 2D RGBA texture is only built when a
+// UI draw asks for it with request_texture_image, and shows a placeholder
+// until then. Requests may come from the map loader thread, so they are
+// queued under a lock and composed in one batch by
+// update_texture_residency on the main thread.
+static int num_requests = 0;
+static pthread_mutex_t request_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// TEXTUREx and PNAMES stay acquired while wall textures may be composed
+static struct {
+  int lumps[MAX_TEXDIR];
+  texture_directory_t *dirs[MAX_TEXDIR];
+  int count;
+  int pnames_lump;
+  mappatchnames_t *pnames;
+} texdefs = { .pnames_lump = -1 };
+
+// A cache entry waiting for its pixels. Workers fill pixels with palette
+// indices, then the main thread uploads them into the world renderer's
+// pages and, if asked for, out->texture.
+typedef struct {
+  maptexture_t const *def;  // wall textures
+  int lump;                 // flats
+  mapside_texture_t *out;
+  uint8_t *pixels;
+  bool layer, image;
+} texjob_t;
+
+static uint8_t *convert_flat(int lump_num);
+
+static void compose_texture_job(int index, void *parm) {
+  texjob_t *job = &((texjob_t *)parm)[index];
+  job->pixels = job->def ? compose_texture(job->def, texdefs.pnames) : convert_flat(job->lump);
+}
+
+static texslot_t *find_texture_slot(mapside_texture_t const *tex) {
+  if (texture_cache && tex >= texture_cache->textures &&
+      tex < texture_cache->textures + texture_cache->num_textures) {
+    return &texture_cache->slots[tex - texture_cache->textures];
+  }
+  if (flat_cache && tex >= flat_cache->textures &&
+      tex < flat_cache->textures + flat_cache->num_textures) {
+    return &flat_cache->slots[tex - flat_cache->textures];
+  }
+  return NULL;
+}
+
+// Asks for a texture to be composed into its page layer by the next
+// update_texture_residency. Safe to call from any thread.
+void request_texture(mapside_texture_t const *tex) {
+  texslot_t *slot = tex ? find_texture_slot(tex) : NULL;
+  if (!slot) return;
+  pthread_mutex_lock(&request_lock);
+  if (slot->state == TEX_PENDING) {
+    slot->state = TEX_REQUESTED;
+    num_requests++;
+  }
+  pthread_mutex_unlock(&request_lock);
+}
+
+// Asks for the 2D RGBA texture in tex->texture, for windows that draw the
+// texture itself. Safe to call from any thread.
+void request_texture_image(mapside_texture_t const *tex) {
+  texslot_t *slot = tex ? find_texture_slot(tex) : NULL;
+  if (!slot || (!slot->def && slot->lump < 0)) return;
+  pthread_mutex_lock(&request_lock);
+  if (!slot->want_image && !is_resident(tex)) {
+    slot->want_image = true;
+    num_requests++;
+  }
+  pthread_mutex_unlock(&request_lock);
+}
+
+// Queues every resident entry to be composed again into the freshly built
+// pages and arrays. Its GL texture is kept.
+static void requeue_resident(texture_cache_t *cache) {
+  pthread_mutex_lock(&request_lock);
+  for (int i = 0; i < cache->num_textures; i++) {
+    texslot_t *slot = &cache->slots[i];
+    if (slot->state != TEX_RESIDENT) continue;
+    if (!slot->def && slot->lump < 0) continue;  // skies have no source here
+    slot->state = TEX_REQUESTED;
+    num_requests++;
+  }
+  pthread_mutex_unlock(&request_lock);
+}
+
+// Whether every entry waiting for a wall layer can get one from the pages
+// as they are
+static bool wall_layers_fit(void) {
+  if (!texture_cache) return true;
+  int *taken = calloc(num_wall_pages + 1, sizeof(int));
+  if (!taken) return true;
+  bool fit = true;
+  pthread_mutex_lock(&request_lock);
+  for (int i = 0; i < texture_cache->num_textures && fit; i++) {
+    texslot_t const *slot = &texture_cache->slots[i];
+    if (!wants_layer(slot) || slot->page >= 0) continue;
+    int page = find_wall_page(&texture_cache->textures[i], taken);
+    if (page < 0) fit = false;
+    else taken[page]++;
+  }
+  pthread_mutex_unlock(&request_lock);
+  free(taken);
+  return fit;
+}
+
+// Whether every entry waiting for a flat layer can get one, or the array
+// can't grow any further
+static bool flat_layers_fit(void) {
+  if (!flat_cache || flat_array_layers == max_array_layers()) return true;
+  int waiting = 0;
+  pthread_mutex_lock(&request_lock);
+  for (int i = 0; i < flat_cache->num_textures; i++) {
+    texslot_t const *slot = &flat_cache->slots[i];
+    waiting += wants_layer(slot) && slot->page < 0;
+  }
+  pthread_mutex_unlock(&request_lock);
+  return waiting <= flat_free.count;
+}
+
+// Hands an entry a layer from its array, false if it has none left
+static bool take_layer(texslot_t *slot, mapside_texture_t const *tex) {
+  if (slot->page >= 0) return true;
+  freelayers_t *list = &flat_free;
+  int page = 0;
+  if (slot->def) {
+    page = find_wall_page(tex, NULL);
+    if (page < 0) return false;
+    list = &wall_free[page];
+  }
+  if (!list->count) return false;
+  slot->page = page;
+  slot->layer = list->layers[--list->count];
+  return true;
+}
+
+static void give_back_layer(texslot_t *slot) {
+  if (slot->page < 0) return;
+  freelayers_t *list = slot->def ? &wall_free[slot->page] : &flat_free;
+  list->layers[list->count++] = slot->layer;
+  slot->page = -1;
+}
+
+static void collect_requests(texture_cache_t *cache, texjob_t *jobs, int *num_jobs) {
+  if (!cache) return;
+  texslot_t *slots = cache->slots;
+  for (int i = 0; i < cache->num_textures; i++) {
+    bool layer = false;
+    if (slots[i].state == TEX_REQUESTED) {
+      layer = take_layer(&slots[i], &cache->textures[i]);
+      // Without a layer it waits for the next batch, which makes room
+      // first, unless the flat array can't grow any further
+      if (layer || (!slots[i].def && flat_array_layers == max_array_layers())) {
+        slots[i].state = TEX_RESIDENT;
+      } else {
+        num_requests++;
+      }
+    }
+    bool image = slots[i].want_image;
+    if (!layer && !image) continue;
+    slots[i].want_image = false;
+    jobs[(*num_jobs)++] = (texjob_t){ slots[i].def, slots[i].lump, &cache->textures[i], NULL, layer, image };
+    if (slots[i].def) want_patches(slots[i].def);
+  }
+}
+
+// Composes every requested texture on the worker pool and uploads them.
+// Returns true if anything was uploaded. Main thread only.
+bool update_texture_residency(void) {
+  pthread_mutex_lock(&request_lock);
+  int pending = num_requests;
+  pthread_mutex_unlock(&request_lock);
+  if (!pending) return false;
+  
+  // Make room first. Rebuilding queues the resident entries again, so
+  // they are composed into their new layers in this same batch.
+  if (!wall_layers_fit()) build_wall_pages();
+  if (!flat_layers_fit()) build_flat_array();
+  
+  pthread_mutex_lock(&request_lock);
+  int max_jobs = (texture_cache ? texture_cache->num_textures : 0) +
+                 (flat_cache ? flat_cache->num_textures : 0);
+  texjob_t *jobs = malloc(sizeof(texjob_t) * (max_jobs + 1));
+  int num_jobs = 0;
+  if (jobs) {
+    num_requests = 0;
+    collect_requests(texture_cache, jobs, &num_jobs);
+    collect_requests(flat_cache, jobs, &num_jobs);
+  }
+  pthread_mutex_unlock(&request_lock);
+  if (!jobs) return false;
+  
+  if (texdefs.pnames) {
+    parallel_for(patch_cache.count, decode_patch_job, texdefs.pnames);
+  }
+  parallel_for(num_jobs, compose_texture_job, jobs);
+  
+  for (int i = 0; i < num_jobs; i++) {
+    texjob_t *job = &jobs[i];
+    texslot_t *slot = find_texture_slot(job->out);
+    if (!job->pixels) {
+      // Nothing to show, so the layer goes back and the fallback stays
+      if (job->layer) give_back_layer(slot);
+      continue;
+    }
+    if (job->image && !is_resident(job->out)) {
+      int stride = job->def ? 2 : 1;
+      uint8_t *rgba = expand_indexed(job->pixels, job->out->width * job->out->height, stride);
+      if (rgba) job->out->texture = upload_texture(rgba, job->out->width, job->out->height);
+      free(rgba);
+    }
+    if (job->layer && job->def) {
+      upload_wall_layer(slot, job->out, job->pixels);
+    } else if (job->layer) {
+      upload_flat_layer(slot->layer, job->pixels);
+    }
+    free(job->pixels);
+  }
+  free(jobs);
+  return num_jobs > 0;
+}
+
+// Requests every texture and flat the map references and makes them
+// resident, so the first frame of a freshly opened map has no placeholders
+void prefetch_map_textures(map_data_t const *map) {
+  for (int i = 0; i < map->num_sidedefs; i++) {
+    mapsidedef_t const *side = &map->sidedefs[i];
+    get_texture(side->toptexture);
+    get_texture(side->bottomtexture);
+    get_texture(side->midtexture);
+  }
+  for (int i = 0; i < map->num_sectors; i++) {
+    get_flat_texture(map->sectors[i].floorpic);
+    get_flat_texture(map->sectors[i].ceilingpic);
+  }
+  update_texture_residency();
+}
+
+static void release_texture_sources(void) {
+  for (int j = 0; j < texdefs.count; j++) release_lump_num(texdefs.lumps[j]);
+  release_lump_num(texdefs.pnames_lump);
+  close_patch_cache();
+  memset(&texdefs, 0, sizeof(texdefs));
+  texdefs.pnames_lump = -1;
+}
+
 // Find a texture in the directory by name
 maptexture_t*
 find_texture(texture_directory_t* directory,
@@ -225,110 +942,92 @@ find_texture(texture_directory_t* directory,
   return NULL;
 }
 
-// Try to load texture from texture directories
-static mapside_texture_t*
-load_texture_from_directories(texname_t const tex_name,
-                              texture_directory_t* tex_dirs[],
-                              mappatchnames_t* pnames)
-{
-  static mapside_texture_t tmp;
-  maptexture_t* tex_def = NULL;
+// Adds a cache entry for the texture, leaving a placeholder until it is
+// requested
+static void maybe_load_texture(texture_cache_t* cache, texname_t const tex_name) {
+  if (tex_name[0] == '-' || tex_name[0] == '\0') return;
+  
+  // Check if texture is already in cache
+  if (find_registry_index(cache, tex_name) >= 0) return;
+  
   texname_t uppercase = {0};
-
   for (int i = 0; i < sizeof(texname_t); i++) {
     uppercase[i] = toupper(tex_name[i]);
   }
   
   // Try each texture directory until we find the texture
-  for (int i = 0; i < MAX_TEXDIR; i++) {
-    tex_def = find_texture(tex_dirs[i], uppercase);
-    if (tex_def) break;
-  }
-  
-  // If texture definition found, create OpenGL texture
-  if (tex_def) {
-    tmp.texture = create_texture_from_definition(tex_def, pnames);
-    tmp.width = tex_def->width;
-    tmp.height = tex_def->height;
-    strncpy(tmp.name, tex_name, sizeof(texname_t));
-    return &tmp;
-  }
-  
-  return NULL;
-}
-
-// Try to load texture
-static void maybe_load_texture(texture_cache_t* cache, texname_t const tex_name,
-                               texture_directory_t* tex_dirs[], mappatchnames_t* pnames) {
-  if (tex_name[0] == '-' || tex_name[0] == '\0') return;
-  if (cache->num_textures == MAX_TEXTURES) return;
-  
-  // Check if texture is already in cache
-  for (int j = 0; j < cache->num_textures; j++) {
-    if (strncmp(cache->textures[j].name, tex_name, 8) == 0) {
-      return;  // Already cached
-    }
-  }
-  
-  // Try to load from texture directories
-  mapside_texture_t *tex =
-  load_texture_from_directories(tex_name, tex_dirs, pnames);
-  
-  if (tex) {
-    cache->textures[cache->num_textures++] = *tex;
+  maptexture_t* tex_def = NULL;
+  for (int i = 0; i < texdefs.count && !tex_def; i++) {
+    tex_def = find_texture(texdefs.dirs[i], uppercase);
   }
+  if (!tex_def) return;
+  
+  int index = add_registry_entry(cache, tex_name);
+  if (index < 0) return;
+  texslot_t *slot = &cache->slots[index];
+  mapside_texture_t *tex = &cache->textures[index];
+  *slot = (texslot_t){ .def = tex_def, .lump = -1, .page = -1 };
+  tex->texture = get_placeholder_texture();
+  tex->width = tex_def->width;
+  tex->height = tex_def->height;
 }
 
-// Check if a lump is a marker (like F_START, F_END)
-bool is_marker(const char* name) {
-  if (name[0] == 'F' && name[1] == '_' && strcmp(name + 2, "START") == 0) return true;
-  if (name[0] == 'F' && name[1] == '_' && strcmp(name + 2, "END") == 0) return true;
-  if (strcmp(name, "FF_START") == 0) return true;
-  if (strcmp(name, "FF_END") == 0) return true;
-  return false;
-}
-
-// Main function to allocate textures for map sides
-int allocate_mapside_textures(void) {
-  texture_cache = malloc(sizeof(texture_cache_t) + sizeof(texture_cache_t) * MAX_TEXTURES);
-  memset(texture_cache, 0, sizeof(texture_cache_t));
-
-  // Array of texture directories
-  texture_directory_t *tex_dirs[MAX_TEXDIR]={0};
-  int dir_count = 0;
+// Lists every texture defined in TEXTURE1..n in the cache. Nothing is
+// composed here; see update_texture_residency.
+static void fill_mapside_textures(texture_cache_t *cache) {
+  release_texture_sources();
   
   // Find and load all texture directories (TEXTURE1, TEXTURE2, etc.)
-  for (int i = 0; dir_count < MAX_TEXDIR; i++) {
+  for (int i = 0; i < MAX_TEXDIR; i++) {
     char tex_lump_name[sizeof(lumpname_t)+1]={0};
     snprintf(tex_lump_name, sizeof(tex_lump_name), "TEXTURE%d", i+1);
-    texture_directory_t *td = cache_lump(tex_lump_name);
+    int lump = find_lump_num(tex_lump_name);
+    texture_directory_t *td = acquire_lump_num(lump);
     if (td) {
-      tex_dirs[dir_count++] = td;
+      texdefs.lumps[texdefs.count] = lump;
+      texdefs.dirs[texdefs.count++] = td;
     }
   }
   
-  if (dir_count == 0) {
+  if (texdefs.count == 0) {
     printf("Error: No texture directories found (TEXTURE1, TEXTURE2)\n");
-    return 0;
+    return;
   }
     
   // Load PNAMES
-  mappatchnames_t* pnames = cache_lump("PNAMES");
-  if (!pnames) {
+  texdefs.pnames_lump = find_lump_num("PNAMES");
+  texdefs.pnames = acquire_lump_num(texdefs.pnames_lump);
+  if (!texdefs.pnames) {
     printf("Error: Failed to load PNAMES lump\n");
-    return 0;
+    release_texture_sources();
+    return;
+  }
+  
+  if (!open_patch_cache(texdefs.pnames->nummappatches)) {
+    printf("Error: Out of memory for %d decoded patches\n", texdefs.pnames->nummappatches);
+    release_texture_sources();
+    return;
   }
   
-  for (int j = 0; j < dir_count; j++) {
-    texture_directory_t* directory = tex_dirs[j];
+  for (int j = 0; j < texdefs.count; j++) {
+    texture_directory_t* directory = texdefs.dirs[j];
     for (int i = 0; i < directory->numtextures; i++) {
       maptexture_t *tex = ((void*)directory)+directory->offsets[i];
       if (strstr(tex->name, "SKY")||strstr(tex->name, "CLOCK")) {
         continue;
       }
-      maybe_load_texture(texture_cache, tex->name, tex_dirs, pnames);
+      maybe_load_texture(cache, tex->name);
     }
   }
+}
+
+// Main function to allocate textures for map sides
+int allocate_mapside_textures(void) {
+  texture_cache = calloc(1, sizeof(texture_cache_t));
+  texture_cache->id = TEXREG_WALLS;
+  
+  fill_mapside_textures(texture_cache);
+  build_wall_pages();
   
   // Process each sidedef
 //  for (int i = 0; i < map->num_sidedefs; i++) {
@@ -355,151 +1054,97 @@ void free_texture_cache(texture_cache_t* cache) {
   if (!cache) return;
   
   for (int i = 0; i < cache->num_textures; i++) {
-    if (cache->textures[i].texture) {
+    if (is_resident(&cache->textures[i])) {
       glDeleteTextures(1, &cache->textures[i].texture);
     }
   }
   
-  cache->num_textures = 0;
+  clear_registry(cache);
 }
 
 // Get texture from cache by name
 mapside_texture_t *get_texture_from_cache(texture_cache_t* cache, const char* name) {
-  for (int i = 0; i < cache->num_textures; i++) {
-    if (strncmp(cache->textures[i].name, name, 8) == 0) {
-      return &cache->textures[i];
-    }
-  }
-  
-  return NULL;
+  int i = find_registry_index(cache, name);
+  return i >= 0 ? &cache->textures[i] : NULL;
 }
 
 // Convenience function to get texture
 mapside_texture_t const *get_texture(const char* name) {
-  return get_texture_from_cache(texture_cache, name);
+  mapside_texture_t const *tex = get_texture_from_cache(texture_cache, name);
+  request_texture(tex);
+  return tex;
 }
 
 /*
  Flat textures
  */
 
-// Load a single flat texture and create an OpenGL texture
-mapside_texture_t *
-load_flat_texture(texname_t const floorpic)
+// Copies a flat lump's palette indices into a fresh buffer. No GL calls,
+// so it runs on the worker pool.
+static uint8_t *
+convert_flat(int lump_num)
 {
-  filelump_t *flat_lump = find_lump(floorpic);
-  static mapside_texture_t tmp = {0};
+  lumpview_t flat_lump = view_lump_num(lump_num);
   
   // Check size - flats should be 64x64 (4096 bytes)
-  if (flat_lump->size != 4096) {
-    printf("Warning: Flat %s has unexpected size: %d bytes\n", flat_lump->name, flat_lump->size);
-    if (flat_lump->size < 4096) return 0;
+  if (flat_lump.size != 4096) {
+    printf("Warning: Flat %.8s has unexpected size: %d bytes\n", get_lump_name(lump_num), flat_lump.size);
+    if (flat_lump.size < 4096) {
+      release_lump_view(&flat_lump);
+      return NULL;
+    }
   }
   
   // Flats are 64x64 pixels
   const int width = 64;
   const int height = 64;
   
-  // Read raw flat data (just color indices)
-  uint8_t *raw_flat = cache_lump(floorpic);
-  uint8_t *flat_data = malloc(width*height*4);
-
-  // Convert color indices to RGBA using palette
-  for (int i = 0; i < width * height; i++) {
-    uint8_t index = raw_flat[i];
-    flat_data[i * 4 + 0] = palette[index].r; // R
-    flat_data[i * 4 + 1] = palette[index].g; // G
-    flat_data[i * 4 + 2] = palette[index].b; // B
-    flat_data[i * 4 + 3] = 255;              // A (always opaque)
+  // Raw flat data is just color indices, which is what the flat array holds
+  uint8_t *flat_data = malloc(width * height);
+  if (flat_data) {
+    memcpy(flat_data, flat_lump.data, width * height);
   }
   
-  // Create OpenGL texture
-  GLuint tex;
-  glGenTextures(1, &tex);
-  glBindTexture(GL_TEXTURE_2D, tex);
-  
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, flat_data);
-  
-  glGenerateMipmap(GL_TEXTURE_2D);
-  
-  tmp.texture = tex;
-  tmp.width = width;
-  tmp.height = height;
-  strncpy(tmp.name, floorpic, sizeof(texname_t));
-  
-  free(flat_data);
+  release_lump_view(&flat_lump);
+  return flat_data;
+}
 
-  return &tmp;
+// Lists every flat of the merged F_START/F_END namespace in the cache.
+// Nothing is converted here; see update_texture_residency.
+static void fill_flat_textures(texture_cache_t *cache) {
+  for (int i = next_lump_in_ns(-1, NS_FLATS); i >= 0; i = next_lump_in_ns(i, NS_FLATS)) {
+    // Flats should be 64x64 (4096 bytes)
+    if (get_lump_size(i) < 4096) {
+      printf("Warning: Flat %.8s has unexpected size: %d bytes\n", get_lump_name(i), get_lump_size(i));
+      continue;
+    }
+    
+    // Check if flat is already in cache
+    if (find_registry_index(cache, get_lump_name(i)) >= 0) continue;
+    
+    int index = add_registry_entry(cache, get_lump_name(i));
+    if (index < 0) break;
+    texslot_t *slot = &cache->slots[index];
+    mapside_texture_t *tex = &cache->textures[index];
+    *slot = (texslot_t){ .lump = i, .page = -1 };
+    tex->texture = get_placeholder_texture();
+    tex->width = 64;
+    tex->height = 64;
+  }
 }
 
 // Main function to allocate flat textures for map
 int allocate_flat_textures(void) {
-  flat_cache = malloc(sizeof(texture_cache_t) + MAX_TEXTURES * sizeof(mapside_texture_t));
-  memset(flat_cache, 0, sizeof(texture_cache_t));
+  flat_cache = calloc(1, sizeof(texture_cache_t));
+  flat_cache->id = TEXREG_FLATS;
   
-  // Find F_START and F_END markers
-  int f_start = find_lump_num("F_START"), f_end = find_lump_num("F_END");
-  int ff_start = find_lump_num("FF_START"), ff_end = find_lump_num("FF_END");
-  
-  if (f_start < 0 || f_end < 0 || f_start >= f_end) {
+  if (next_lump_in_ns(-1, NS_FLATS) < 0) {
     printf("Error: Could not find flat markers (F_START/F_END)\n");
     return 0;
   }
   
-  // Load flats between F_START and F_END
-  for (int i = f_start + 1; i < f_end; i++) {
-    // Skip markers
-    if (is_marker(get_lump_name(i))) continue;
-    
-    // Check if we're at capacity
-    if (flat_cache->num_textures >= MAX_TEXTURES) break;
-    
-    // Check if flat is already in cache
-    bool already_cached = false;
-    for (int j = 0; j < flat_cache->num_textures; j++) {
-      if (strncmp(flat_cache->textures[j].name, get_lump_name(i), 8) == 0) {
-        already_cached = true;
-        break;
-      }
-    }
-    if (already_cached) continue;
-    
-    // Load the flat texture
-    mapside_texture_t *tex = load_flat_texture(get_lump_name(i));
-    if (tex) {
-      flat_cache->textures[flat_cache->num_textures++] = *tex;
-    }
-  }
-  
-  // If FF_START/FF_END exist, load those flats too (DOOM II)
-  if (ff_start >= 0 && ff_end >= 0 && ff_start < ff_end) {
-    for (int i = ff_start + 1; i < ff_end; i++) {
-      // Skip markers
-      if (is_marker(get_lump_name(i))) continue;
-
-      // Check if we're at capacity
-      if (flat_cache->num_textures >= MAX_TEXTURES) break;
-      
-      // Check if flat is already in cache
-      bool already_cached = false;
-      for (int j = 0; j < flat_cache->num_textures; j++) {
-        if (strncmp(flat_cache->textures[j].name, get_lump_name(i), 8) == 0) {
-          already_cached = true;
-          break;
-        }
-      }
-      if (already_cached) continue;
-      
-      // Load the flat texture
-      mapside_texture_t *tex = load_flat_texture(get_lump_name(i));
-      if (tex) {
-        flat_cache->textures[flat_cache->num_textures++] = *tex;
-      }
-    }
-  }
+  fill_flat_textures(flat_cache);
+  build_flat_array();
   
 //  // Process each sector to preload required flat textures
 //  for (int i = 0; i < map->num_sectors; i++) {
@@ -536,30 +1181,27 @@ void free_flat_texture_cache(texture_cache_t* cache) {
   if (!cache) return;
   
   for (int i = 0; i < cache->num_textures; i++) {
-    if (cache->textures[i].texture) {
+    if (is_resident(&cache->textures[i])) {
       glDeleteTextures(1, &cache->textures[i].texture);
     }
   }
   
-  cache->num_textures = 0;
+  clear_registry(cache);
 }
 
 // Get flat texture from cache by name
 mapside_texture_t const *
 get_flat_texture_from_cache(texture_cache_t* cache, const char* name) {
-  for (int i = 0; i < cache->num_textures; i++) {
-    if (strncmp(cache->textures[i].name, name, 8) == 0) {
-      return &cache->textures[i];
-    }
-  }
-  
-  return NULL;
+  int i = find_registry_index(cache, name);
+  return i >= 0 ? &cache->textures[i] : NULL;
 }
 
 // Convenience function to get flat texture
 mapside_texture_t const *
 get_flat_texture(const char* name) {
-  return get_flat_texture_from_cache(flat_cache, name);
+  mapside_texture_t const *tex = get_flat_texture_from_cache(flat_cache, name);
+  request_texture(tex);
+  return tex;
 }
 
 char const* get_texture_name(int i) {
@@ -571,21 +1213,27 @@ char const* get_flat_texture_name(int i) {
 }
 
 int get_texture_index(char const* name) {
-  for (int i = 0; i < texture_cache->num_textures; i++) {
-    if (!strncmp(name, texture_cache->textures[i].name, sizeof(texname_t))) {
-      return i;
-    }
-  }
-  return -1;
+  return find_registry_index(texture_cache, name);
 }
 
 int get_flat_texture_index(char const* name) {
-  for (int i = 0; i < flat_cache->num_textures; i++) {
-    if (!strncmp(name, flat_cache->textures[i].name, sizeof(texname_t))) {
-      return i;
-    }
-  }
-  return -1;
+  return find_registry_index(flat_cache, name);
+}
+
+// Like get_texture, but returns a handle that stays valid while the
+// registry grows. Resolve it with get_texture_by_handle.
+texhandle_t get_texture_handle(const char* name) {
+  int i = find_registry_index(texture_cache, name);
+  if (i < 0) return 0;
+  request_texture(&texture_cache->textures[i]);
+  return make_handle(texture_cache, i);
+}
+
+texhandle_t get_flat_texture_handle(const char* name) {
+  int i = find_registry_index(flat_cache, name);
+  if (i < 0) return 0;
+  request_texture(&flat_cache->textures[i]);
+  return make_handle(flat_cache, i);
 }
 
 // Load a sky texture and create an OpenGL texture
@@ -595,25 +1243,28 @@ find_and_load_sky_texture(texname_t const skypic)
   static mapside_texture_t tmp = {0};
   
   // Sky textures in Doom are stored as patches
-  int width, height;
-  uint8_t* patch_data = load_patch(cache_lump(skypic), &width, &height);
+  decodedpatch_t patch;
+  lumpview_t sky_lump = view_lump(skypic);
+  bool ok = decode_patch(&sky_lump, &patch);
+  release_lump_view(&sky_lump);
   
-  if (!patch_data) {
+  if (!ok) {
     printf("Error: Failed to load sky texture %s\n", skypic);
     return 0;
   }
   
-  // Now convert the color indices to RGBA using the palette
+  int width = patch.width, height = patch.height;
   uint8_t* sky_data = malloc(width * height * 4);
   if (!sky_data) {
-    free(patch_data);
+    free_decoded_patch(&patch);
     return 0;
   }
   
-  // Convert color indices to RGBA using palette
+  // Convert color indices to RGBA using palette, transposing the columns
   for (int i = 0; i < width * height; i++) {
-    if (patch_data[i * 4 + 3] == 255) { // Only copy opaque pixels
-      uint8_t index = patch_data[i * 4]; // Color index is stored in the red channel
+    int src = (i % width) * height + i / width;
+    if (patch.mask[src]) { // Only copy opaque pixels
+      uint8_t index = patch.pixels[src];
       sky_data[i * 4] = palette[index].r;     // R
       sky_data[i * 4 + 1] = palette[index].g; // G
       sky_data[i * 4 + 2] = palette[index].b; // B
@@ -629,6 +1280,7 @@ find_and_load_sky_texture(texname_t const skypic)
       sky_data[i * 4 + 3] = 0;
     }
   }
+  free_decoded_patch(&patch);
   
   // Create OpenGL texture
   GLuint tex;
@@ -647,7 +1299,6 @@ find_and_load_sky_texture(texname_t const skypic)
   
   glGenerateMipmap(GL_TEXTURE_2D);
   
-  free(patch_data);
   free(sky_data);
   
   tmp.texture = tex;
@@ -674,8 +1325,10 @@ int find_and_load_sky_textures(map_data_t* map)
     mapside_texture_t* sky = find_and_load_sky_texture(sky_names[i]);
     if (sky) {
       // Add to the texture cache
-      if (texture_cache->num_textures < MAX_TEXTURES) {
-        texture_cache->textures[texture_cache->num_textures++] = *sky;
+      int index = add_registry_entry(texture_cache, sky->name);
+      if (index >= 0) {
+        texture_cache->textures[index] = *sky;
+        texture_cache->slots[index] = (texslot_t){ .lump = -1, .state = TEX_RESIDENT, .page = -1 };
         sky_count++;
       }
     }
@@ -13,22 +13,40 @@
 #include <doom/info.h>
 #endif
 
-// Thing shader sources - we'll use view-aligned quads
+// Thing shader sources. Every thing is one instance; its center and
+// light, size and atlas rectangle are three texels of the instance buffer,
+// and the quad is turned towards the viewer here instead of on the CPU.
 const char* thing_vs_src = "#version 150 core\n"
 "in vec2 position; in vec2 texcoord;\n"
 "out vec2 tex;\n"
+"out float light;\n"
 "uniform mat4 mvp;\n"
-"uniform vec2 scale;\n"
+"uniform vec3 viewPos;\n"
+"uniform bool billboard;\n"
+"uniform int instanceBase;\n"
+"uniform samplerBuffer instances;\n"
 "void main() {\n"
-"  tex = texcoord;\n"
-"  gl_Position = mvp * vec4(position * scale, 0.0, 1.0);\n"
+"  int base = (instanceBase + gl_InstanceID) * 3;\n"
+"  vec4 center = texelFetch(instances, base);\n"
+"  vec2 size = texelFetch(instances, base + 1).xy;\n"
+"  vec4 uvrect = texelFetch(instances, base + 2);\n"
+"  tex = mix(uvrect.xy, uvrect.zw, texcoord);\n"
+"  light = center.w;\n"
+"  vec2 corner = position * size;\n"
+"  vec3 world = center.xyz + vec3(corner, 0.0);\n"
+"  if (billboard) {\n"
+"    vec2 toView = viewPos.xy - center.xy;\n"
+"    vec2 right = dot(toView, toView) > 0.0 ? normalize(vec2(toView.y, -toView.x)) : vec2(1.0, 0.0);\n"
+"    world = center.xyz + vec3(right * corner.x, corner.y);\n"
+"  }\n"
+"  gl_Position = mvp * vec4(world, 1.0);\n"
 "}";
 
 const char* thing_fs_src = "#version 150 core\n"
 "in vec2 tex;\n"
+"in float light;\n"
 "out vec4 outColor;\n"
 "uniform sampler2D tex0;\n"
-"uniform float light;\n"
 "void main() {\n"
 "  outColor = texture(tex0, tex);\n"
 "  outColor.rgb *= light;\n"
@@ -44,11 +62,28 @@ float thing_verts[] = {
   0.5f,    -0.5f,    1.0f, 1.0f, // bottom right
 };
 
+// Per-thing data as the vertex shader reads it
+typedef struct {
+  float center[4];  // x, y, z of the quad center, light
+  float size[4];    // width, height
+  float uv[4];      // atlas rectangle, u0 > u1 when mirrored
+} thing_instance_t;
+
+typedef struct {
+  GLuint page;
+  thing_instance_t instance;
+} thing_draw_t;
+
 // Thing rendering system
 typedef struct {
   GLuint program;
   GLuint vao;
   GLuint vbo;
+  GLuint instance_buf, instance_tex;
+  int mvp, view_pos, billboard, instance_base;
+  thing_draw_t *draws;
+  thing_instance_t *instances;
+  int capacity;
 } thing_renderer_t;
 
 typedef struct {
@@ -57,18 +92,142 @@ typedef struct {
   bool flip[8];
 } spriteframe_t;
 
+#define SPRITEFRAMES 24
+
 typedef struct  {
   int num_frames;
-  spriteframe_t spriteframes[24];
+  spriteframe_t spriteframes[SPRITEFRAMES];
 } spritedef_t;
 
+// What drawing a thing type needs, resolved once from mobjinfo and states
+typedef struct {
+  mobjinfo_t const *info;
+  state_t const *state;        // spawn state
+  spritedef_t const *sprite;
+  spriteframe_t const *frame;  // spawn frame, NULL when the sprite has none
+  int radius, height;          // bounding size in map units
+} thingdesc_t;
+
 static thing_renderer_t g_thing_renderer = {0};
 static spritedef_t sprites[NUMSPRITES];
+static thingdesc_t thingdescs[NUMMOBJTYPES];
+static int16_t *thingdesc_by_type;  // doomednum to thingdescs index, -1 if none
+static int max_doomednum = -1;
 
 // Forward declarations
 GLuint compile_thing_shader(GLenum type, const char* src);
 bool point_in_frustum(vec3 point, vec4 const planes[6]);
 
+#define SPRNAME_BUCKETS 1024
+
+// Records one rotation of a frame. Rotation 0 is used for every angle;
+// rotations 1-8 go to the angle they face, and once a frame has any of
+// them a rotation 0 for it is ignored, as the old lookup did.
+static void add_sprite_rotation(spriteframe_t *sf, sprite_t *sprite, int rotation, bool flip) {
+  if (rotation == 0) {
+    if (!sf->rotate && !sf->angle[0]) sf->angle[0] = sprite;
+    return;
+  }
+  if (!sf->rotate) {
+    memset(sf, 0, sizeof(spriteframe_t));
+    sf->rotate = true;
+  }
+  if (!sf->angle[rotation - 1]) {
+    sf->angle[rotation - 1] = sprite;
+    sf->flip[rotation - 1] = flip;
+  }
+}
+
+static uint32_t sprname_key(const char *name) {
+  return (uint32_t)name[0] | (uint32_t)name[1] << 8 | (uint32_t)name[2] << 16 | (uint32_t)name[3] << 24;
+}
+
+// Fills the frame and rotation tables in one pass over the registered
+// sprites, parsing PREFIX+frame+rotation names and the optional second
+// frame+rotation pair that is drawn mirrored (e.g. TROOA2A8).
+static void build_spritedefs(void) {
+  static int16_t buckets[SPRNAME_BUCKETS];
+  memset(sprites, 0, sizeof(sprites));
+  memset(buckets, 0xff, sizeof(buckets));
+  for (int i = 0; i < NUMSPRITES; i++) {
+    uint32_t h = sprname_key(sprnames[i]) * 2654435761u % SPRNAME_BUCKETS;
+    while (buckets[h] >= 0) h = (h + 1) % SPRNAME_BUCKETS;
+    buckets[h] = i;
+  }
+  
+  for (int i = 0; i < get_num_sprites(); i++) {
+    sprite_t *sprite = get_sprite(i);
+    const char *name = sprite->name;
+    if (strnlen(name, 8) < 6) continue;
+    uint32_t key = sprname_key(name);
+    uint32_t h = key * 2654435761u % SPRNAME_BUCKETS;
+    while (buckets[h] >= 0 && sprname_key(sprnames[buckets[h]]) != key) h = (h + 1) % SPRNAME_BUCKETS;
+    if (buckets[h] < 0) continue;
+    spritedef_t *sdef = &sprites[buckets[h]];
+    
+    for (int pair = 4; pair <= 6 && name[pair]; pair += 2) {
+      int frame = name[pair] - 'A';
+      int rotation = name[pair + 1] - '0';
+      if (frame < 0 || frame >= SPRITEFRAMES || rotation < 0 || rotation > 8) break;
+      add_sprite_rotation(&sdef->spriteframes[frame], sprite, rotation, pair == 6);
+    }
+  }
+  
+  // A sprite's frames run from A up to the first one that is missing
+  for (int i = 0; i < NUMSPRITES; i++) {
+    while (sprites[i].num_frames < SPRITEFRAMES &&
+           sprites[i].spriteframes[sprites[i].num_frames].angle[0]) {
+      sprites[i].num_frames++;
+    }
+  }
+}
+
+// Resolves every mobjinfo entry with a doomednum to its spawn frame and
+// indexes it by doomednum. The first entry for a doomednum wins, as the
+// old scan over mobjinfo did.
+static void build_thingdescs(void) {
+  free(thingdesc_by_type);
+  thingdesc_by_type = NULL;
+  max_doomednum = -1;
+  for (int i = 0; i < NUMMOBJTYPES; i++) {
+    if (mobjinfo[i].doomednum <= UINT16_MAX) {
+      max_doomednum = MAX(max_doomednum, mobjinfo[i].doomednum);
+    }
+  }
+  if (max_doomednum < 0) return;
+  if (!(thingdesc_by_type = malloc((max_doomednum + 1) * sizeof(int16_t)))) {
+    printf("Error: Could not allocate thing type table\n");
+    max_doomednum = -1;
+    return;
+  }
+  memset(thingdesc_by_type, 0xff, (max_doomednum + 1) * sizeof(int16_t));
+  
+  for (int i = 0; i < NUMMOBJTYPES; i++) {
+    thingdesc_t *desc = &thingdescs[i];
+    desc->info = &mobjinfo[i];
+    desc->state = &states[mobjinfo[i].spawnstate];
+    desc->sprite = &sprites[desc->state->sprite];
+    desc->radius = mobjinfo[i].radius >> 16;  // mobjinfo sizes are 16.16 fixed point
+    desc->height = mobjinfo[i].height >> 16;
+    uint16_t frame = desc->state->frame&0x7fff;
+    if (desc->sprite->num_frames <= frame) {
+      frame = 0;
+    }
+    desc->frame = desc->sprite->num_frames ? &desc->sprite->spriteframes[frame] : NULL;
+    
+    int type = mobjinfo[i].doomednum;
+    if (type >= 0 && type <= max_doomednum && thingdesc_by_type[type] < 0) {
+      thingdesc_by_type[type] = i;
+    }
+  }
+}
+
+// Looks up the descriptor for a map thing type, NULL for unknown types
+static thingdesc_t const *get_thing_desc(uint16_t thing_type) {
+  if (thing_type > max_doomednum || thingdesc_by_type[thing_type] < 0) return NULL;
+  return &thingdescs[thingdesc_by_type[thing_type]];
+}
+
 // Initialize the thing rendering system
 bool init_things(void) {
   thing_renderer_t* renderer = &g_thing_renderer;
@@ -111,38 +270,22 @@ bool init_things(void) {
   glDeleteShader(vertex_shader);
   glDeleteShader(fragment_shader);
   
-  memset(sprites, 0, sizeof(sprites));
+  glGenBuffers(1, &renderer->instance_buf);
+  glGenTextures(1, &renderer->instance_tex);
+  glBindTexture(GL_TEXTURE_BUFFER, renderer->instance_tex);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, renderer->instance_buf);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
   
-  extern sprite_t* find_sprite6(const char* name);
+  glUseProgram(renderer->program);
+  glUniform1i(glGetUniformLocation(renderer->program, "tex0"), 0);
+  glUniform1i(glGetUniformLocation(renderer->program, "instances"), 1);
+  renderer->mvp = glGetUniformLocation(renderer->program, "mvp");
+  renderer->view_pos = glGetUniformLocation(renderer->program, "viewPos");
+  renderer->billboard = glGetUniformLocation(renderer->program, "billboard");
+  renderer->instance_base = glGetUniformLocation(renderer->program, "instanceBase");
   
-  for (int i = 0; i < NUMSPRITES; i++) {
-    // Determine angle frame (A-H based on 45-degree increments)
-    // Doom uses 8 angle sprites, with 0 being east, 45 northeast, etc.
-    for (int j = 0; j < 16; j++) { //((angle + 22) % 360) / 45;
-      char frame_char = 'A' + j;
-      char sprite_name[8]={0};
-      const char *prefix = sprnames[i];
-      // Format sprite name (typically PREFIX + FRAME + ANGLE, e.g., "TROOA1")
-      snprintf(sprite_name, sizeof(sprite_name), "%s%c1", prefix, frame_char);
-      
-      if (find_sprite6(sprite_name)) {
-        for (int k = 0; k < 8; k++) {
-          snprintf(sprite_name, sizeof(sprite_name), "%s%c%d", prefix, frame_char, k+1);
-          sprites[i].spriteframes[j].angle[k] = find_sprite6(sprite_name);
-        }
-        sprites[i].spriteframes[j].rotate = true;
-      } else {
-        snprintf(sprite_name, sizeof(sprite_name), "%s%c0", prefix, frame_char);
-        sprites[i].spriteframes[j].angle[0] = find_sprite6(sprite_name);
-      }
-      
-      if (!sprites[i].spriteframes[j].angle[0]) {
-        break;
-      }
-      
-      sprites[i].num_frames++;
-    }
-  }
+  build_spritedefs();
+  build_thingdescs();
   
   return true;
 }
@@ -168,30 +311,30 @@ GLuint compile_thing_shader(GLenum type, const char* src) {
   return shader;
 }
 
-// Helper function to get sprite name based on thing type and angle
-sprite_t *get_thing_sprite_name(uint16_t thing_type, uint16_t angle) {
+// Helper function to get sprite name based on thing type and angle. flip
+// is set when the sprite has to be drawn mirrored for that angle.
+static sprite_t *find_thing_sprite(uint16_t thing_type, uint16_t angle, bool *flip) {
   static sprite_t empty = {
     .width = 8,
     .height = 8,
     .texture = 1,
+    .uv = { 0, 0, 1, 1 },
   };
-  for (int i = 0; i < NUMMOBJTYPES; i++) {
-    if (mobjinfo[i].doomednum == thing_type) {
-      state_t const *s = &states[mobjinfo[i].spawnstate];
-      spritedef_t const *sdef = &sprites[s->sprite];
-      uint16_t frame = s->frame&0x7fff;
-      if (sdef->num_frames == 0) {
-        return &empty;
-      }
-      if (sdef->num_frames <= frame) {
-        frame = 0;
-      }
-      spriteframe_t const *sf = &sdef->spriteframes[frame];
-      sprite_t *sprite = sf->rotate ? sf->angle[angle%8] : sf->angle[0];
-      return sprite ? sprite : &empty;
-    }
+  *flip = false;
+  thingdesc_t const *desc = get_thing_desc(thing_type);
+  if (!desc || !desc->frame) {
+    return &empty;
   }
-  return &empty;
+  spriteframe_t const *sf = desc->frame;
+  sprite_t *sprite = sf->rotate ? sf->angle[angle%8] : sf->angle[0];
+  *flip = sf->rotate && sf->flip[angle%8];
+  make_sprite_resident(sprite);
+  return sprite ? sprite : &empty;
+}
+
+sprite_t *get_thing_sprite_name(uint16_t thing_type, uint16_t angle) {
+  bool flip;
+  return find_thing_sprite(thing_type, angle, &flip);
 }
 
 // Returns a value from 1 to 8 for sprite angle selection
@@ -212,26 +355,35 @@ int GetSpriteRotationIndex(int thingAngleDeg, int playerAngleDeg) {
   return spriteIndex;
 }
 
+static bool reserve_thing_draws(thing_renderer_t *renderer, int count) {
+  if (count <= renderer->capacity) return true;
+  int capacity = MAX(count, renderer->capacity * 2);
+  thing_draw_t *draws = realloc(renderer->draws, capacity * sizeof(thing_draw_t));
+  if (draws) renderer->draws = draws;
+  thing_instance_t *instances = realloc(renderer->instances, capacity * sizeof(thing_instance_t));
+  if (instances) renderer->instances = instances;
+  if (!draws || !instances) {
+    printf("Error: Could not allocate %d thing instances\n", capacity);
+    return false;
+  }
+  renderer->capacity = capacity;
+  return true;
+}
+
+static int compare_thing_draws(const void *a, const void *b) {
+  GLuint pa = ((thing_draw_t const *)a)->page;
+  GLuint pb = ((thing_draw_t const *)b)->page;
+  return (pa > pb) - (pa < pb);
+}
+
 // Draw things in the map
 void draw_things(map_data_t const *map, viewdef_t const *viewdef, bool rotate) {
   thing_renderer_t* renderer = &g_thing_renderer;
   
-  glDisable(GL_CULL_FACE);
+  if (!reserve_thing_draws(renderer, map->num_things)) return;
   
-  // Enable blending for transparency
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-  
-  // Use thing shader program
-  glUseProgram(renderer->program);
-  
-  // Bind VAO
-  glBindVertexArray(renderer->vao);
-  
-  // Set uniforms that don't change per-thing
-  glUniformMatrix4fv(glGetUniformLocation(renderer->program, "mvp"), 1, GL_FALSE, viewdef->mvp[0]);
-
-  // Loop through all things in the map
+  // Collect one instance per visible thing
+  int count = 0;
   for (int i = 0; i < map->num_things; i++) {
     mapthing_t const *thing = &map->things[i];
     
@@ -253,62 +405,59 @@ void draw_things(map_data_t const *map, viewdef_t const *viewdef, bool rotate) {
 
     if (thing->height < map->num_sectors) {
       mapsector_t const *sector = &map->sectors[thing->height];
-      
-      // Calculate distance to player (for potential culling)
-      //    float dist_to_player = dist_sq(player->x, player->y, thing->x, thing->y);
-      
-      // Simple culling - skip if too far away
-      //    if (dist_to_player > 100000.0f) { // Adjust threshold as needed
-      //      continue;
-      //    }
-      
       // Calculate thing height (based on floor height)
       z_pos = sector->floorheight;
       light = sector->lightlevel / 255.0f;
     }
     
-    // Get appropriate sprite name based on thing type and angle
-    int angle = GetSpriteRotationIndex(thing->angle, viewdef->player.angle);
-    sprite_t* sprite = get_thing_sprite_name(thing->type, rotate?angle:0);
-    // Set up matrices for this thing
-    mat4 model, mv;
-    glm_mat4_identity(model);
-    
-    // Translate to thing position
-    glm_translate(model, (vec3){thing->x, thing->y, z_pos+sprite->offsety-sprite->height/2});
-    
-    // Rotate to face the defined angle
-//    float angle_rad = glm_rad(thing->angle);
-//    glm_rotate_z(model, angle_rad, model);
-    
-    float dx = viewdef->viewpos[0] - thing->x;
-    float dy = viewdef->viewpos[1] - thing->y;
-
-    if (rotate) {
-      glm_rotate_z(model, atan2f(dy, dx)-M_PI_2, model);
-      glm_rotate_x(model, M_PI_2, model);
-    }
-    
     if (!point_in_frustum((vec3){thing->x, thing->y, z_pos}, viewdef->frustum))
       continue;
 
-    glm_mat4_mul(viewdef->mvp, model, mv);
-
-    glUniformMatrix4fv(glGetUniformLocation(renderer->program, "mvp"), 1, GL_FALSE, (const float*)mv);
-    
-    // Set scale uniform
-    glUniform2f(glGetUniformLocation(renderer->program, "scale"), sprite->width, sprite->height);
-    
-    // Set light level
-    glUniform1f(glGetUniformLocation(renderer->program, "light"), rotate?light*1.5:1.25);
-    
-    // Bind texture
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, sprite->texture);
-    glUniform1i(glGetUniformLocation(renderer->program, "tex0"), 0);
+    // Get appropriate sprite name based on thing type and angle
+    int angle = GetSpriteRotationIndex(thing->angle, viewdef->player.angle);
+    bool flip;
+    sprite_t* sprite = find_thing_sprite(thing->type, rotate?angle:0, &flip);
     
-    // Draw the thing
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    thing_draw_t *draw = &renderer->draws[count++];
+    draw->page = sprite->texture;
+    draw->instance = (thing_instance_t) {
+      .center = { thing->x, thing->y, z_pos+sprite->offsety-sprite->height/2, rotate?light*1.5:1.25 },
+      .size = { sprite->width, sprite->height },
+      .uv = { sprite->uv[flip?2:0], sprite->uv[1], sprite->uv[flip?0:2], sprite->uv[3] },
+    };
+  }
+  if (!count) return;
+  
+  // Group by atlas page so each page is one instanced draw
+  qsort(renderer->draws, count, sizeof(thing_draw_t), compare_thing_draws);
+  for (int i = 0; i < count; i++) {
+    renderer->instances[i] = renderer->draws[i].instance;
+  }
+  glBindBuffer(GL_TEXTURE_BUFFER, renderer->instance_buf);
+  glBufferData(GL_TEXTURE_BUFFER, count * sizeof(thing_instance_t), renderer->instances, GL_STREAM_DRAW);
+  
+  glDisable(GL_CULL_FACE);
+  
+  // Enable blending for transparency
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  
+  glUseProgram(renderer->program);
+  glBindVertexArray(renderer->vao);
+  glUniformMatrix4fv(renderer->mvp, 1, GL_FALSE, viewdef->mvp[0]);
+  glUniform3fv(renderer->view_pos, 1, viewdef->viewpos);
+  glUniform1i(renderer->billboard, rotate);
+  
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_BUFFER, renderer->instance_tex);
+  glActiveTexture(GL_TEXTURE0);
+  
+  for (int first = 0, last; first < count; first = last) {
+    GLuint page = renderer->draws[first].page;
+    for (last = first + 1; last < count && renderer->draws[last].page == page; last++);
+    glBindTexture(GL_TEXTURE_2D, page);
+    glUniform1i(renderer->instance_base, first);
+    glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, last - first);
   }
     
   // Reset state
@@ -323,6 +472,16 @@ void cleanup_things(void) {
   glDeleteProgram(renderer->program);
   glDeleteVertexArrays(1, &renderer->vao);
   glDeleteBuffers(1, &renderer->vbo);
+  glDeleteBuffers(1, &renderer->instance_buf);
+  glDeleteTextures(1, &renderer->instance_tex);
+  free(renderer->draws);
+  free(renderer->instances);
+  renderer->draws = NULL;
+  renderer->instances = NULL;
+  renderer->capacity = 0;
+  free(thingdesc_by_type);
+  thingdesc_by_type = NULL;
+  max_doomednum = -1;
 }
 
 void assign_thing_sector(map_data_t const *map, mapthing_t *thing) {
@@ -0,0 +1,84 @@
+#include <mapview/map.h>
+
+// Sector adjacency for traversal. Every sector gets the linedef sides
+// facing into it and the portals leading out of it, stored as compressed
+// rows so visiting a sector costs its own lines instead of the whole map.
+
+// Turns per-sector counts in start[i + 1] into row offsets
+static void prefix_sum(uint32_t *start, uint32_t num_sectors) {
+  for (uint32_t i = 0; i < num_sectors; i++) {
+    start[i + 1] += start[i];
+  }
+}
+
+// After filling, start[i] has advanced to the end of row i; move the
+// offsets back so start[i] is the beginning of the row again
+static void restore_offsets(uint32_t *start, uint32_t num_sectors) {
+  memmove(start + 1, start, num_sectors * sizeof(uint32_t));
+  start[0] = 0;
+}
+
+static int side_sector(map_data_t const *map, uint16_t sidenum) {
+  if (sidenum >= map->num_sidedefs) return -1;
+  uint16_t sector = map->sidedefs[sidenum].sector;
+  return sector < map->num_sectors ? sector : -1;
+}
+
+// Rebuilds the rows from the linedefs and sidedefs. Rows keep linedef
+// order, which is the order the old full-map scans visited them in.
+void build_sector_topology(map_data_t *map) {
+  uint32_t num_sectors = map->num_sectors;
+  uint32_t *side_start = realloc(map->topology.side_start, (num_sectors + 1) * sizeof(uint32_t));
+  if (side_start) map->topology.side_start = side_start;
+  uint32_t *portal_start = realloc(map->topology.portal_start, (num_sectors + 1) * sizeof(uint32_t));
+  if (portal_start) map->topology.portal_start = portal_start;
+  if (!side_start || !portal_start) goto fail;
+  memset(side_start, 0, (num_sectors + 1) * sizeof(uint32_t));
+  memset(portal_start, 0, (num_sectors + 1) * sizeof(uint32_t));
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < map->num_linedefs; i++) {
+      maplinedef_t const *linedef = &map->linedefs[i];
+      // walls are drawn through the front side, so a line without one has none
+      if (side_sector(map, linedef->sidenum[0]) < 0) continue;
+      for (int j = 0; j < 2; j++) {
+        int sector = side_sector(map, linedef->sidenum[j]);
+        if (sector < 0) continue;
+        int neighbor = side_sector(map, linedef->sidenum[!j]);
+        if (pass == 0) {
+          side_start[sector + 1]++;
+          if (neighbor >= 0) portal_start[sector + 1]++;
+        } else {
+          map->topology.sides[side_start[sector]++] = (mapsideref_t){ i, j };
+          if (neighbor >= 0) {
+            map->topology.portals[portal_start[sector]++] = (mapportal_t){ i, neighbor };
+          }
+        }
+      }
+    }
+    if (pass == 0) {
+      prefix_sum(side_start, num_sectors);
+      prefix_sum(portal_start, num_sectors);
+      mapsideref_t *sides = realloc(map->topology.sides, (side_start[num_sectors] + 1) * sizeof(mapsideref_t));
+      if (sides) map->topology.sides = sides;
+      mapportal_t *portals = realloc(map->topology.portals, (portal_start[num_sectors] + 1) * sizeof(mapportal_t));
+      if (portals) map->topology.portals = portals;
+      if (!sides || !portals) goto fail;
+    }
+  }
+  restore_offsets(side_start, num_sectors);
+  restore_offsets(portal_start, num_sectors);
+  return;
+
+fail:
+  printf("Error: Could not allocate sector topology\n");
+  free_sector_topology(map);
+}
+
+void free_sector_topology(map_data_t *map) {
+  free(map->topology.side_start);
+  free(map->topology.sides);
+  free(map->topology.portal_start);
+  free(map->topology.portals);
+  memset(&map->topology, 0, sizeof(map->topology));
+}
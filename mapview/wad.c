@@ -1,88 +1,550 @@
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
 #include <mapview/map.h>
 
+// The WAD is mapped read-only where the platform allows it, so lump views
+// point straight into the page cache. Build with -DWAD_NO_MMAP to force the
+// stdio path used on platforms without mmap.
+#if !defined(WAD_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define WAD_USE_MMAP
+#include <sys/mman.h>
+#endif
+
+// Hash index over the lump directory. Names are packed into a 64-bit key,
+// each bucket holds the newest lump with that name and next[] chains back
+// to older lumps of the same name, so "last lump wins" lookups are O(1)
+// and namespace-scoped lookups only walk same-named lumps.
+typedef struct {
+  uint64_t *keys;
+  int32_t *next;
+  uint8_t *ns;
+  int32_t *buckets;
+  uint32_t mask;
+} lumpindex_t;
+
+static uint64_t lump_key(const char *name) {
+  uint64_t key = 0;
+  for (int i = 0; i < 8 && name[i]; i++) {
+    key |= (uint64_t)(uint8_t)toupper((uint8_t)name[i]) << (i * 8);
+  }
+  return key;
+}
+
+static uint32_t lump_hash(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return (uint32_t)key;
+}
+
+#define MAX_MARKER_DEPTH 8  // deeper blocks share the namespace of the 8th
+
+static lumpns_t marker_namespace(const char *name) {
+  switch (toupper((uint8_t)name[0])) {
+    case 'S': return NS_SPRITES;
+    case 'F': return NS_FLATS;
+    case 'P': return NS_PATCHES;
+    default: return NS_GLOBAL;
+  }
+}
+
+static bool is_marker_suffix(const char *name, const char *suffix) {
+  char const *underscore = memchr(name, '_', 8);
+  if (!underscore || underscore - name > 2) return false;
+  return strncmp(underscore, suffix, 8 - (underscore - name)) == 0;
+}
+
+static void free_lump_index(lumpindex_t *index) {
+  free(index->keys);
+  free(index->next);
+  free(index->ns);
+  free(index->buckets);
+  memset(index, 0, sizeof(lumpindex_t));
+}
+
+static bool build_lump_index(lumpindex_t *index, filelump_t const *dir, int num_lumps) {
+  uint32_t num_buckets = 16;
+  while (num_buckets < (uint32_t)num_lumps * 2) num_buckets <<= 1;
+  
+  index->keys = malloc(sizeof(uint64_t) * (num_lumps + 1));
+  index->next = malloc(sizeof(int32_t) * (num_lumps + 1));
+  index->ns = malloc(sizeof(uint8_t) * (num_lumps + 1));
+  index->buckets = malloc(sizeof(int32_t) * num_buckets);
+  index->mask = num_buckets - 1;
+  if (!index->keys || !index->next || !index->ns || !index->buckets) {
+    free_lump_index(index);
+    return false;
+  }
+  memset(index->buckets, 0xff, sizeof(int32_t) * num_buckets);
+  
+  // Blocks nest: F1_START..F1_END sits inside F_START..F_END, so an end
+  // marker returns to the block that was open before its start marker
+  lumpns_t open[MAX_MARKER_DEPTH];
+  int depth = 0;
+  for (int i = 0; i < num_lumps; i++) {
+    char const *name = dir[i].name;
+    uint64_t key = lump_key(name);
+    index->keys[i] = key;
+    index->next[i] = -1;
+    
+    // Markers themselves stay global so they can still be found by name
+    if (is_marker_suffix(name, "_START")) {
+      if (depth < MAX_MARKER_DEPTH) open[depth] = marker_namespace(name);
+      depth++;
+      index->ns[i] = NS_GLOBAL;
+    } else if (is_marker_suffix(name, "_END")) {
+      if (depth > 0) depth--;
+      index->ns[i] = NS_GLOBAL;
+    } else if (depth > 0) {
+      index->ns[i] = open[(depth < MAX_MARKER_DEPTH ? depth : MAX_MARKER_DEPTH) - 1];
+    } else {
+      index->ns[i] = NS_GLOBAL;
+    }
+    
+    // Later lumps shadow earlier ones with the same name
+    uint32_t slot = lump_hash(key) & index->mask;
+    while (index->buckets[slot] >= 0 && index->keys[index->buckets[slot]] != key) {
+      slot = (slot + 1) & index->mask;
+    }
+    index->next[i] = index->buckets[slot];
+    index->buckets[slot] = i;
+  }
+  return true;
+}
+
+// Returns the newest lump with the given name, restricted to one namespace
+// unless ns is negative
+static int lookup_lump(lumpindex_t const *index, const char *name, int ns) {
+  if (!index->buckets) return -1;
+  uint64_t key = lump_key(name);
+  uint32_t slot = lump_hash(key) & index->mask;
+  while (index->buckets[slot] >= 0) {
+    int i = index->buckets[slot];
+    if (index->keys[i] == key) {
+      for (; i >= 0; i = index->next[i]) {
+        if (ns < 0 || index->ns[i] == ns) return i;
+      }
+      return -1;
+    }
+    slot = (slot + 1) & index->mask;
+  }
+  return -1;
+}
+
+// One slot per lump. Lumps with a zero refcount that are not pinned sit on
+// an LRU list and get purged oldest-first once the cache exceeds its budget.
+typedef struct {
+  void *data;
+  int32_t refcount;
+  int32_t lru_prev, lru_next;
+  bool pinned;
+} lumpcache_entry_t;
+
+// One open file of the resource stack. Its lumps occupy the range
+// [first_lump, first_lump + num_lumps) of the merged directory.
+typedef struct {
+  FILE *file;
+  uint8_t const *base;  // mapped file contents, NULL in stdio mode
+  size_t file_size;
+  int first_lump;
+  int num_lumps;
+} wadfile_t;
+
+// The IWAD is always file 0 and PWADs are stacked on top of it. The
+// merged directory lists lumps oldest file first, so the hash index
+// resolves every name to the newest file that has it.
 struct {
   filelump_t* directory;
+  uint8_t *lump_file;  // index into files[] for each lump
   int num_lumps;
-  void **cache;
-  FILE *file;
+  lumpcache_entry_t *cache;
+  int32_t lru_head, lru_tail;  // most / least recently released
+  lumpcache_stats_t stats;
+  wadfile_t files[MAX_WAD_FILES];
+  int num_files;
+  lumpindex_t index;
 } wad = {0};
 
-bool init_wad(const char *filename) {
-  wad.file = fopen(filename, "rb");
-  if (!wad.file) {
+static bool read_file_range(wadfile_t const *wf, void *dest, size_t offset, size_t size) {
+  if (offset > wf->file_size || size > wf->file_size - offset) return false;
+  if (wf->base) {
+    memcpy(dest, wf->base + offset, size);
+    return true;
+  }
+  if (fseek(wf->file, (long)offset, SEEK_SET) != 0) return false;
+  return fread(dest, 1, size, wf->file) == size;
+}
+
+static void close_wad_file(wadfile_t *wf) {
+#ifdef WAD_USE_MMAP
+  if (wf->base) munmap((void *)wf->base, wf->file_size);
+#endif
+  if (wf->file) fclose(wf->file);
+  memset(wf, 0, sizeof(wadfile_t));
+}
+
+// Whether the directory the header describes fits in the file and in
+// the merged directory of num_loaded lumps
+bool is_wad_directory_valid(wadheader_t const *header, size_t file_size, int num_loaded) {
+  if (header->numlumps > (uint32_t)(INT_MAX - num_loaded)) return false;
+  uint64_t end = (uint64_t)header->infotableofs + (uint64_t)header->numlumps * sizeof(filelump_t);
+  return end <= file_size;
+}
+
+// Opens one file and appends its directory to the merged one. A file
+// that fails to open leaves the loaded stack as it was.
+static bool open_wad_file(const char *filename) {
+  if (wad.num_files == MAX_WAD_FILES) {
+    printf("Error: Too many WAD files, %s not loaded\n", filename);
+    return false;
+  }
+  
+  wadfile_t *wf = &wad.files[wad.num_files];
+  wf->file = fopen(filename, "rb");
+  if (!wf->file) {
     printf("Error: Could not open file %s\n", filename);
     return false;
   }
   
+  fseek(wf->file, 0, SEEK_END);
+  wf->file_size = (size_t)ftell(wf->file);
+  fseek(wf->file, 0, SEEK_SET);
+
+#ifdef WAD_USE_MMAP
+  void *mapped = mmap(NULL, wf->file_size, PROT_READ, MAP_PRIVATE, fileno(wf->file), 0);
+  if (mapped != MAP_FAILED) {
+    wf->base = mapped;
+  } else {
+    printf("Warning: mmap failed for %s, falling back to buffered reads\n", filename);
+  }
+#endif
+  
   // Read WAD header
   wadheader_t header;
-  fread(&header, sizeof(wadheader_t), 1, wad.file);
+  if (!read_file_range(wf, &header, 0, sizeof(wadheader_t))) {
+    printf("Error: %s is too small to be a WAD\n", filename);
+    close_wad_file(wf);
+    return false;
+  }
   
-  printf("WAD Type: %.4s\n", header.identification);
+  printf("WAD Type: %.4s (%s)\n", header.identification, filename);
   printf("Lumps: %d\n", header.numlumps);
   
+  // Check the directory against the file before touching the loaded ones
+  if (!is_wad_directory_valid(&header, wf->file_size, wad.num_lumps)) {
+    printf("Error: Lump directory of %s does not fit in the file\n", filename);
+    close_wad_file(wf);
+    return false;
+  }
+  
+  // Grow the merged directory and cache
+  int total = wad.num_lumps + header.numlumps;
+  filelump_t *directory = realloc(wad.directory, sizeof(filelump_t) * total);
+  if (directory) wad.directory = directory;
+  uint8_t *lump_file = realloc(wad.lump_file, sizeof(uint8_t) * total);
+  if (lump_file) wad.lump_file = lump_file;
+  lumpcache_entry_t *cache = realloc(wad.cache, sizeof(lumpcache_entry_t) * total);
+  if (cache) wad.cache = cache;
+  
   // Read directory
-  wad.directory = malloc(sizeof(filelump_t) * header.numlumps);
-  wad.num_lumps = header.numlumps;
-  wad.cache = malloc(sizeof(void*) * header.numlumps);
-  fseek(wad.file, header.infotableofs, SEEK_SET);
-  fread(wad.directory, sizeof(filelump_t), header.numlumps, wad.file);
+  filelump_t *dir = directory ? directory + wad.num_lumps : NULL;
+  if (!directory || !lump_file || !cache ||
+      !read_file_range(wf, dir, header.infotableofs, sizeof(filelump_t) * header.numlumps)) {
+    printf("Error: Could not read lump directory of %s\n", filename);
+    close_wad_file(wf);
+    return false;
+  }
   
+  // Clamp lumps that claim to extend past the end of the file, so every
+  // view handed out later stays inside the mapping
+  for (int i = 0; i < (int)header.numlumps; i++) {
+    filelump_t *lump = &dir[i];
+    lumpcache_entry_t *entry = &wad.cache[wad.num_lumps + i];
+    memset(entry, 0, sizeof(lumpcache_entry_t));
+    entry->lru_prev = entry->lru_next = -1;
+    wad.lump_file[wad.num_lumps + i] = wad.num_files;
+    if (lump->filepos > wf->file_size || lump->size > wf->file_size - lump->filepos) {
+      printf("Warning: Lump %.8s extends past end of file, ignoring\n", lump->name);
+      lump->filepos = 0;
+      lump->size = 0;
+    }
+  }
+  
+  wf->first_lump = wad.num_lumps;
+  wf->num_lumps = header.numlumps;
+  wad.num_lumps = total;
+  wad.num_files++;
+  return true;
+}
+
+static bool rebuild_lump_index(void) {
+  free_lump_index(&wad.index);
+  if (!build_lump_index(&wad.index, wad.directory, wad.num_lumps)) {
+    printf("Error: Could not index lump directory\n");
+    return false;
+  }
   return true;
 }
 
+static void drop_cached_lump(int i);
+
+// Opens the IWAD followed by any number of PWADs and indexes the merged
+// directory once
+bool init_wad_stack(const char **filenames, int count) {
+  shutdown_wad();
+  wad.lru_head = wad.lru_tail = -1;
+  wad.stats.budget = LUMP_CACHE_BUDGET;
+  for (int i = 0; i < count; i++) {
+    if (!open_wad_file(filenames[i])) {
+      shutdown_wad();
+      return false;
+    }
+  }
+  if (!rebuild_lump_index()) {
+    shutdown_wad();
+    return false;
+  }
+  return wad.num_files > 0;
+}
+
+bool init_wad(const char *filename) {
+  return init_wad_stack(&filename, 1);
+}
+
 void shutdown_wad(void) {
+  for (int i = 0; i < wad.num_lumps; i++) {
+    drop_cached_lump(i);
+  }
+  while (wad.num_files > 0) {
+    close_wad_file(&wad.files[--wad.num_files]);
+  }
+  free_lump_index(&wad.index);
   free(wad.directory);
+  free(wad.lump_file);
   free(wad.cache);
-  fclose(wad.file);
+  memset(&wad, 0, sizeof(wad));
 }
 
-// Function to find a lump index by name
+// Function to find a lump by name, later lumps override earlier ones
 filelump_t *find_lump(const char* name) {
-  for (int i = 0; i < wad.num_lumps; i++) {
-    if (strncmp(wad.directory[i].name, name, sizeof(lumpname_t)) == 0) {
-      return &wad.directory[i];
-    }
-  }
-  return NULL; // Not found
+  int i = lookup_lump(&wad.index, name, -1);
+  return i >= 0 ? &wad.directory[i] : NULL;
 }
 
 int find_lump_num(const char* name) {
-  for (int i = 0; i < wad.num_lumps; i++) {
-    if (strncmp(wad.directory[i].name, name, sizeof(lumpname_t)) == 0) {
+  return lookup_lump(&wad.index, name, -1);
+}
+
+// Same as find_lump_num, but only considers lumps between the markers of
+// the given namespace
+int find_lump_num_ns(const char* name, lumpns_t ns) {
+  return lookup_lump(&wad.index, name, ns);
+}
+
+char const *get_lump_name(int i) {
+  return wad.directory[i].name;
+}
+
+uint32_t get_lump_size(int i) {
+  return (i >= 0 && i < wad.num_lumps) ? wad.directory[i].size : 0;
+}
+
+// Walks a namespace across all files of the stack: returns the next lump
+// after i that lies in ns and is not overridden by a newer lump of the
+// same name, or -1. Start with i = -1.
+int next_lump_in_ns(int i, lumpns_t ns) {
+  for (i++; i < wad.num_lumps; i++) {
+    if (wad.index.ns[i] == ns && lookup_lump(&wad.index, wad.directory[i].name, ns) == i) {
       return i;
     }
   }
-  return -1; // Not found
+  return -1;
 }
 
-char const *get_lump_name(int i) {
-  return wad.directory[i].name;
+static void lru_unlink(int i) {
+  lumpcache_entry_t *entry = &wad.cache[i];
+  if (entry->lru_prev >= 0) wad.cache[entry->lru_prev].lru_next = entry->lru_next;
+  else wad.lru_head = entry->lru_next;
+  if (entry->lru_next >= 0) wad.cache[entry->lru_next].lru_prev = entry->lru_prev;
+  else wad.lru_tail = entry->lru_prev;
+  entry->lru_prev = entry->lru_next = -1;
+  wad.stats.bytes_purgeable -= wad.directory[i].size;
 }
 
-void *cache_lump_num(uint16_t i) {
-  wad.cache[i] = malloc(wad.directory[i].size);
-  fseek(wad.file, wad.directory[i].filepos, SEEK_SET);
-  fread(wad.cache[i], wad.directory[i].size, 1, wad.file);
-  return wad.cache[i];
+static void lru_push(int i) {
+  lumpcache_entry_t *entry = &wad.cache[i];
+  entry->lru_prev = -1;
+  entry->lru_next = wad.lru_head;
+  if (wad.lru_head >= 0) wad.cache[wad.lru_head].lru_prev = i;
+  else wad.lru_tail = i;
+  wad.lru_head = i;
+  wad.stats.bytes_purgeable += wad.directory[i].size;
 }
 
-void *cache_lump(const char* name) {
-  for (int i = 0; i < wad.num_lumps; i++) {
-    if (strncmp(wad.directory[i].name, name, sizeof(lumpname_t)) == 0) {
-      return cache_lump_num(i);
+static bool on_lru(int i) {
+  return wad.cache[i].lru_prev >= 0 || wad.lru_head == i;
+}
+
+static wadfile_t const *lump_wad_file(int i) {
+  return &wad.files[wad.lump_file[i]];
+}
+
+// Forgets a cached lump regardless of its refcount, freeing the heap copy
+// when the lump was read rather than mapped
+static void drop_cached_lump(int i) {
+  lumpcache_entry_t *entry = &wad.cache[i];
+  if (!entry->data) return;
+  if (on_lru(i)) lru_unlink(i);
+  if (!lump_wad_file(i)->base) {
+    free(entry->data);
+    wad.stats.bytes_resident -= wad.directory[i].size;
+  }
+  memset(entry, 0, sizeof(lumpcache_entry_t));
+  entry->lru_prev = entry->lru_next = -1;
+}
+
+// Frees least recently released lumps until the cache fits its budget.
+// Mapped lumps cost no heap and never enter the LRU list.
+static void purge_lump_cache(void) {
+  while (wad.stats.bytes_resident > wad.stats.budget && wad.lru_tail >= 0) {
+    drop_cached_lump(wad.lru_tail);
+    wad.stats.purges++;
+  }
+}
+
+// Map loads run on a worker thread, so the cache, the LRU list and the
+// shared FILE handles are only touched with this lock held. The directory
+// and the name index are read without it; they only change in
+// init_wad_stack, which runs before any map is loaded.
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *acquire_lump_locked(int i) {
+  if (i < 0 || i >= wad.num_lumps) return NULL;
+  lumpcache_entry_t *entry = &wad.cache[i];
+  filelump_t const *lump = &wad.directory[i];
+  wadfile_t const *wf = lump_wad_file(i);
+  if (entry->data) {
+    wad.stats.hits++;
+    if (on_lru(i)) lru_unlink(i);
+  } else if (wf->base) {
+    wad.stats.misses++;
+    entry->data = (void *)(wf->base + lump->filepos);
+  } else {
+    wad.stats.misses++;
+    entry->data = malloc(lump->size ? lump->size : 1);
+    if (!entry->data) return NULL;
+    if (!read_file_range(wf, entry->data, lump->filepos, lump->size)) {
+      free(entry->data);
+      entry->data = NULL;
+      return NULL;
     }
+    wad.stats.bytes_resident += lump->size;
   }
-  return NULL; // Not found
+  entry->refcount++;
+  return entry->data;
+}
+
+// Returns the lump contents and holds a reference until release_lump_num.
+// Data stays valid while referenced; after the last release it may be
+// purged if the cache is over budget.
+void *acquire_lump_num(int i) {
+  pthread_mutex_lock(&cache_lock);
+  void *data = acquire_lump_locked(i);
+  pthread_mutex_unlock(&cache_lock);
+  return data;
 }
 
-// Function to read data from a file at a specific offset
-void* read_lump_data(FILE* file, filelump_t const *lump) {
-  void* data = malloc(lump->size);
-  if (!data) return NULL;
+void *acquire_lump(const char* name) {
+  return acquire_lump_num(find_lump_num(name));
+}
+
+static void release_lump_locked(int i) {
+  if (i < 0 || i >= wad.num_lumps) return;
+  lumpcache_entry_t *entry = &wad.cache[i];
+  if (entry->refcount <= 0) {
+    printf("Warning: Lump %.8s released more often than acquired\n", wad.directory[i].name);
+    return;
+  }
+  if (--entry->refcount == 0 && !entry->pinned && !lump_wad_file(i)->base) {
+    lru_push(i);
+    purge_lump_cache();
+  }
+}
+
+void release_lump_num(int i) {
+  pthread_mutex_lock(&cache_lock);
+  release_lump_locked(i);
+  pthread_mutex_unlock(&cache_lock);
+}
+
+void set_lump_cache_budget(size_t bytes) {
+  pthread_mutex_lock(&cache_lock);
+  wad.stats.budget = bytes;
+  purge_lump_cache();
+  pthread_mutex_unlock(&cache_lock);
+}
+
+void get_lump_cache_stats(lumpcache_stats_t *stats) {
+  pthread_mutex_lock(&cache_lock);
+  *stats = wad.stats;
+  pthread_mutex_unlock(&cache_lock);
+}
+
+lumpview_t view_lump_num(int i) {
+  lumpview_t view = { .lump = -1 };
+  void *data = acquire_lump_num(i);
+  if (!data) return view;
+  view.data = data;
+  view.size = wad.directory[i].size;
+  view.lump = i;
+  return view;
+}
+
+lumpview_t view_lump(const char* name) {
+  return view_lump_num(find_lump_num(name));
+}
+
+void release_lump_view(lumpview_t *view) {
+  if (view->data) release_lump_num(view->lump);
+  memset(view, 0, sizeof(lumpview_t));
+  view->lump = -1;
+}
+
+bool lump_view_has(lumpview_t const *view, uint32_t offset, uint32_t length) {
+  return view->data && offset <= view->size && length <= view->size - offset;
+}
+
+// Returns lump contents that stay valid until shutdown_wad. The lump is
+// pinned, so it is read at most once and never purged.
+void *cache_lump_num(uint16_t i) {
+  if (i >= wad.num_lumps) return NULL;
+  pthread_mutex_lock(&cache_lock);
+  void *data;
+  if (wad.cache[i].pinned) {
+    wad.stats.hits++;
+    data = wad.cache[i].data;
+  } else {
+    data = acquire_lump_locked(i);
+    if (data) wad.cache[i].pinned = true;
+  }
+  pthread_mutex_unlock(&cache_lock);
+  return data;
+}
+
+void *cache_lump(const char* name) {
+  int i = find_lump_num(name);
+  return i >= 0 ? cache_lump_num(i) : NULL;
+}
+
+// Copies a lump into a fresh allocation the map can own and edit
+static void* read_lump_data(int lump) {
+  lumpview_t view = view_lump_num(lump);
+  if (!view.data) return NULL;
   
-  fseek(file, lump->filepos, SEEK_SET);
-  fread(data, 1, lump->size, file);
+  void* data = malloc(view.size ? view.size : 1);
+  if (data) memcpy(data, view.data, view.size);
+  release_lump_view(&view);
   return data;
 }
 
@@ -106,44 +568,62 @@ void find_all_maps(void (*proc)(const char *, void *), void *parm) {
   }
 }
 
-// Function to load map data
-map_data_t load_map(const char* map_name) {
-  map_data_t map = {0};
-  
+// Reads the map lumps into map, which must be zeroed. Works in place so
+// worker threads never hold a whole map_data_t on their stack.
+bool load_map_data(map_data_t *map, const char* map_name) {
   // Find the map marker lump
   int map_index = find_lump_num(map_name);
   if (map_index == -1) {
     printf("Map %s not found!\n", map_name);
-    return map;
+    return false;
   }
 
   // Map lumps follow a specific order after the map marker
   if (map_index + 10 <= wad.num_lumps) {
     // THINGS
-    map.num_things = wad.directory[map_index + ML_THINGS].size / sizeof(mapthing_t);
-    map.things = read_lump_data(wad.file, &wad.directory[map_index + ML_THINGS]);
+    map->num_things = wad.directory[map_index + ML_THINGS].size / sizeof(mapthing_t);
+    map->things = read_lump_data(map_index + ML_THINGS);
     
     // LINEDEFS
-    map.num_linedefs = wad.directory[map_index + ML_LINEDEFS].size / sizeof(maplinedef_t);
-    map.linedefs = read_lump_data(wad.file, &wad.directory[map_index + ML_LINEDEFS]);
+    map->num_linedefs = wad.directory[map_index + ML_LINEDEFS].size / sizeof(maplinedef_t);
+    map->linedefs = read_lump_data(map_index + ML_LINEDEFS);
     
     // SIDEDEFS
-    map.num_sidedefs = wad.directory[map_index + ML_SIDEDEFS].size / sizeof(mapsidedef_t);
-    map.sidedefs = read_lump_data(wad.file, &wad.directory[map_index + ML_SIDEDEFS]);
+    map->num_sidedefs = wad.directory[map_index + ML_SIDEDEFS].size / sizeof(mapsidedef_t);
+    map->sidedefs = read_lump_data(map_index + ML_SIDEDEFS);
     
     // VERTEXES
-    map.num_vertices = wad.directory[map_index + ML_VERTEXES].size / sizeof(mapvertex_t);
-    map.vertices = read_lump_data(wad.file, &wad.directory[map_index + ML_VERTEXES]);
+    map->num_vertices = wad.directory[map_index + ML_VERTEXES].size / sizeof(mapvertex_t);
+    map->vertices = read_lump_data(map_index + ML_VERTEXES);
 
     // SECTORS
-    map.num_sectors = wad.directory[map_index + ML_SECTORS].size / sizeof(mapsector_t);
-    map.sectors = read_lump_data(wad.file, &wad.directory[map_index + ML_SECTORS]);
-  }
-  
-  for (int i = 0; i < map.num_things; i++) {
-    assign_thing_sector(&map, &map.things[i]);
+    map->num_sectors = wad.directory[map_index + ML_SECTORS].size / sizeof(mapsector_t);
+    map->sectors = read_lump_data(map_index + ML_SECTORS);
+    
+    // SEGS, SSECTORS and NODES, only used by the BSP visibility path.
+    // Extended node formats start with a magic and are left out.
+    lumpview_t nodes = view_lump_num(map_index + ML_NODES);
+    bool extended = lump_view_has(&nodes, 0, 4) && !memcmp(nodes.data + 1, "NOD", 3);
+    release_lump_view(&nodes);
+    if (!extended) {
+      map->num_segs = wad.directory[map_index + ML_SEGS].size / sizeof(mapseg_t);
+      map->segs = read_lump_data(map_index + ML_SEGS);
+      map->num_subsectors = wad.directory[map_index + ML_SSECTORS].size / sizeof(mapsubsector_t);
+      map->subsectors = read_lump_data(map_index + ML_SSECTORS);
+      map->num_nodes = wad.directory[map_index + ML_NODES].size / sizeof(mapnode_t);
+      map->nodes = read_lump_data(map_index + ML_NODES);
+      map->num_node_vertices = map->num_vertices;
+      map->node_vertices = read_lump_data(map_index + ML_VERTEXES);
+    }
   }
   
+  return map->num_vertices > 0;
+}
+
+// Function to load map data
+map_data_t load_map(const char* map_name) {
+  map_data_t map = {0};
+  load_map_data(&map, map_name);
   return map;
 }
 
@@ -154,6 +634,16 @@ void free_map_data(map_data_t* map) {
   CLEAR_COLLECTION(map, sidedefs);
   CLEAR_COLLECTION(map, things);
   CLEAR_COLLECTION(map, sectors);
+  CLEAR_COLLECTION(map, segs);
+  CLEAR_COLLECTION(map, subsectors);
+  CLEAR_COLLECTION(map, nodes);
+  CLEAR_COLLECTION(map, node_vertices);
+  free(map->walls.sections);
+  free(map->walls.surfaces);
+  free(map->floors.sectors);
+  free(map->floors.surfaces);
+  free_sector_topology(map);
+  free_blockmap(map);
   memset(map, 0, sizeof(map_data_t));
 }
 
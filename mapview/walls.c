@@ -7,7 +7,8 @@
 #define init_wall_vertex(X, Y, Z, U, V) \
 write_line=true;\
 map->walls.vertices[map->walls.num_vertices++] = \
-(wall_vertex_t) {X,Y,Z,U*dist+u_offset,V*height+v_offset,n[0],n[1],n[2],color}
+(wall_vertex_t) {.x=X,.y=Y,.z=Z,.u=U*dist+u_offset,.v=V*height+v_offset,\
+.nx=n[0],.ny=n[1],.nz=n[2],.surface=0,.color=color}
 
 extern GLuint world_prog, ui_prog;
 extern GLuint no_tex, white_tex;
@@ -36,20 +37,24 @@ float compute_normal_packed(float dx, float dy, int8_t out[3]) {
   return length;
 }
 
-void build_wall_vertex_buffer(map_data_t *map) {
+// Allocates one empty section record per sidedef, reindexes which
+// sides and portals belong to each sector and rebuilds the blockmap
+void init_wall_sections(map_data_t *map) {
   map->walls.sections = realloc(map->walls.sections, sizeof(mapsidedef2_t) * map->num_sidedefs);
   memset(map->walls.sections, 0, sizeof(mapsidedef2_t) * map->num_sidedefs);
   for (uint32_t i = 0; i < map->num_sidedefs; i++) {
     map->walls.sections[i].def = &map->sidedefs[i];
     map->walls.sections[i].sector = &map->sectors[map->sidedefs[i].sector];
   }
+  build_sector_topology(map);
+  build_blockmap(map);
+}
+
+// Builds wall sections and vertices on the CPU, no GL calls
+void build_wall_geometry(map_data_t *map) {
+  init_wall_sections(map);
   
   map->walls.num_vertices = 0;
-  // Create VAO for walls if not already created
-  if (!map->walls.vao) {
-    glGenVertexArrays(1, &map->walls.vao);
-    glGenBuffers(1, &map->walls.vbo);
-  }
 
   // Loop through all linedefs
   for (int i = 0; i < map->num_linedefs; i++) {
@@ -90,7 +95,7 @@ void build_wall_vertex_buffer(map_data_t *map) {
         // Store vertex_start in the appropriate structure (this would need to be added to sidedef)
         front->upper_section.vertex_start = map->walls.num_vertices;
         front->upper_section.vertex_count = 4;
-        front->upper_section.texture = get_texture(front->def->toptexture);
+        front->upper_section.texture = get_texture_handle(front->def->toptexture);
         
         float height = fabs((float)(back->sector->ceilingheight - front->sector->ceilingheight));
         
@@ -104,7 +109,7 @@ void build_wall_vertex_buffer(map_data_t *map) {
       if (back && front->sector->floorheight < back->sector->floorheight) {
         front->lower_section.vertex_start = map->walls.num_vertices;
         front->lower_section.vertex_count = 4;
-        front->lower_section.texture = get_texture(front->def->bottomtexture);
+        front->lower_section.texture = get_texture_handle(front->def->bottomtexture);
         
         float height = fabs((float)(back->sector->floorheight - front->sector->floorheight));
         
@@ -118,7 +123,7 @@ void build_wall_vertex_buffer(map_data_t *map) {
       if (get_texture(front->def->midtexture)) {
         front->mid_section.vertex_start = map->walls.num_vertices;
         front->mid_section.vertex_count = 4;
-        front->mid_section.texture = get_texture(front->def->midtexture);
+        front->mid_section.texture = get_texture_handle(front->def->midtexture);
         
         float bottom = back ? MAX(front->sector->floorheight, back->sector->floorheight) : front->sector->floorheight;
         float top = back ? MIN(front->sector->ceilingheight, back->sector->ceilingheight) : front->sector->ceilingheight;
@@ -139,7 +144,7 @@ void build_wall_vertex_buffer(map_data_t *map) {
       if (back->sector->ceilingheight > front->sector->ceilingheight) {
         back->upper_section.vertex_start = map->walls.num_vertices;
         back->upper_section.vertex_count = 4;
-        back->upper_section.texture = get_texture(back->def->toptexture);
+        back->upper_section.texture = get_texture_handle(back->def->toptexture);
         
         float height = fabs((float)(back->sector->ceilingheight - front->sector->ceilingheight));
         
@@ -153,7 +158,7 @@ void build_wall_vertex_buffer(map_data_t *map) {
       if (back->sector->floorheight < front->sector->floorheight) {
         back->lower_section.vertex_start = map->walls.num_vertices;
         back->lower_section.vertex_count = 4;
-        back->lower_section.texture = get_texture(back->def->bottomtexture);
+        back->lower_section.texture = get_texture_handle(back->def->bottomtexture);
         
         float height = fabs((float)(back->sector->floorheight - front->sector->floorheight));
         
@@ -167,7 +172,7 @@ void build_wall_vertex_buffer(map_data_t *map) {
       if (get_texture(back->def->midtexture)) {
         back->mid_section.vertex_start = map->walls.num_vertices;
         back->mid_section.vertex_count = 4;
-        back->mid_section.texture = get_texture(back->def->midtexture);
+        back->mid_section.texture = get_texture_handle(back->def->midtexture);
         
         float bottom = MAX(front->sector->floorheight, back->sector->floorheight);
         float top = MIN(front->sector->ceilingheight, back->sector->ceilingheight);
@@ -192,10 +197,20 @@ void build_wall_vertex_buffer(map_data_t *map) {
     }
   }
   
+}
+
+// Uploads a wall vertex stream, which may live outside map->walls.vertices
+void upload_wall_vertices(map_data_t *map, wall_vertex_t const *vertices, uint32_t count) {
+  // Create VAO for walls if not already created
+  if (!map->walls.vao) {
+    glGenVertexArrays(1, &map->walls.vao);
+    glGenBuffers(1, &map->walls.vbo);
+  }
+  
   // Upload vertex data to GPU
   glBindVertexArray(map->walls.vao);
   glBindBuffer(GL_ARRAY_BUFFER, map->walls.vbo);
-  glBufferData(GL_ARRAY_BUFFER, map->walls.num_vertices * sizeof(wall_vertex_t), map->walls.vertices, GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, count * sizeof(wall_vertex_t), vertices, GL_STATIC_DRAW);
   
   // Set up vertex attributes
   glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, sizeof(wall_vertex_t), OFFSET_OF(wall_vertex_t, x)); // Position
@@ -206,84 +221,199 @@ void build_wall_vertex_buffer(map_data_t *map) {
   glEnableVertexAttribArray(2);
   glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(wall_vertex_t), OFFSET_OF(wall_vertex_t, color)); // Color
   glEnableVertexAttribArray(3);
+  
+  // Surface table, one entry per quad, filled by draw_wall_batch as the
+  // quads become visible. The copy kept in memory starts out matching it.
+  uint16_t (*surfaces)[4] = realloc(map->walls.surfaces, sizeof(uint16_t[4]) * (count / 4 + 1));
+  if (!surfaces) return;
+  map->walls.surfaces = surfaces;
+  memset(surfaces, 0, sizeof(uint16_t[4]) * (count / 4 + 1));
+  if (!map->walls.surfaces_buf) {
+    glGenBuffers(1, &map->walls.surfaces_buf);
+    glGenTextures(1, &map->walls.surfaces_tex);
+  }
+  glBindBuffer(GL_TEXTURE_BUFFER, map->walls.surfaces_buf);
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(uint16_t[4]) * (count / 4 + 1), surfaces, GL_DYNAMIC_DRAW);
+  glBindTexture(GL_TEXTURE_BUFFER, map->walls.surfaces_tex);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA16UI, map->walls.surfaces_buf);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
 
 //  printf("Built wall vertex buffer with %d vertices\n", map->walls.num_vertices);
 }
 
-// Helper function to draw a textured quad from the wall vertex buffer
-void draw_textured_surface(wall_section_t const *surface, float light, int mode) {
-  if (surface->texture) {
-    glBindTexture(GL_TEXTURE_2D, surface->texture->texture);
-    glUniform2f(world_prog_tex0_size, surface->texture->width, surface->texture->height);
-  } else {
-    glBindTexture(GL_TEXTURE_2D, no_tex);
-    glUniform2f(world_prog_tex0_size, 1, 1);
-  }
-  glUniform1i(world_prog_tex0, 0);
-  glUniform1f(world_prog_light, light);
-  
-  // Draw 4 vertices starting at vertex_start
-  glDrawArrays(mode, surface->vertex_start, surface->vertex_count);
+void build_wall_vertex_buffer(map_data_t *map) {
+  build_wall_geometry(map);
+  upload_wall_vertices(map, map->walls.vertices, map->walls.num_vertices);
 }
 
-// Draw the map from player perspective
-void draw_walls(map_data_t const *map,
-                mapsector_t const *sector,
-                viewdef_t const *viewdef)
-{
-  // Bind the wall VAO
-  glBindVertexArray(map->walls.vao);
-  glDisable(GL_BLEND);
+// Sections picked by draw_walls this frame, drawn by draw_wall_batch
+typedef struct {
+  wall_section_t const *section;
+  uint16_t light;
+} visible_wall_t;
+
+static visible_wall_t *visible_walls = NULL;
+static int num_visible_walls = 0;
+static int max_visible_walls = 0;
 
-  glUniformMatrix4fv(world_prog_mvp, 1, GL_FALSE, viewdef->mvp[0]);
-  glUniform3fv(world_prog_viewPos, 1, viewdef->viewpos);
+// Multi-draw ranges sorted by page, sized with visible_walls
+static int *wall_group = NULL;
+static GLint *wall_first = NULL;
+static GLsizei *wall_size = NULL;
+static int *group_start = NULL;
+static int max_groups = 0;
+
+static void add_visible_wall(wall_section_t const *section, float light) {
+  if (!section->vertex_count || num_visible_walls == max_visible_walls) return;
+  visible_walls[num_visible_walls++] = (visible_wall_t){ section, (uint16_t)(light * 255) };
+}
+
+// Starts collecting the walls of a new frame. Each sidedef belongs to one
+// sector, so a frame never picks more than three sections per sidedef.
+void begin_wall_batch(map_data_t const *map) {
+  num_visible_walls = 0;
+  int count = map->num_sidedefs * 3;
+  if (count <= max_visible_walls) return;
+  visible_wall_t *walls = realloc(visible_walls, sizeof(visible_wall_t) * count);
+  if (walls) visible_walls = walls;
+  int *group = realloc(wall_group, sizeof(int) * count);
+  if (group) wall_group = group;
+  GLint *first = realloc(wall_first, sizeof(GLint) * count);
+  if (first) wall_first = first;
+  GLsizei *size = realloc(wall_size, sizeof(GLsizei) * count);
+  if (size) wall_size = size;
+  if (walls && group && first && size) max_visible_walls = count;
+}
+
+// Draws the collected walls with one multi-draw per texture page, plus
+// one for sections without a texture. Only surface entries that changed
+// since they were last drawn, when a texture got its layer or the light
+// changed, are uploaded.
+void draw_wall_batch(map_data_t const *map, viewdef_t const *viewdef) {
+  if (!num_visible_walls || !map->walls.surfaces_buf || !map->walls.surfaces) return;
   
-  // Draw linedefs
-  for (int i = 0; i < map->num_linedefs; i++) {
-    maplinedef_t const *linedef = &map->linedefs[i];
-    
-    // Check if front sidedef exists
-    if (linedef->sidenum[0] >= map->num_sidedefs) {
-      continue; // Skip if invalid front sidedef
+  int num_groups = get_num_wall_pages() + 1;
+  if (num_groups + 1 > max_groups) {
+    int *starts = realloc(group_start, sizeof(int) * (num_groups + 1));
+    if (!starts) return;
+    group_start = starts;
+    max_groups = num_groups + 1;
+  }
+  memset(group_start, 0, sizeof(int) * (num_groups + 1));
+  
+  uint32_t dirty_start = UINT32_MAX, dirty_end = 0;
+  for (int i = 0; i < num_visible_walls; i++) {
+    wall_section_t const *section = visible_walls[i].section;
+    mapside_texture_t const *tex = get_texture_by_handle(section->texture);
+    int page = num_groups - 1;
+    int layer = get_wall_layer(section->texture, &page);
+    uint16_t entry[4] = {
+      layer < 0 ? 0xFFFF : layer,
+      visible_walls[i].light,
+      tex ? tex->width : 1,
+      tex ? tex->height : 1,
+    };
+    // Textures still on the fallback layer may be larger than its page
+    texpage_t const *info = layer < 0 ? NULL : get_wall_page(page);
+    if (info) {
+      entry[2] = MIN(entry[2], info->width);
+      entry[3] = MIN(entry[3], info->height);
     }
-    
-    mapsidedef2_t const *front = &map->walls.sections[linedef->sidenum[0]];
-    float light = front->sector->lightlevel / 255.0f;
-    
-    extern int pixel;
-
-    if (front->sector == sector) {
-      // Draw front side
-      if (CHECK_PIXEL(pixel, TOP, linedef->sidenum[0])) {
-        draw_textured_surface(&front->upper_section, HIGHLIGHT(light), GL_TRIANGLE_FAN);
-      } else if (front->upper_section.texture || strncmp(front->sector->ceilingpic, "F_SKY", 5)) {
-        draw_textured_surface(&front->upper_section, light, GL_TRIANGLE_FAN);
-      }
-      if (CHECK_PIXEL(pixel, BOTTOM, linedef->sidenum[0])) {
-        draw_textured_surface(&front->lower_section, HIGHLIGHT(light), GL_TRIANGLE_FAN);
-      } else {
-        draw_textured_surface(&front->lower_section, light, GL_TRIANGLE_FAN);
-      }
-      if (CHECK_PIXEL(pixel, MID, linedef->sidenum[0])) {
-        draw_textured_surface(&front->mid_section, HIGHLIGHT(light), GL_TRIANGLE_FAN);
-      } else {
-        draw_textured_surface(&front->mid_section, light, GL_TRIANGLE_FAN);
-      }
+    uint32_t quad = section->vertex_start / 4;
+    if (memcmp(map->walls.surfaces[quad], entry, sizeof(entry))) {
+      memcpy(map->walls.surfaces[quad], entry, sizeof(entry));
+      dirty_start = MIN(dirty_start, quad);
+      dirty_end = MAX(dirty_end, quad + 1);
     }
+    wall_group[i] = layer < 0 ? num_groups - 1 : page;
+    group_start[wall_group[i] + 1]++;
+  }
+  for (int g = 0; g < num_groups; g++) {
+    group_start[g + 1] += group_start[g];
+  }
+  // Scatter the ranges by page, using group_start as insertion cursors
+  for (int i = 0; i < num_visible_walls; i++) {
+    int slot = group_start[wall_group[i]]++;
+    wall_first[slot] = visible_walls[i].section->vertex_start;
+    wall_size[slot] = visible_walls[i].section->vertex_count;
+  }
+  
+  if (dirty_start < dirty_end) {
+    glBindBuffer(GL_TEXTURE_BUFFER, map->walls.surfaces_buf);
+    glBufferSubData(GL_TEXTURE_BUFFER, sizeof(uint16_t[4]) * dirty_start,
+                    sizeof(uint16_t[4]) * (dirty_end - dirty_start), map->walls.surfaces[dirty_start]);
+  }
+  
+  extern GLuint wall_prog;
+  glUseProgram(wall_prog);
+  glUniformMatrix4fv(wall_prog_mvp, 1, GL_FALSE, viewdef->mvp[0]);
+  glUniform3fv(wall_prog_viewPos, 1, viewdef->viewpos);
+  glBindVertexArray(map->walls.vao);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_BUFFER, map->walls.surfaces_tex);
+  glActiveTexture(GL_TEXTURE0);
+  bind_palette_textures();
+  
+  // The cursors now sit at the end of each group
+  for (int g = 0; g < num_groups; g++) {
+    int start = g ? group_start[g - 1] : 0;
+    int n = group_start[g] - start;
+    if (!n) continue;
+    texpage_t const *page = get_wall_page(g);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, page ? page->texture : 0);
+    glMultiDrawArrays(GL_TRIANGLE_FAN, wall_first + start, wall_size + start, n);
+  }
+}
 
-    // Draw back side if it exists
-    if (linedef->sidenum[1] != 0xFFFF && linedef->sidenum[1] < map->num_sidedefs) {
-      mapsidedef2_t const *back = &map->walls.sections[linedef->sidenum[1]];
-      if (back->sector == sector) {
-        draw_textured_surface(&back->upper_section, light, GL_TRIANGLE_FAN);
-        draw_textured_surface(&back->lower_section, light, GL_TRIANGLE_FAN);
-        draw_textured_surface(&back->mid_section, light, GL_TRIANGLE_FAN);
-      }
+// Adds the sections of one linedef side to this frame's wall batch,
+// draw_wall_batch draws them later, grouped by texture page
+void draw_wall_side(map_data_t const *map, uint16_t index, int side) {
+  maplinedef_t const *linedef = &map->linedefs[index];
+  
+  mapsidedef2_t const *front = &map->walls.sections[linedef->sidenum[0]];
+  float light = front->sector->lightlevel / 255.0f;
+  
+  extern int pixel;
+
+  if (side == 0) {
+    // Draw front side
+    if (CHECK_PIXEL(pixel, TOP, linedef->sidenum[0])) {
+      add_visible_wall(&front->upper_section, HIGHLIGHT(light));
+    } else if (front->upper_section.texture || strncmp(front->sector->ceilingpic, "F_SKY", 5)) {
+      add_visible_wall(&front->upper_section, light);
     }
+    if (CHECK_PIXEL(pixel, BOTTOM, linedef->sidenum[0])) {
+      add_visible_wall(&front->lower_section, HIGHLIGHT(light));
+    } else {
+      add_visible_wall(&front->lower_section, light);
+    }
+    if (CHECK_PIXEL(pixel, MID, linedef->sidenum[0])) {
+      add_visible_wall(&front->mid_section, HIGHLIGHT(light));
+    } else {
+      add_visible_wall(&front->mid_section, light);
+    }
+  } else {
+    // Draw back side
+    mapsidedef2_t const *back = &map->walls.sections[linedef->sidenum[1]];
+    add_visible_wall(&back->upper_section, light);
+    add_visible_wall(&back->lower_section, light);
+    add_visible_wall(&back->mid_section, light);
   }
+}
+
+// Adds the sides facing into sector to this frame's wall batch
+void draw_walls(map_data_t const *map,
+                mapsector_t const *sector,
+                viewdef_t const *viewdef)
+{
+  if (!map->topology.side_start) return;
+  uint32_t s = (uint32_t)(sector - map->sectors);
   
-  // Reset texture binding
-  glBindTexture(GL_TEXTURE_2D, 0);
+  // Draw the sides facing into this sector
+  for (uint32_t k = map->topology.side_start[s]; k < map->topology.side_start[s + 1]; k++) {
+    mapsideref_t ref = map->topology.sides[k];
+    draw_wall_side(map, ref.linedef, ref.side);
+  }
 }
 
 // Helper function to draw a textured quad from the wall vertex buffer
@@ -308,31 +438,16 @@ draw_wall_ids(map_data_t const *map,
   glBindVertexArray(map->walls.vao);
   glDisableVertexAttribArray(3);
   glVertexAttrib4f(3, 0, 0, 0, 0);
-  // Draw linedefs
-  for (int i = 0; i < map->num_linedefs; i++) {
-    maplinedef_t const *linedef = &map->linedefs[i];
-    
-    // Check if front sidedef exists
-    if (linedef->sidenum[0] != 0xFFFF) {
-      uint32_t sidenum = linedef->sidenum[0];
-      mapsidedef2_t const *front = &map->walls.sections[linedef->sidenum[0]];
-      if (front->sector == sector) {
-        draw_textured_surface_id(&front->upper_section, sidenum|PIXEL_TOP, GL_TRIANGLE_FAN);
-        draw_textured_surface_id(&front->lower_section, sidenum|PIXEL_BOTTOM, GL_TRIANGLE_FAN);
-        draw_textured_surface_id(&front->mid_section, sidenum|PIXEL_MID, GL_TRIANGLE_FAN);
-      }
-    }
-
-    // Draw back side if it exists
-    if (linedef->sidenum[1] != 0xFFFF) {
-      uint32_t sidenum = linedef->sidenum[1];
-      mapsidedef2_t const *back = &map->walls.sections[linedef->sidenum[1]];
-      if (back->sector == sector) {
-        draw_textured_surface_id(&back->upper_section, sidenum|PIXEL_TOP, GL_TRIANGLE_FAN);
-        draw_textured_surface_id(&back->lower_section, sidenum|PIXEL_BOTTOM, GL_TRIANGLE_FAN);
-        draw_textured_surface_id(&back->mid_section, sidenum|PIXEL_MID, GL_TRIANGLE_FAN);
-      }
-    }
+  // Draw the sides facing into this sector
+  uint32_t const *side_start = map->topology.side_start;
+  uint32_t s = (uint32_t)(sector - map->sectors);
+  for (uint32_t k = side_start ? side_start[s] : 0, end = side_start ? side_start[s + 1] : 0; k < end; k++) {
+    mapsideref_t ref = map->topology.sides[k];
+    uint32_t sidenum = map->linedefs[ref.linedef].sidenum[ref.side];
+    mapsidedef2_t const *side = &map->walls.sections[sidenum];
+    draw_textured_surface_id(&side->upper_section, sidenum|PIXEL_TOP, GL_TRIANGLE_FAN);
+    draw_textured_surface_id(&side->lower_section, sidenum|PIXEL_BOTTOM, GL_TRIANGLE_FAN);
+    draw_textured_surface_id(&side->mid_section, sidenum|PIXEL_MID, GL_TRIANGLE_FAN);
   }
   
   // Reset texture binding
@@ -0,0 +1,285 @@
+/*
+ * Blockmap Tests
+ *
+ * Builds the blockmap of mapview/blockmap.c for small generated maps and
+ * checks that collision queries see every linedef near the query box,
+ * each once, that corner flags match the wall angles, and that point
+ * location through the cells agrees with a ray cast over the whole map.
+ */
+
+#include <tests/map_test.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+
+static uint16_t add_vertex(map_data_t *map, int x, int y) {
+  map->vertices = realloc(map->vertices, sizeof(mapvertex_t) * (map->num_vertices + 1));
+  map->vertices[map->num_vertices] = (mapvertex_t){ x, y };
+  return map->num_vertices++;
+}
+
+static void add_line(map_data_t *map, uint16_t start, uint16_t end) {
+  map->linedefs = realloc(map->linedefs, sizeof(maplinedef_t) * (map->num_linedefs + 1));
+  map->linedefs[map->num_linedefs++] = (maplinedef_t){
+    .start = start,
+    .end = end,
+    .sidenum = { 0, 0xFFFF },
+  };
+}
+
+// Linedef with a sidedef for each sector given, back may be -1
+static void add_sector_line(map_data_t *map, uint16_t start, uint16_t end, int front, int back) {
+  int s = map->num_sidedefs;
+  map->sidedefs = realloc(map->sidedefs, sizeof(mapsidedef_t) * (s + 2));
+  map->sidedefs[s] = (mapsidedef_t){ front };
+  map->sidedefs[s + 1] = (mapsidedef_t){ back };
+  map->num_sidedefs += back < 0 ? 1 : 2;
+  add_line(map, start, end);
+  map->linedefs[map->num_linedefs - 1].sidenum[0] = s;
+  map->linedefs[map->num_linedefs - 1].sidenum[1] = back < 0 ? 0xFFFF : s + 1;
+}
+
+static void add_sectors(map_data_t *map, int count) {
+  map->sectors = calloc(count, sizeof(mapsector_t));
+  map->num_sectors = count;
+}
+
+static void free_map(map_data_t *map) {
+  free_blockmap(map);
+  CLEAR_COLLECTION(map, vertices);
+  CLEAR_COLLECTION(map, linedefs);
+  CLEAR_COLLECTION(map, sidedefs);
+  CLEAR_COLLECTION(map, sectors);
+}
+
+static bool has_line(uint16_t const *lines, int count, uint16_t line) {
+  for (int i = 0; i < count; i++) {
+    if (lines[i] == line) return true;
+  }
+  return false;
+}
+
+// Square room of 1024 units with a collinear vertex halfway up the left wall
+static void make_room(map_data_t *map) {
+  uint16_t a = add_vertex(map, 0, 0);
+  uint16_t m = add_vertex(map, 0, 512);
+  uint16_t b = add_vertex(map, 0, 1024);
+  uint16_t c = add_vertex(map, 1024, 1024);
+  uint16_t d = add_vertex(map, 1024, 0);
+  add_line(map, a, m);
+  add_line(map, m, b);
+  add_line(map, b, c);
+  add_line(map, c, d);
+  add_line(map, d, a);
+  build_blockmap(map);
+}
+
+// Test 1: A query near one wall finds it and skips the far ones
+static void test_query_near_wall(void) {
+  printf("Test 1: Query near a wall... ");
+
+  map_data_t map = { 0 };
+  make_room(&map);
+  assert(map.blockmap.width == 9 && map.blockmap.height == 9);
+
+  uint16_t lines[16];
+  int count = get_blockmap_lines(&map, 1000, 400, 1030, 420, lines, 16);
+  assert(has_line(lines, count, 3));
+  assert(!has_line(lines, count, 0));
+  assert(!has_line(lines, count, 1));
+
+  count = get_blockmap_lines(&map, 400, 400, 420, 420, lines, 16);
+  assert(count == 0);
+
+  free_map(&map);
+  printf("PASSED\n");
+}
+
+// Test 2: Every linedef shows up once in a query covering the map
+static void test_query_whole_map(void) {
+  printf("Test 2: Query covering the map... ");
+
+  map_data_t map = { 0 };
+  make_room(&map);
+
+  uint16_t lines[16];
+  int count = get_blockmap_lines(&map, -100, -100, 2000, 2000, lines, 16);
+  assert(count == map.num_linedefs);
+  for (int i = 0; i < map.num_linedefs; i++) {
+    assert(has_line(lines, count, i));
+  }
+
+  // A full buffer stops the query
+  assert(get_blockmap_lines(&map, -100, -100, 2000, 2000, lines, 2) == 2);
+
+  free_map(&map);
+  printf("PASSED\n");
+}
+
+// Test 3: A diagonal line is found from every point along it
+static void test_diagonal_line(void) {
+  printf("Test 3: Diagonal line cells... ");
+
+  map_data_t map = { 0 };
+  add_line(&map, add_vertex(&map, -700, 33), add_vertex(&map, 900, 1250));
+  add_line(&map, add_vertex(&map, 1000, 1300), add_vertex(&map, 1000, 1300));
+  build_blockmap(&map);
+
+  for (int i = 0; i <= 100; i++) {
+    float x = -700 + 1600 * i / 100.0f;
+    float y = 33 + 1217 * i / 100.0f;
+    uint16_t lines[16];
+    int count = get_blockmap_lines(&map, x - 1, y - 1, x + 1, y + 1, lines, 16);
+    assert(has_line(lines, count, 0));
+  }
+
+  free_map(&map);
+  printf("PASSED\n");
+}
+
+// Test 4: Room corners are corners, the vertex along a straight wall is not
+static void test_corners(void) {
+  printf("Test 4: Corner flags... ");
+
+  map_data_t map = { 0 };
+  make_room(&map);
+  assert(map.blockmap.num_corners == map.num_vertices);
+  assert(map.blockmap.corners[0]);
+  assert(!map.blockmap.corners[1]);
+  assert(map.blockmap.corners[2]);
+  assert(map.blockmap.corners[3]);
+  assert(map.blockmap.corners[4]);
+
+  free_map(&map);
+  printf("PASSED\n");
+}
+
+// Room of sector 0 around a slanted pentagon of sector 1 and a triangle of
+// sector 2 that shares the room's corner, over several cells
+static void make_sectors(map_data_t *map) {
+  add_sectors(map, 3);
+  uint16_t a = add_vertex(map, -37, -11);
+  uint16_t b = add_vertex(map, -37, 700);
+  uint16_t c = add_vertex(map, 901, 700);
+  uint16_t d = add_vertex(map, 901, -11);
+  uint16_t e = add_vertex(map, 300, -11);
+  uint16_t f = add_vertex(map, 901, 250);
+  add_sector_line(map, a, b, 0, -1);
+  add_sector_line(map, b, c, 0, -1);
+  add_sector_line(map, c, f, 0, -1);
+  add_sector_line(map, e, a, 0, -1);
+  add_sector_line(map, f, d, 2, -1);
+  add_sector_line(map, d, e, 2, -1);
+  add_sector_line(map, e, f, 2, 0);
+
+  uint16_t p[5] = {
+    add_vertex(map, 129, 255),
+    add_vertex(map, 257, 513),
+    add_vertex(map, 513, 449),
+    add_vertex(map, 500, 128),
+    add_vertex(map, 256, 127),
+  };
+  for (int i = 0; i < 5; i++) {
+    add_sector_line(map, p[i], p[(i + 1) % 5], 1, 0);
+  }
+  build_blockmap(map);
+}
+
+// Compares the cells against the full scan at every sample point, which
+// includes the vertices and points along the lines
+static void check_sectors(map_data_t const *map, int step) {
+  for (int y = -64; y <= 780; y += step) {
+    for (int x = -64; x <= 980; x += step) {
+      uint16_t sectors[8];
+      int count = get_blockmap_sectors(map, x, y, sectors, 8);
+      assert(count >= 0);
+      int expected = 0;
+      for (int i = 0; i < map->num_sectors; i++) {
+        bool inside = scan_point_in_sector(map, x, y, i);
+        assert(blockmap_point_in_sector(map, x, y, i) == inside);
+        if (!inside) continue;
+        bool found = false;
+        for (int j = 0; j < count; j++) {
+          found |= sectors[j] == i;
+        }
+        assert(found);
+        expected++;
+      }
+      assert(count == expected);
+    }
+  }
+}
+
+// Test 5: Points in the cells are in the same sectors as in a full scan
+static void test_point_sectors(void) {
+  printf("Test 5: Point location... ");
+
+  map_data_t map = { 0 };
+  make_sectors(&map);
+  assert(map.blockmap.num_open == 0);
+
+  uint16_t sectors[8];
+  assert(get_blockmap_sectors(&map, 380, 300, sectors, 8) == 1 && sectors[0] == 1);
+  assert(get_blockmap_sectors(&map, 50, 600, sectors, 8) == 1 && sectors[0] == 0);
+  assert(get_blockmap_sectors(&map, 850, 10, sectors, 8) == 1 && sectors[0] == 2);
+  assert(get_blockmap_sectors(&map, 2000, 10, sectors, 8) == 0);
+  check_sectors(&map, 1);
+
+  free_map(&map);
+  printf("PASSED\n");
+}
+
+// Test 6: A sector that does not close is located by the full scan
+static void test_open_sector(void) {
+  printf("Test 6: Open sector... ");
+
+  map_data_t map = { 0 };
+  add_sectors(&map, 2);
+  add_sector_line(&map, add_vertex(&map, 0, 0), add_vertex(&map, 0, 300), 0, -1);
+  add_sector_line(&map, 1, add_vertex(&map, 300, 300), 0, -1);
+  add_sector_line(&map, 2, add_vertex(&map, 300, 0), 0, -1);
+  add_sector_line(&map, add_vertex(&map, 500, 500), add_vertex(&map, 500, 700), 1, -1);
+  add_sector_line(&map, 5, add_vertex(&map, 700, 500), 1, -1);
+  add_sector_line(&map, 6, 4, 1, -1);
+  build_blockmap(&map);
+  assert(map.blockmap.num_open == 1 && map.blockmap.open_list[0] == 0);
+  assert(map.blockmap.open_sectors[0] && !map.blockmap.open_sectors[1]);
+  check_sectors(&map, 3);
+
+  free_map(&map);
+  printf("PASSED\n");
+}
+
+// Test 7: Editing the map without a rebuild leaves it to the full scan
+static void test_stale_sectors(void) {
+  printf("Test 7: Out of date point location... ");
+
+  map_data_t map = { 0 };
+  make_sectors(&map);
+  assert(blockmap_point_in_sector(&map, 380, 300, 1) == 1);
+  add_sector_line(&map, 0, 2, 0, -1);
+  uint16_t sectors[8];
+  assert(blockmap_point_in_sector(&map, 380, 300, 1) == -1);
+  assert(get_blockmap_sectors(&map, 380, 300, sectors, 8) == -1);
+  build_blockmap(&map);
+  assert(blockmap_point_in_sector(&map, 380, 300, 1) == 1);
+
+  free_map(&map);
+  printf("PASSED\n");
+}
+
+int main(void) {
+  printf("=== Running Blockmap Tests ===\n\n");
+
+  test_query_near_wall();
+  test_query_whole_map();
+  test_diagonal_line();
+  test_corners();
+  test_point_sectors();
+  test_open_sector();
+  test_stale_sectors();
+
+  printf("\n=== All Tests Passed! ===\n");
+
+  return 0;
+}
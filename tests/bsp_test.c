@@ -155,6 +155,135 @@ void test_point_on_side_diagonal(void) {
   printf("PASSED\n");
 }
 
+
+//
+// Solid wall clip list, copied from gldoom/r_bsp.c
+//
+#define CLIPCOLUMNS 2048
+
+typedef struct
+{
+  int first;
+  int last;
+
+} cliprange_t;
+
+#define MAXSEGS (CLIPCOLUMNS / 2 + 2)
+
+static cliprange_t *newend;
+static cliprange_t solidsegs[MAXSEGS];
+
+//
+// R_ClearClipSegs
+//
+static void R_ClearClipSegs(void)
+{
+  solidsegs[0].first = -0x7fffffff;
+  solidsegs[0].last = -1;
+  solidsegs[1].first = CLIPCOLUMNS;
+  solidsegs[1].last = 0x7fffffff;
+  newend = solidsegs+2;
+}
+
+// True once solid walls cover every column
+static bool R_ClipListFull(void)
+{
+  return solidsegs[0].last >= CLIPCOLUMNS - 1;
+}
+
+// Returns true if some column of first..last is not covered yet.
+// Touching ranges are merged, so one range holds any covered span.
+static bool R_RangeVisible(int first, int last)
+{
+  cliprange_t *start = solidsegs;
+  while (start->last < last)
+    start++;
+
+  return first < start->first || last > start->last;
+}
+
+//
+// R_ClipSolidWallSegment
+// Marks columns first..last as covered by a solid wall.
+//
+static void R_ClipSolidWallSegment(int first, int last)
+{
+  cliprange_t *next;
+  cliprange_t *start;
+
+  // Find the first range that touches the range
+  //  (adjacent columns are touching).
+  start = solidsegs;
+  while (start->last < first-1)
+    start++;
+
+  if (first < start->first)
+  {
+    if (last < start->first-1)
+    {
+      // Post is entirely visible (above start),
+      //  so insert a new clippost. A full list
+      //  only loses occlusion, never geometry.
+      if (newend == solidsegs + MAXSEGS)
+        return;
+      next = newend;
+      newend++;
+
+      while (next != start)
+      {
+        *next = *(next-1);
+        next--;
+      }
+      next->first = first;
+      next->last = last;
+      return;
+    }
+
+    // Extend the existing post to the left.
+    start->first = first;
+  }
+
+  // Bottom contained in start?
+  if (last <= start->last)
+    return;
+
+  next = start;
+  while (last >= (next+1)->first-1)
+  {
+    next++;
+
+    if (last <= next->last)
+    {
+      // Bottom is contained in next.
+      // Adjust the clip size.
+      start->last = next->last;
+      goto crunch;
+    }
+  }
+
+  // There is a fragment after *next.
+  start->last = last;
+
+  // Remove start+1 to next from the clip list,
+  // because start now covers their area.
+crunch:
+  if (next == start)
+  {
+    // Post just extended past the bottom of one post.
+    return;
+  }
+
+  // Pre-increment, unlike the original, which kept one stale post
+  // after every merge and let the list fill up
+  while (++next != newend)
+  {
+    // Remove a post.
+    *++start = *next;
+  }
+
+  newend = start+1;
+}
+
 //
 // Test 4: Simple BSP tree traversal
 //
@@ -217,6 +346,156 @@ void test_consistency(void) {
   printf("PASSED\n");
 }
 
+//
+// Test 6: Solid walls cover columns and merge into one range
+//
+void test_clip_solid_segs(void) {
+  printf("Test 6: Solid seg clipping... ");
+  
+  R_ClearClipSegs();
+  assert(R_RangeVisible(0, CLIPCOLUMNS - 1));
+  
+  R_ClipSolidWallSegment(100, 199);
+  assert(!R_RangeVisible(100, 199));
+  assert(!R_RangeVisible(120, 130));
+  assert(R_RangeVisible(90, 110));
+  assert(R_RangeVisible(200, 200));
+  
+  // A disjoint wall adds a range, one bridging both merges them
+  R_ClipSolidWallSegment(300, 399);
+  assert(newend == solidsegs + 4);
+  assert(R_RangeVisible(100, 399));
+  R_ClipSolidWallSegment(200, 299);
+  assert(newend == solidsegs + 3);
+  assert(!R_RangeVisible(100, 399));
+  
+  // Walls touching the edges join the sentinels until nothing is left open
+  R_ClipSolidWallSegment(0, 99);
+  R_ClipSolidWallSegment(400, CLIPCOLUMNS - 1);
+  assert(R_ClipListFull());
+  assert(!R_RangeVisible(0, CLIPCOLUMNS - 1));
+  
+  printf("PASSED\n");
+}
+
+//
+// Portal windows, copied from draw_portals in floor.c with the projection
+// replaced by a fixed screen rectangle per portal
+//
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+static bool merge_portal_window(float seen[4], float const window[4]) {
+  if (window[0] >= seen[0] && window[1] >= seen[1] &&
+      window[2] <= seen[2] && window[3] <= seen[3])
+    return false;
+  seen[0] = MIN(seen[0], window[0]);
+  seen[1] = MIN(seen[1], window[1]);
+  seen[2] = MAX(seen[2], window[2]);
+  seen[3] = MAX(seen[3], window[3]);
+  return true;
+}
+
+typedef struct {
+  int from, to;
+  float rect[4];
+} test_portal_t;
+
+typedef struct {
+  int sector;
+  float window[4];
+} test_visit_t;
+
+#define MAX_TEST_SECTORS 8
+
+static bool seen[MAX_TEST_SECTORS];
+static float seen_window[MAX_TEST_SECTORS][4];
+
+static int traverse_portals(test_portal_t const *portals, int num_portals) {
+  static float const full_window[4] = { -1, -1, 1, 1 };
+  test_visit_t stack[64];
+  int count = 0, pushes = 0;
+  
+  memset(seen, 0, sizeof(seen));
+  seen[0] = true;
+  memcpy(seen_window[0], full_window, sizeof(full_window));
+  stack[count].sector = 0;
+  memcpy(stack[count++].window, full_window, sizeof(full_window));
+  
+  while (count > 0) {
+    test_visit_t visit = stack[--count];
+    for (int k = 0; k < num_portals; k++) {
+      test_portal_t const *portal = &portals[k];
+      if (portal->from != visit.sector) continue;
+      float window[4] = {
+        MAX(visit.window[0], portal->rect[0]), MAX(visit.window[1], portal->rect[1]),
+        MIN(visit.window[2], portal->rect[2]), MIN(visit.window[3], portal->rect[3]),
+      };
+      if (!(window[0] < window[2] && window[1] < window[3])) continue;
+      if (seen[portal->to]) {
+        if (!merge_portal_window(seen_window[portal->to], window)) continue;
+      } else {
+        seen[portal->to] = true;
+        memcpy(seen_window[portal->to], window, sizeof(window));
+      }
+      assert(count < 64);
+      stack[count].sector = portal->to;
+      memcpy(stack[count++].window, seen_window[portal->to], sizeof(window));
+      pushes++;
+    }
+  }
+  return pushes;
+}
+
+//
+// Test 7: A sector seen through two partly overlapping portals is traversed
+// through their union, so what shows only in the union is not lost
+//
+void test_portal_window_union(void) {
+  printf("Test 7: Portal window union... ");
+  
+  test_portal_t portals[] = {
+    { 0, 1, { -0.8f, -0.8f, 0.2f, 0.0f } },
+    { 0, 1, { -0.2f, -0.2f, 0.8f, 0.8f } },
+    // Inside the union of both windows into 1, but outside each of them
+    { 1, 2, { 0.4f, -0.6f, 0.7f, -0.3f } },
+  };
+  traverse_portals(portals, 3);
+  
+  assert(seen[1]);
+  assert(seen_window[1][0] == -0.8f && seen_window[1][1] == -0.8f);
+  assert(seen_window[1][2] == 0.8f && seen_window[1][3] == 0.8f);
+  assert(seen[2]);
+  assert(seen_window[2][0] == 0.4f && seen_window[2][1] == -0.6f);
+  assert(seen_window[2][2] == 0.7f && seen_window[2][3] == -0.3f);
+  
+  printf("PASSED\n");
+}
+
+//
+// Test 8: A window inside what a sector was already seen through does not
+// traverse it again, and cycles between sectors end
+//
+void test_portal_window_contained(void) {
+  printf("Test 8: Contained portal windows... ");
+  
+  test_portal_t portals[] = {
+    { 0, 1, { -0.5f, -0.5f, 0.5f, 0.5f } },
+    { 0, 1, { -0.2f, -0.2f, 0.2f, 0.2f } },
+    { 1, 0, { -0.4f, -0.4f, 0.4f, 0.4f } },
+    { 1, 2, { -0.9f, -0.1f, 0.9f, 0.1f } },
+    { 2, 1, { -0.9f, -0.1f, 0.9f, 0.1f } },
+  };
+  int pushes = traverse_portals(portals, 5);
+  
+  // 0 -> 1 once, 1 -> 2 once, every way back is already covered
+  assert(pushes == 2);
+  assert(seen[2]);
+  assert(seen_window[2][0] == -0.5f && seen_window[2][2] == 0.5f);
+  
+  printf("PASSED\n");
+}
+
 int main(void) {
   printf("=== Running BSP Traversal Tests ===\n\n");
   
@@ -225,6 +504,9 @@ int main(void) {
   test_point_on_side_diagonal();
   test_bsp_traversal();
   test_consistency();
+  test_clip_solid_segs();
+  test_portal_window_union();
+  test_portal_window_contained();
   
   printf("\n=== All Tests Passed! ===\n");
   
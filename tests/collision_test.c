@@ -2,7 +2,8 @@
  * Collision Detection Tests
  *
  * Tests for the pure geometric helper functions in collision.c:
- *   dist_sq, closest_point_on_line, calc_slide, can_enter_sector
+ *   dist_sq, closest_point_on_line, calc_slide, can_enter_sector,
+ *   sweep_circle_segment, sweep_player
  *
  * These functions have no external dependencies (no OpenGL, no SDL, no cglm),
  * so they can be compiled and tested in isolation.
@@ -82,6 +83,8 @@ typedef struct {
 #define P_RADIUS   12.0f
 #define WALL_DIST  2.0f
 #define EPSILON    0.1f
+#define NO_HIT     2.0f
+#define MIN_APPROACH 1e-4f
 
 // ── Functions under test (copied from collision.c to isolate from map.h) ───
 
@@ -108,7 +111,7 @@ float closest_point_on_line(float point_x, float point_y,
   }
 
   float t = ((point_x - line_x1) * dx + (point_y - line_y1) * dy) / len_sq;
-  t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+  t = fminf(fmaxf(t, 0.0f), 1.0f);
 
   *closest_x = line_x1 + t * dx;
   *closest_y = line_y1 + t * dy;
@@ -149,6 +152,137 @@ bool can_enter_sector(mapsector_t const *current, mapsector_t const *new_sector,
   return true;
 }
 
+float sweep_circle_segment(float x, float y, float dx, float dy, float radius,
+                           float ax, float ay, float bx, float by,
+                           float *nx, float *ny) {
+  float hit = NO_HIT;
+
+  float ex = bx - ax;
+  float ey = by - ay;
+  float len_sq = ex*ex + ey*ey;
+  if (len_sq > EPSILON) {
+    float len = sqrtf(len_sq);
+    float fx = -ey / len;
+    float fy = ex / len;
+    float dist = (x - ax) * fx + (y - ay) * fy;
+    if (dist < 0) {
+      fx = -fx;
+      fy = -fy;
+      dist = -dist;
+    }
+    float approach = -(dx * fx + dy * fy);
+    if (approach > MIN_APPROACH) {
+      float t = fmaxf(0.0f, (dist - radius) / approach);
+      float cx, cy, u;
+      closest_point_on_line(x + dx * t, y + dy * t, ax, ay, bx, by, &cx, &cy, &u);
+      if (t <= 1.0f && u > 0.0f && u < 1.0f) {
+        hit = t;
+        *nx = fx;
+        *ny = fy;
+      }
+    }
+  }
+
+  float move_sq = dx*dx + dy*dy;
+  for (int end = 0; end < 2 && move_sq > 0; end++) {
+    float vx = end ? bx : ax;
+    float vy = end ? by : ay;
+    float b = (x - vx) * dx + (y - vy) * dy;
+    if (b > -MIN_APPROACH) continue;
+    float c = dist_sq(x, y, vx, vy) - radius * radius;
+    float t = 0.0f;
+    if (c > 0) {
+      float disc = b*b - move_sq * c;
+      if (disc < 0) continue;
+      t = (-b - sqrtf(disc)) / move_sq;
+    }
+    if (t > 1.0f || t >= hit) continue;
+    float cx = x + dx * t - vx;
+    float cy = y + dy * t - vy;
+    float d = sqrtf(cx*cx + cy*cy);
+    if (d < EPSILON) continue;
+    hit = t;
+    *nx = cx / d;
+    *ny = cy / d;
+  }
+  return hit;
+}
+
+// Walls gathered once per move, laid out for the sweep loop
+#define MAX_SLIDES 3
+#define MAX_BLOCK_LINES 16
+
+typedef struct {
+  int count;
+  uint16_t line[MAX_BLOCK_LINES];
+  float ax[MAX_BLOCK_LINES], ay[MAX_BLOCK_LINES];
+  float bx[MAX_BLOCK_LINES], by[MAX_BLOCK_LINES];
+  bool solid[MAX_BLOCK_LINES];
+} sweep_lines_t;
+
+// The blockmap query is replaced by a test of each linedef's box against
+// the query box; the box itself is computed as in collision.c
+static void gather_sweep_lines(map_data_t const *map, float x, float y, float mx, float my,
+                               float radius, sweep_lines_t *walls) {
+  float reach = sqrtf(mx*mx + my*my) + radius;
+  walls->count = 0;
+  for (int i = 0; i < map->num_linedefs && walls->count < MAX_BLOCK_LINES; i++) {
+    mapvertex_t const *a = &map->vertices[map->linedefs[i].start];
+    mapvertex_t const *b = &map->vertices[map->linedefs[i].end];
+    if (fmaxf(a->x, b->x) < x - reach || fminf(a->x, b->x) > x + reach ||
+        fmaxf(a->y, b->y) < y - reach || fminf(a->y, b->y) > y + reach)
+      continue;
+    walls->line[walls->count++] = (uint16_t)i;
+  }
+  for (int i = 0; i < walls->count; i++) {
+    maplinedef_t const *line = &map->linedefs[walls->line[i]];
+    walls->ax[i] = map->vertices[line->start].x;
+    walls->ay[i] = map->vertices[line->start].y;
+    walls->bx[i] = map->vertices[line->end].x;
+    walls->by[i] = map->vertices[line->end].y;
+    walls->solid[i] = true;
+  }
+}
+
+static void sweep_player(player_t *player, sweep_lines_t const *walls, float mx, float my) {
+  float radius = P_RADIUS + WALL_DIST;
+
+  for (int slide = 0; slide < MAX_SLIDES; slide++) {
+    float hit = NO_HIT, nx = 0, ny = 0;
+    for (int i = 0; i < walls->count; i++) {
+      if (!walls->solid[i]) continue;
+      float lnx, lny;
+      float t = sweep_circle_segment(player->x, player->y, mx, my, radius,
+                                     walls->ax[i], walls->ay[i], walls->bx[i], walls->by[i],
+                                     &lnx, &lny);
+      if (t < hit) {
+        hit = t;
+        nx = lnx;
+        ny = lny;
+      }
+    }
+
+    if (hit > 1.0f) {
+      player->x += mx;
+      player->y += my;
+      return;
+    }
+
+    float len = sqrtf(mx*mx + my*my);
+    float t = fmaxf(0.0f, hit - EPSILON / len);
+    player->x += mx * t;
+    player->y += my * t;
+    calc_slide(mx * (1.0f - hit), my * (1.0f - hit), nx, ny, &mx, &my);
+
+    float into = mx * nx + my * ny;
+    if (into < 0) {
+      mx -= nx * into;
+      my -= ny * into;
+    }
+    if (mx*mx + my*my < EPSILON) return;
+  }
+}
+
 // ── Test helpers ─────────────────────────────────────────────────────────────
 
 static int tests_passed = 0;
@@ -377,6 +511,94 @@ static void test_can_enter_exact_max_step(void) {
   PASS();
 }
 
+// ── sweep_circle_segment tests ───────────────────────────────────────────────
+
+static void test_sweep_head_on(void) {
+  TEST("sweep_circle_segment: head-on hit stops one radius short");
+  float nx = 0, ny = 0;
+  float t = sweep_circle_segment(0, 0, 100, 0, 14, 50, -100, 50, 100, &nx, &ny);
+  ASSERT(float_eq(t, 0.36f, 1e-4f), "Contact should be at (50 - 14) / 100");
+  ASSERT(float_eq(nx, -1.0f, 1e-4f) && float_eq(ny, 0.0f, 1e-4f),
+         "Normal should face back towards the circle");
+  PASS();
+}
+
+static void test_sweep_no_tunneling(void) {
+  TEST("sweep_circle_segment: fast move hits a thin wall");
+  float nx, ny;
+  float t = sweep_circle_segment(0, 0, 5000, 0, 14, 50, -100, 50, 100, &nx, &ny);
+  ASSERT(t <= 1.0f, "A move far past the wall should still hit it");
+  ASSERT(float_eq(t * 5000, 36.0f, 1e-2f), "Contact should be one radius before the wall");
+  PASS();
+}
+
+static void test_sweep_parallel(void) {
+  TEST("sweep_circle_segment: moving along a wall does not hit");
+  float nx, ny;
+  float t = sweep_circle_segment(0, 20, 100, 0, 14, -50, 0, 200, 0, &nx, &ny);
+  ASSERT(t > 1.0f, "Parallel move should not hit");
+  PASS();
+}
+
+static void test_sweep_moving_away(void) {
+  TEST("sweep_circle_segment: moving away does not hit");
+  float nx, ny;
+  float t = sweep_circle_segment(40, 0, -100, 0, 14, 50, -100, 50, 100, &nx, &ny);
+  ASSERT(t > 1.0f, "Moving away from a touching wall should not hit");
+  PASS();
+}
+
+static void test_sweep_end_hit(void) {
+  TEST("sweep_circle_segment: passing the end of a wall hits its corner");
+  float nx, ny;
+  float t = sweep_circle_segment(0, 0, 100, 0, 14, 50, 10, 50, 100, &nx, &ny);
+  float x = (50.0f - sqrtf(14 * 14 - 10 * 10)) / 100.0f;
+  ASSERT(float_eq(t, x, 1e-4f), "Contact should be where the circle reaches the end");
+  ASSERT(float_eq(nx * nx + ny * ny, 1.0f, 1e-4f) && ny < 0 && nx < 0,
+         "Normal should point from the end back to the circle");
+  PASS();
+}
+
+static void test_sweep_overlap(void) {
+  TEST("sweep_circle_segment: touching and moving closer hits at once");
+  float nx, ny;
+  float t = sweep_circle_segment(40, 0, 10, 0, 14, 50, -100, 50, 100, &nx, &ny);
+  ASSERT(float_eq(t, 0.0f, 1e-6f), "Overlapping move should hit at 0");
+  PASS();
+}
+
+static void test_sweep_out_of_reach(void) {
+  TEST("sweep_circle_segment: wall beyond the move is not hit");
+  float nx, ny;
+  float t = sweep_circle_segment(0, 0, 100, 0, 14, 200, -100, 200, 100, &nx, &ny);
+  ASSERT(t > 1.0f, "Wall past the end of the move should not hit");
+  PASS();
+}
+
+// ── sweep_player tests ───────────────────────────────────────────────────────
+
+static void test_slide_into_wall_past_move(void) {
+  TEST("sweep_player: slide stops at a wall beyond the box around the move");
+  // The move (20, 4) hits x = 20 and slides up towards y = 28, which lies
+  // past the move's own box grown by the radius
+  mapvertex_t vertices[] = { { 20, -100 }, { 20, 100 }, { -100, 28 }, { 19, 28 } };
+  maplinedef_t linedefs[] = { { .start = 0, .end = 1 }, { .start = 2, .end = 3 } };
+  map_data_t map = { .vertices = vertices, .num_vertices = 4,
+                     .linedefs = linedefs, .num_linedefs = 2 };
+  player_t player = { 0 };
+  float radius = P_RADIUS + WALL_DIST;
+
+  sweep_lines_t walls;
+  gather_sweep_lines(&map, player.x, player.y, 20, 4, radius, &walls);
+  ASSERT(walls.count == 2, "Both walls should be within reach of the move");
+
+  sweep_player(&player, &walls, 20, 4);
+  ASSERT(player.x + radius <= 20.0f + 1e-3f, "Should stop at the first wall");
+  ASSERT(player.y > 10.0f, "Should slide along the first wall");
+  ASSERT(player.y + radius <= 28.0f + 1e-3f, "Should stop at the second wall");
+  PASS();
+}
+
 // ── main ─────────────────────────────────────────────────────────────────────
 
 int main(void) {
@@ -410,6 +632,18 @@ int main(void) {
   test_can_enter_step_down();
   test_can_enter_exact_max_step();
 
+  /* sweep_circle_segment */
+  test_sweep_head_on();
+  test_sweep_no_tunneling();
+  test_sweep_parallel();
+  test_sweep_moving_away();
+  test_sweep_end_hit();
+  test_sweep_overlap();
+  test_sweep_out_of_reach();
+
+  /* sweep_player */
+  test_slide_into_wall_past_move();
+
   printf("\n=== Test Results ===\n");
   printf("Passed: %d/%d\n", tests_passed, tests_total);
 
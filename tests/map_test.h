@@ -22,7 +22,126 @@ typedef struct {
   int8_t nx;
   int8_t ny;
   int8_t nz;
+  uint16_t surface;
   uint8_t color[4];
 } wall_vertex_t;
 
+#ifndef MIN
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+#endif
+
+#define DEFINE_COLLECTION(type, name) \
+type* name;                   \
+int num_##name
+
+#define CLEAR_COLLECTION(map, name) \
+if ((map)->name) free((map)->name); \
+(map)->name = NULL;               \
+(map)->num_##name = 0
+
+// Minimal types needed for node building
+enum {
+  BOXTOP,
+  BOXBOTTOM,
+  BOXLEFT,
+  BOXRIGHT
+};
+
+typedef struct {
+  uint16_t start;
+  uint16_t end;
+  uint16_t flags;
+  uint16_t special;
+  uint16_t tag;
+  uint16_t sidenum[2];
+} maplinedef_t;
+
+typedef struct {
+  uint16_t sector;
+} mapsidedef_t;
+
+typedef struct {
+  int16_t floorheight;
+  int16_t ceilingheight;
+} mapsector_t;
+
+typedef struct {
+  uint16_t v1;
+  uint16_t v2;
+  uint16_t angle;
+  uint16_t linedef;
+  uint16_t side;
+  uint16_t offset;
+} mapseg_t;
+
+typedef struct {
+  uint16_t numsegs;
+  uint16_t firstseg;
+} mapsubsector_t;
+
+#define NF_SUBSECTOR 0x8000
+
+typedef struct {
+  uint16_t sector;
+  uint16_t inside;
+  uint32_t first_line;
+} mapcellsector_t;
+
+typedef struct {
+  int16_t x;
+  int16_t y;
+  int16_t dx;
+  int16_t dy;
+  int16_t bbox[2][4];
+  uint16_t children[2];
+} mapnode_t;
+
+typedef struct {
+  DEFINE_COLLECTION(mapvertex_t, vertices);
+  DEFINE_COLLECTION(maplinedef_t, linedefs);
+  DEFINE_COLLECTION(mapsidedef_t, sidedefs);
+  DEFINE_COLLECTION(mapsector_t, sectors);
+  DEFINE_COLLECTION(mapseg_t, segs);
+  DEFINE_COLLECTION(mapsubsector_t, subsectors);
+  DEFINE_COLLECTION(mapnode_t, nodes);
+  DEFINE_COLLECTION(mapvertex_t, node_vertices);
+  struct {
+    int16_t x, y;
+    int width, height;
+    uint32_t *cell_start;
+    uint16_t *lines;
+    uint32_t *line_stamps;
+    bool *corners;
+    int num_corners;
+    uint32_t *sector_start;
+    mapcellsector_t *sectors;
+    uint16_t *sector_lines;
+    bool *open_sectors;
+    uint16_t *open_list;
+    int num_open;
+    int num_linedefs, num_sidedefs, num_sectors;
+  } blockmap;
+} map_data_t;
+
+#define BLOCKSIZE 128
+
+typedef enum {
+  NODEBUILD_FAST,
+  NODEBUILD_THOROUGH,
+} nodebuild_mode_t;
+
+void parallel_for(int count, void (*job)(int index, void *parm), void *parm);
+int get_num_workers(void);
+bool build_map_nodes(map_data_t *map, nodebuild_mode_t mode);
+void build_blockmap(map_data_t *map);
+void free_blockmap(map_data_t *map);
+int get_blockmap_lines(map_data_t const *map, float x1, float y1, float x2, float y2,
+                       uint16_t *lines, int max_lines);
+int get_blockmap_sectors(map_data_t const *map, int x, int y, uint16_t *sectors, int max_sectors);
+int blockmap_point_in_sector(map_data_t const *map, int x, int y, int sector);
+bool scan_point_in_sector(map_data_t const *map, int x, int y, int sector);
+
 #endif
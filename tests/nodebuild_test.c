@@ -0,0 +1,215 @@
+/*
+ * Node Builder Tests
+ *
+ * Builds nodes for small generated maps with mapview/nodebuild.c and checks
+ * the output the way the BSP renderer relies on it:
+ *   - every child reference is in range and points below its parent
+ *   - every subsector is convex
+ *   - every linedef side ends up in at least one seg
+ */
+
+#include <tests/map_test.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+
+static void add_line(map_data_t *map, int x1, int y1, int x2, int y2, bool two_sided) {
+  int v = map->num_vertices;
+  map->vertices = realloc(map->vertices, sizeof(mapvertex_t) * (v + 2));
+  map->vertices[v] = (mapvertex_t){ x1, y1 };
+  map->vertices[v + 1] = (mapvertex_t){ x2, y2 };
+  map->num_vertices += 2;
+
+  int s = map->num_sidedefs;
+  map->sidedefs = realloc(map->sidedefs, sizeof(mapsidedef_t) * (s + 2));
+  map->sidedefs[s] = (mapsidedef_t){ 0 };
+  map->sidedefs[s + 1] = (mapsidedef_t){ 0 };
+  map->num_sidedefs += two_sided ? 2 : 1;
+
+  map->linedefs = realloc(map->linedefs, sizeof(maplinedef_t) * (map->num_linedefs + 1));
+  map->linedefs[map->num_linedefs++] = (maplinedef_t){
+    .start = v,
+    .end = v + 1,
+    .sidenum = { s, two_sided ? s + 1 : 0xFFFF },
+  };
+}
+
+// Clockwise box, so the front sides face inwards
+static void add_room(map_data_t *map, int x1, int y1, int x2, int y2) {
+  add_line(map, x1, y1, x1, y2, false);
+  add_line(map, x1, y2, x2, y2, false);
+  add_line(map, x2, y2, x2, y1, false);
+  add_line(map, x2, y1, x1, y1, false);
+}
+
+// Counter-clockwise box, so the front sides face outwards
+static void add_pillar(map_data_t *map, int x1, int y1, int x2, int y2) {
+  add_line(map, x1, y1, x2, y1, false);
+  add_line(map, x2, y1, x2, y2, false);
+  add_line(map, x2, y2, x1, y2, false);
+  add_line(map, x1, y2, x1, y1, false);
+}
+
+static void free_map(map_data_t *map) {
+  CLEAR_COLLECTION(map, vertices);
+  CLEAR_COLLECTION(map, linedefs);
+  CLEAR_COLLECTION(map, sidedefs);
+  CLEAR_COLLECTION(map, segs);
+  CLEAR_COLLECTION(map, subsectors);
+  CLEAR_COLLECTION(map, nodes);
+  CLEAR_COLLECTION(map, node_vertices);
+}
+
+static double seg_side(map_data_t const *map, mapseg_t const *line, mapvertex_t const *v) {
+  mapvertex_t const *a = &map->node_vertices[line->v1];
+  mapvertex_t const *b = &map->node_vertices[line->v2];
+  double dx = b->x - a->x, dy = b->y - a->y;
+  return (dy * (v->x - a->x) - dx * (v->y - a->y)) / sqrt(dx * dx + dy * dy);
+}
+
+static void check_child(map_data_t const *map, int parent, uint16_t child) {
+  if (child & NF_SUBSECTOR) {
+    assert((child & ~NF_SUBSECTOR) < map->num_subsectors);
+  } else {
+    assert(child < parent);
+  }
+}
+
+static void check_nodes(map_data_t const *map) {
+  for (int i = 0; i < map->num_nodes; i++) {
+    check_child(map, i, map->nodes[i].children[0]);
+    check_child(map, i, map->nodes[i].children[1]);
+  }
+
+  // No seg of a subsector lies behind another one's line; split points
+  // are rounded, so allow a unit of slack
+  for (int i = 0; i < map->num_subsectors; i++) {
+    mapsubsector_t const *sub = &map->subsectors[i];
+    assert(sub->numsegs > 0);
+    assert(sub->firstseg + sub->numsegs <= map->num_segs);
+    for (int j = 0; j < sub->numsegs; j++) {
+      mapseg_t const *line = &map->segs[sub->firstseg + j];
+      for (int k = 0; k < sub->numsegs; k++) {
+        mapseg_t const *other = &map->segs[sub->firstseg + k];
+        assert(seg_side(map, line, &map->node_vertices[other->v1]) > -1.0);
+        assert(seg_side(map, line, &map->node_vertices[other->v2]) > -1.0);
+      }
+    }
+  }
+
+  bool *seen = calloc(map->num_linedefs * 2, sizeof(bool));
+  for (int i = 0; i < map->num_segs; i++) {
+    mapseg_t const *seg = &map->segs[i];
+    assert(seg->v1 < map->num_node_vertices && seg->v2 < map->num_node_vertices);
+    assert(seg->linedef < map->num_linedefs && seg->side < 2);
+    seen[seg->linedef * 2 + seg->side] = true;
+  }
+  for (int i = 0; i < map->num_linedefs; i++) {
+    assert(seen[i * 2]);
+    assert(seen[i * 2 + 1] == (map->linedefs[i].sidenum[1] != 0xFFFF));
+  }
+  free(seen);
+}
+
+// Test 1: A box is convex and needs no nodes
+static void test_convex_room(void) {
+  printf("Test 1: Convex room... ");
+
+  map_data_t map = { 0 };
+  add_room(&map, 0, 0, 256, 256);
+  assert(build_map_nodes(&map, NODEBUILD_FAST));
+  assert(map.num_nodes == 0);
+  assert(map.num_subsectors == 1);
+  assert(map.num_segs == 4);
+  assert(map.num_node_vertices == map.num_vertices);
+  check_nodes(&map);
+  free_map(&map);
+
+  printf("PASSED\n");
+}
+
+// Test 2: A pillar makes the room concave and gets partitioned around
+static void test_room_with_pillar(void) {
+  printf("Test 2: Room with pillar... ");
+
+  map_data_t map = { 0 };
+  add_room(&map, 0, 0, 512, 512);
+  add_pillar(&map, 192, 192, 320, 320);
+  assert(build_map_nodes(&map, NODEBUILD_FAST));
+  assert(map.num_nodes > 0);
+  assert(map.num_subsectors == map.num_nodes + 1);
+  check_nodes(&map);
+  free_map(&map);
+
+  printf("PASSED\n");
+}
+
+// Test 3: Partitions crossing a diagonal wall split it at a new vertex
+static void test_split_segs(void) {
+  printf("Test 3: Split segs... ");
+
+  map_data_t map = { 0 };
+  add_room(&map, 0, 0, 512, 512);
+  add_pillar(&map, 64, 64, 128, 128);
+  add_pillar(&map, 384, 384, 448, 448);
+  add_line(&map, 100, 300, 300, 100, true);
+  assert(build_map_nodes(&map, NODEBUILD_THOROUGH));
+  check_nodes(&map);
+  // Vertices of the map are kept in place ahead of the split points
+  assert(map.num_node_vertices >= map.num_vertices);
+  assert(!memcmp(map.node_vertices, map.vertices, sizeof(mapvertex_t) * map.num_vertices));
+  free_map(&map);
+
+  printf("PASSED\n");
+}
+
+// Test 4: A field of pillars is large enough to score candidates on threads
+static void test_pillar_field(void) {
+  printf("Test 4: Pillar field in both modes... ");
+
+  for (int mode = NODEBUILD_FAST; mode <= NODEBUILD_THOROUGH; mode++) {
+    map_data_t map = { 0 };
+    add_room(&map, 0, 0, 4096, 4096);
+    for (int y = 0; y < 12; y++) {
+      for (int x = 0; x < 12; x++) {
+        add_pillar(&map, 128 + x * 320, 128 + y * 320, 192 + x * 320, 224 + y * 320);
+      }
+    }
+    assert(build_map_nodes(&map, mode));
+    check_nodes(&map);
+    free_map(&map);
+  }
+
+  printf("PASSED\n");
+}
+
+// Test 5: Rebuilding replaces the previous nodes
+static void test_rebuild(void) {
+  printf("Test 5: Rebuild after an edit... ");
+
+  map_data_t map = { 0 };
+  add_room(&map, 0, 0, 512, 512);
+  assert(build_map_nodes(&map, NODEBUILD_FAST));
+  assert(map.num_nodes == 0);
+  add_pillar(&map, 192, 192, 320, 320);
+  assert(build_map_nodes(&map, NODEBUILD_FAST));
+  assert(map.num_nodes > 0);
+  check_nodes(&map);
+  free_map(&map);
+
+  printf("PASSED\n");
+}
+
+int main(void) {
+  printf("=== Running Node Builder Tests ===\n\n");
+
+  test_convex_room();
+  test_room_with_pillar();
+  test_split_segs();
+  test_pillar_field();
+  test_rebuild();
+
+  printf("\n=== All Tests Passed! ===\n");
+
+  return 0;
+}
@@ -6,6 +6,8 @@
  *   - Pitch clamping (kept in –89 to +89)
  *   - Velocity clamping (speed capped at MAX_SPEED)
  *   - Friction / deceleration (speed reduced toward 0 without going negative)
+ *   - Fixed-rate tic clock (tics due and interpolation fraction)
+ *   - Look turning per frame at a rate set by the tic rate
  *
  * These are pure floating-point calculations with no external dependencies,
  * so they can be exercised entirely in isolation.
@@ -24,6 +26,7 @@
 #define MAX_SPEED    300.0f
 #define ACCELERATION 1000.0f
 #define FRICTION     1200.0f
+#define TICRATE      35
 
 // ── Pure-math helpers extracted from game_tick() in input.c ──────────────────
 
@@ -64,6 +67,21 @@ static void apply_friction(float *vx, float *vy, float friction, float dt) {
   *vy *= scale;
 }
 
+/* Tics due after elapsed milliseconds of the simulation clock. */
+static uint32_t tics_elapsed(uint32_t elapsed) {
+  return (uint32_t)((uint64_t)elapsed * TICRATE / 1000);
+}
+
+/* How far the clock is into the tic after the last one due, from 0 to 1. */
+static float tic_fraction(uint32_t elapsed) {
+  return (float)((uint64_t)elapsed * TICRATE % 1000) / 1000.0f;
+}
+
+/* Degrees a look axis turns the view in ms, one step of it per tic. */
+static float look_turn(float axis, float sensitivity, uint32_t ms) {
+  return axis * sensitivity * TICRATE * ms / 1000.0f;
+}
+
 // ── Test helpers ─────────────────────────────────────────────────────────────
 
 static int tests_passed = 0;
@@ -256,6 +274,88 @@ static void test_friction_preserves_direction(void) {
 
 // ── main ─────────────────────────────────────────────────────────────────────
 
+// ── Tic clock tests ──────────────────────────────────────────────────────────
+
+static void test_tics_per_second(void) {
+  TEST("tics_elapsed: one second holds TICRATE tics");
+  ASSERT(tics_elapsed(0) == 0, "No tics at the start");
+  ASSERT(tics_elapsed(1000) == TICRATE, "TICRATE tics after a second");
+  ASSERT(tics_elapsed(60000) == 60 * TICRATE, "No drift over a minute");
+  PASS();
+}
+
+static void test_tic_boundary(void) {
+  TEST("tics_elapsed: first tic falls due after 1000 / TICRATE ms");
+  ASSERT(tics_elapsed(28) == 0, "28 ms is short of a 35 Hz tic");
+  ASSERT(tics_elapsed(29) == 1, "29 ms completes the first 35 Hz tic");
+  PASS();
+}
+
+static void test_tic_clock_wraps(void) {
+  TEST("tics_elapsed: clock wrapping past 2^32 ms keeps counting");
+  uint32_t start = 0xFFFFFF00u;
+  uint32_t now = start + 1000;
+  ASSERT(now < start, "Clock should have wrapped");
+  ASSERT(tics_elapsed(now - start) == TICRATE, "Elapsed time survives the wrap");
+  PASS();
+}
+
+static void test_tic_fraction(void) {
+  TEST("tic_fraction: runs from 0 to 1 within a tic");
+  ASSERT(float_eq(tic_fraction(0), 0.0f, 1e-6f), "Tic boundary is 0");
+  ASSERT(float_eq(tic_fraction(1000), 0.0f, 1e-6f), "Whole second is a boundary");
+  ASSERT(float_eq(tic_fraction(20), 0.7f, 1e-6f), "20 ms is 0.7 of a 35 Hz tic");
+  ASSERT(tic_fraction(28) > 0.9f && tic_fraction(28) < 1.0f, "Just before a tic is almost 1");
+  PASS();
+}
+
+static void test_tics_independent_of_paints(void) {
+  TEST("tics_elapsed: paint rate does not change the simulation");
+  int intervals[] = { 1, 4, 10, 25, 100, 200 };
+  float result = -1.0f;
+  for (int i = 0; i < 6; i++) {
+    float vx = 300.0f, vy = 0.0f;
+    uint32_t done = 0;
+    for (uint32_t t = 0; t <= 200; t += intervals[i]) {
+      for (uint32_t due = tics_elapsed(t); done != due; done++) {
+        apply_friction(&vx, &vy, FRICTION, 1.0f / TICRATE);
+      }
+    }
+    if (result < 0) result = vx;
+    ASSERT(vx == result, "Every paint rate should end with the same velocity");
+  }
+  ASSERT(result > 0.0f && result < 300.0f, "Friction should have slowed the player");
+  PASS();
+}
+
+// ── Look tests ───────────────────────────────────────────────────────────────
+
+static void test_look_turns_every_frame(void) {
+  TEST("look_turn: view turns on every frame, not only on tics");
+  // At 120 fps most frames run no tic, yet each should still turn
+  ASSERT(tics_elapsed(8) == 0, "An 8 ms frame runs no tic");
+  ASSERT(look_turn(10.0f, 0.1f, 8) > 0.0f, "An 8 ms frame should still turn");
+  ASSERT(float_eq(look_turn(10.0f, 0.1f, 1000), 10.0f * 0.1f * TICRATE, 1e-4f),
+         "A second turns one axis step per tic");
+  PASS();
+}
+
+static void test_look_independent_of_paints(void) {
+  TEST("look_turn: paint rate does not change how far the view turns");
+  int intervals[] = { 1, 4, 10, 25, 100, 200 };
+  for (int i = 0; i < 6; i++) {
+    float angle = 0.0f;
+    uint32_t last = 0;
+    for (uint32_t t = intervals[i]; t <= 200; t += intervals[i]) {
+      angle += look_turn(10.0f, 0.1f, t - last);
+      last = t;
+    }
+    ASSERT(float_eq(angle, look_turn(10.0f, 0.1f, 200), 1e-3f),
+           "Every paint rate should turn the same amount");
+  }
+  PASS();
+}
+
 int main(void) {
   printf("\n=== Running Player Physics Tests ===\n");
 
@@ -285,6 +385,17 @@ int main(void) {
   test_friction_stationary_object();
   test_friction_preserves_direction();
 
+  /* Tic clock */
+  test_tics_per_second();
+  test_tic_boundary();
+  test_tic_clock_wraps();
+  test_tic_fraction();
+  test_tics_independent_of_paints();
+
+  /* Look */
+  test_look_turns_every_frame();
+  test_look_independent_of_paints();
+
   printf("\n=== Test Results ===\n");
   printf("Passed: %d/%d\n", tests_passed, tests_total);
 
@@ -4,7 +4,8 @@
  * Tests for WAD file parsing logic that can be exercised without a real
  * WAD file on disk:
  *   - is_map_block_valid  (lump-sequence validation)
- *   - find_lump / find_lump_num style name matching
+ *   - find_lump / find_lump_num hashed name lookup and namespaces
+ *   - lump_view_has (bounds checks on mapped lump views)
  *   - WAD header and directory structure layout
  */
 
@@ -14,6 +15,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <ctype.h>
+#include <limits.h>
 
 // ── Minimal type stubs ──────────────────────────────────────────────────────
 
@@ -33,6 +36,12 @@ typedef struct {
 
 // ── Functions under test (copied from wad.c to isolate from map.h) ──────────
 
+bool is_wad_directory_valid(wadheader_t const *header, size_t file_size, int num_loaded) {
+  if (header->numlumps > (uint32_t)(INT_MAX - num_loaded)) return false;
+  uint64_t end = (uint64_t)header->infotableofs + (uint64_t)header->numlumps * sizeof(filelump_t);
+  return end <= file_size;
+}
+
 bool is_map_block_valid(filelump_t *dir, int index, int total_lumps) {
   static const char *expected[] = {
     "THINGS", "LINEDEFS", "SIDEDEFS", "VERTEXES",
@@ -45,14 +54,156 @@ bool is_map_block_valid(filelump_t *dir, int index, int total_lumps) {
   return true;
 }
 
-static int find_lump_num_impl(filelump_t const *dir, int num_lumps, const char *name) {
+typedef enum {
+  NS_GLOBAL,
+  NS_SPRITES,
+  NS_FLATS,
+  NS_PATCHES,
+} lumpns_t;
+
+// Hash index over the lump directory. Names are packed into a 64-bit key,
+// each bucket holds the newest lump with that name and next[] chains back
+// to older lumps of the same name, so "last lump wins" lookups are O(1)
+// and namespace-scoped lookups only walk same-named lumps.
+typedef struct {
+  uint64_t *keys;
+  int32_t *next;
+  uint8_t *ns;
+  int32_t *buckets;
+  uint32_t mask;
+} lumpindex_t;
+
+static uint64_t lump_key(const char *name) {
+  uint64_t key = 0;
+  for (int i = 0; i < 8 && name[i]; i++) {
+    key |= (uint64_t)(uint8_t)toupper((uint8_t)name[i]) << (i * 8);
+  }
+  return key;
+}
+
+static uint32_t lump_hash(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return (uint32_t)key;
+}
+
+#define MAX_MARKER_DEPTH 8  // deeper blocks share the namespace of the 8th
+
+static lumpns_t marker_namespace(const char *name) {
+  switch (toupper((uint8_t)name[0])) {
+    case 'S': return NS_SPRITES;
+    case 'F': return NS_FLATS;
+    case 'P': return NS_PATCHES;
+    default: return NS_GLOBAL;
+  }
+}
+
+static bool is_marker_suffix(const char *name, const char *suffix) {
+  char const *underscore = memchr(name, '_', 8);
+  if (!underscore || underscore - name > 2) return false;
+  return strncmp(underscore, suffix, 8 - (underscore - name)) == 0;
+}
+
+static void free_lump_index(lumpindex_t *index) {
+  free(index->keys);
+  free(index->next);
+  free(index->ns);
+  free(index->buckets);
+  memset(index, 0, sizeof(lumpindex_t));
+}
+
+static bool build_lump_index(lumpindex_t *index, filelump_t const *dir, int num_lumps) {
+  uint32_t num_buckets = 16;
+  while (num_buckets < (uint32_t)num_lumps * 2) num_buckets <<= 1;
+  
+  index->keys = malloc(sizeof(uint64_t) * (num_lumps + 1));
+  index->next = malloc(sizeof(int32_t) * (num_lumps + 1));
+  index->ns = malloc(sizeof(uint8_t) * (num_lumps + 1));
+  index->buckets = malloc(sizeof(int32_t) * num_buckets);
+  index->mask = num_buckets - 1;
+  if (!index->keys || !index->next || !index->ns || !index->buckets) {
+    free_lump_index(index);
+    return false;
+  }
+  memset(index->buckets, 0xff, sizeof(int32_t) * num_buckets);
+  
+  // Blocks nest: F1_START..F1_END sits inside F_START..F_END, so an end
+  // marker returns to the block that was open before its start marker
+  lumpns_t open[MAX_MARKER_DEPTH];
+  int depth = 0;
   for (int i = 0; i < num_lumps; i++) {
-    if (strncmp(dir[i].name, name, sizeof(lumpname_t)) == 0)
-      return i;
+    char const *name = dir[i].name;
+    uint64_t key = lump_key(name);
+    index->keys[i] = key;
+    index->next[i] = -1;
+    
+    // Markers themselves stay global so they can still be found by name
+    if (is_marker_suffix(name, "_START")) {
+      if (depth < MAX_MARKER_DEPTH) open[depth] = marker_namespace(name);
+      depth++;
+      index->ns[i] = NS_GLOBAL;
+    } else if (is_marker_suffix(name, "_END")) {
+      if (depth > 0) depth--;
+      index->ns[i] = NS_GLOBAL;
+    } else if (depth > 0) {
+      index->ns[i] = open[(depth < MAX_MARKER_DEPTH ? depth : MAX_MARKER_DEPTH) - 1];
+    } else {
+      index->ns[i] = NS_GLOBAL;
+    }
+    
+    // Later lumps shadow earlier ones with the same name
+    uint32_t slot = lump_hash(key) & index->mask;
+    while (index->buckets[slot] >= 0 && index->keys[index->buckets[slot]] != key) {
+      slot = (slot + 1) & index->mask;
+    }
+    index->next[i] = index->buckets[slot];
+    index->buckets[slot] = i;
+  }
+  return true;
+}
+
+// Returns the newest lump with the given name, restricted to one namespace
+// unless ns is negative
+static int lookup_lump(lumpindex_t const *index, const char *name, int ns) {
+  if (!index->buckets) return -1;
+  uint64_t key = lump_key(name);
+  uint32_t slot = lump_hash(key) & index->mask;
+  while (index->buckets[slot] >= 0) {
+    int i = index->buckets[slot];
+    if (index->keys[i] == key) {
+      for (; i >= 0; i = index->next[i]) {
+        if (ns < 0 || index->ns[i] == ns) return i;
+      }
+      return -1;
+    }
+    slot = (slot + 1) & index->mask;
   }
   return -1;
 }
 
+static int find_lump_ns_impl(filelump_t const *dir, int num_lumps, const char *name, int ns) {
+  lumpindex_t index = {0};
+  if (num_lumps > 0 && !build_lump_index(&index, dir, num_lumps)) return -1;
+  int result = lookup_lump(&index, name, ns);
+  free_lump_index(&index);
+  return result;
+}
+
+static int find_lump_num_impl(filelump_t const *dir, int num_lumps, const char *name) {
+  return find_lump_ns_impl(dir, num_lumps, name, -1);
+}
+
+typedef struct {
+  uint8_t const *data;
+  uint32_t size;
+  int lump;
+} lumpview_t;
+
+bool lump_view_has(lumpview_t const *view, uint32_t offset, uint32_t length) {
+  return view->data && offset <= view->size && length <= view->size - offset;
+}
+
 // ── Test helpers ─────────────────────────────────────────────────────────────
 
 static int tests_passed = 0;
@@ -205,8 +356,8 @@ static void test_find_lump_not_found(void) {
   PASS();
 }
 
-static void test_find_lump_first_match(void) {
-  TEST("find_lump_num: returns first matching lump when duplicates exist");
+static void test_find_lump_last_match(void) {
+  TEST("find_lump_num: returns last matching lump when duplicates exist");
   filelump_t dir[4];
   memset(dir, 0, sizeof(dir));
   set_lump_name(&dir[0], "FLAT1");
@@ -214,8 +365,8 @@ static void test_find_lump_first_match(void) {
   set_lump_name(&dir[2], "FLAT1");  // duplicate
   set_lump_name(&dir[3], "FLAT3");
 
-  ASSERT(find_lump_num_impl(dir, 4, "FLAT1") == 0,
-         "Should return first occurrence of duplicate lump");
+  ASSERT(find_lump_num_impl(dir, 4, "FLAT1") == 2,
+         "Should return last occurrence of duplicate lump");
   PASS();
 }
 
@@ -238,6 +389,143 @@ static void test_find_lump_8char_name(void) {
   PASS();
 }
 
+static void test_find_lump_case_insensitive(void) {
+  TEST("find_lump_num: lookup ignores case");
+  filelump_t dir[2];
+  memset(dir, 0, sizeof(dir));
+  set_lump_name(&dir[0], "PLAYPAL");
+  set_lump_name(&dir[1], "SKY1");
+
+  ASSERT(find_lump_num_impl(dir, 2, "sky1") == 1, "Lowercase query should match");
+  PASS();
+}
+
+static void test_find_lump_many(void) {
+  TEST("find_lump_num: every lump of a large directory is found");
+  enum { COUNT = 5000 };
+  filelump_t *dir = calloc(COUNT, sizeof(filelump_t));
+  char name[16];
+  for (int i = 0; i < COUNT; i++) {
+    snprintf(name, sizeof(name), "L%05d", i);
+    set_lump_name(&dir[i], name);
+  }
+  for (int i = 0; i < COUNT; i++) {
+    snprintf(name, sizeof(name), "L%05d", i);
+    if (find_lump_num_impl(dir, COUNT, name) != i) {
+      free(dir);
+      ASSERT(0, name);
+    }
+  }
+  free(dir);
+  PASS();
+}
+
+static void test_find_lump_namespace(void) {
+  TEST("find_lump_num_ns: lookup is scoped to marker namespace");
+  filelump_t dir[8];
+  memset(dir, 0, sizeof(dir));
+  set_lump_name(&dir[0], "S_START");
+  set_lump_name(&dir[1], "TROOA1");
+  set_lump_name(&dir[2], "S_END");
+  set_lump_name(&dir[3], "FF_START");
+  set_lump_name(&dir[4], "FLOOR4_8");
+  set_lump_name(&dir[5], "TROOA1");
+  set_lump_name(&dir[6], "FF_END");
+  set_lump_name(&dir[7], "FLOOR4_8");
+
+  ASSERT(find_lump_ns_impl(dir, 8, "TROOA1", NS_SPRITES) == 1,
+         "Sprite lookup should skip the newer lump in the flat namespace");
+  ASSERT(find_lump_ns_impl(dir, 8, "TROOA1", -1) == 5,
+         "Unscoped lookup should return the newest lump");
+  ASSERT(find_lump_ns_impl(dir, 8, "FLOOR4_8", NS_FLATS) == 4,
+         "Flat lookup should skip the newer global lump");
+  ASSERT(find_lump_ns_impl(dir, 8, "FLOOR4_8", NS_GLOBAL) == 7,
+         "Global lookup should find the lump outside markers");
+  ASSERT(find_lump_ns_impl(dir, 8, "FLOOR4_8", NS_SPRITES) == -1,
+         "Name absent from a namespace should return -1");
+  ASSERT(find_lump_ns_impl(dir, 8, "S_START", -1) == 0,
+         "Markers should still be found by name");
+  PASS();
+}
+
+static void test_find_lump_nested_namespace(void) {
+  TEST("find_lump_num_ns: inner end marker returns to the outer namespace");
+  filelump_t dir[9];
+  memset(dir, 0, sizeof(dir));
+  set_lump_name(&dir[0], "F_START");
+  set_lump_name(&dir[1], "F1_START");
+  set_lump_name(&dir[2], "FLOOR0_1");
+  set_lump_name(&dir[3], "F1_END");
+  set_lump_name(&dir[4], "NUKAGE1");
+  set_lump_name(&dir[5], "F_END");
+  set_lump_name(&dir[6], "P_START");
+  set_lump_name(&dir[7], "P_END");
+  set_lump_name(&dir[8], "TITLEPIC");
+
+  ASSERT(find_lump_ns_impl(dir, 9, "FLOOR0_1", NS_FLATS) == 2,
+         "Flat in the inner block should be in the flat namespace");
+  ASSERT(find_lump_ns_impl(dir, 9, "NUKAGE1", NS_FLATS) == 4,
+         "Flat after F1_END should stay in the flat namespace");
+  ASSERT(find_lump_ns_impl(dir, 9, "NUKAGE1", NS_GLOBAL) == -1,
+         "Flat after F1_END should not fall back to global");
+  ASSERT(find_lump_ns_impl(dir, 9, "TITLEPIC", NS_GLOBAL) == 8,
+         "Lump after the outer end marker should be global");
+  PASS();
+}
+
+static void test_find_lump_pwad_stack(void) {
+  TEST("find_lump_num_ns: PWAD appended after IWAD overrides and merges namespaces");
+  /* Merged directory: IWAD lumps first, then the PWAD's */
+  filelump_t dir[9];
+  memset(dir, 0, sizeof(dir));
+  set_lump_name(&dir[0], "PLAYPAL");
+  set_lump_name(&dir[1], "S_START");
+  set_lump_name(&dir[2], "TROOA1");
+  set_lump_name(&dir[3], "POSSA1");
+  set_lump_name(&dir[4], "S_END");
+  set_lump_name(&dir[5], "PLAYPAL");
+  set_lump_name(&dir[6], "SS_START");
+  set_lump_name(&dir[7], "TROOA1");
+  set_lump_name(&dir[8], "SS_END");
+
+  ASSERT(find_lump_num_impl(dir, 9, "PLAYPAL") == 5, "PWAD PLAYPAL should win");
+  ASSERT(find_lump_ns_impl(dir, 9, "TROOA1", NS_SPRITES) == 7,
+         "PWAD sprite should replace the IWAD sprite");
+  ASSERT(find_lump_ns_impl(dir, 9, "POSSA1", NS_SPRITES) == 3,
+         "IWAD sprite not in the PWAD should stay visible");
+  PASS();
+}
+
+// ── Lump view bounds tests ───────────────────────────────────────────────────
+
+static void test_lump_view_in_bounds(void) {
+  TEST("lump_view_has: ranges inside the lump are accepted");
+  uint8_t bytes[16] = {0};
+  lumpview_t view = { bytes, sizeof(bytes), 0 };
+  ASSERT(lump_view_has(&view, 0, 16), "Whole lump should be readable");
+  ASSERT(lump_view_has(&view, 12, 4), "Tail of lump should be readable");
+  ASSERT(lump_view_has(&view, 16, 0), "Empty range at end should be readable");
+  PASS();
+}
+
+static void test_lump_view_out_of_bounds(void) {
+  TEST("lump_view_has: ranges past the end are rejected");
+  uint8_t bytes[16] = {0};
+  lumpview_t view = { bytes, sizeof(bytes), 0 };
+  ASSERT(!lump_view_has(&view, 13, 4), "Range crossing the end should fail");
+  ASSERT(!lump_view_has(&view, 17, 0), "Offset past the end should fail");
+  ASSERT(!lump_view_has(&view, 8, UINT32_MAX), "Huge length must not wrap around");
+  ASSERT(!lump_view_has(&view, UINT32_MAX, 2), "Huge offset must not wrap around");
+  PASS();
+}
+
+static void test_lump_view_empty(void) {
+  TEST("lump_view_has: missing lump has no readable bytes");
+  lumpview_t view = { NULL, 0, -1 };
+  ASSERT(!lump_view_has(&view, 0, 0), "View without data should fail");
+  PASS();
+}
+
 // ── WAD header structure tests ───────────────────────────────────────────────
 
 static void test_wadheader_size(void) {
@@ -275,6 +563,34 @@ static void test_wadheader_identification_pwad(void) {
   PASS();
 }
 
+// ── Directory bounds tests ───────────────────────────────────────────────────
+
+static void test_directory_fits(void) {
+  TEST("is_wad_directory_valid: directory ending at end of file is accepted");
+  wadheader_t hdr = { "PWAD", 4, 100 };
+  ASSERT(is_wad_directory_valid(&hdr, 100 + 4 * 16, 0), "Directory at end of file should fit");
+  ASSERT(is_wad_directory_valid(&hdr, 1000, 2000), "Lumps already loaded should not matter");
+  PASS();
+}
+
+static void test_directory_past_end(void) {
+  TEST("is_wad_directory_valid: directory past end of file is rejected");
+  wadheader_t hdr = { "PWAD", 4, 100 };
+  ASSERT(!is_wad_directory_valid(&hdr, 100 + 4 * 16 - 1, 0), "Directory one byte short should fail");
+  hdr.infotableofs = UINT32_MAX;
+  ASSERT(!is_wad_directory_valid(&hdr, 1000, 0), "Huge offset must not wrap around");
+  PASS();
+}
+
+static void test_directory_negative_count(void) {
+  TEST("is_wad_directory_valid: negative or huge lump count is rejected");
+  wadheader_t hdr = { "PWAD", (uint32_t)-5, 12 };
+  ASSERT(!is_wad_directory_valid(&hdr, SIZE_MAX, 0), "Negative count should fail");
+  hdr.numlumps = INT_MAX;
+  ASSERT(!is_wad_directory_valid(&hdr, SIZE_MAX, 10), "Count overflowing the merged directory should fail");
+  PASS();
+}
+
 // ── main ─────────────────────────────────────────────────────────────────────
 
 int main(void) {
@@ -292,9 +608,21 @@ int main(void) {
   /* find_lump_num */
   test_find_lump_found();
   test_find_lump_not_found();
-  test_find_lump_first_match();
+  test_find_lump_last_match();
   test_find_lump_empty_directory();
   test_find_lump_8char_name();
+  test_find_lump_case_insensitive();
+  test_find_lump_many();
+
+  /* find_lump_num_ns */
+  test_find_lump_namespace();
+  test_find_lump_nested_namespace();
+  test_find_lump_pwad_stack();
+
+  /* lump views */
+  test_lump_view_in_bounds();
+  test_lump_view_out_of_bounds();
+  test_lump_view_empty();
 
   /* WAD struct layout */
   test_wadheader_size();
@@ -302,6 +630,11 @@ int main(void) {
   test_wadheader_identification_iwad();
   test_wadheader_identification_pwad();
 
+  /* directory bounds */
+  test_directory_fits();
+  test_directory_past_end();
+  test_directory_negative_count();
+
   printf("\n=== Test Results ===\n");
   printf("Passed: %d/%d\n", tests_passed, tests_total);
 
@@ -6,6 +6,9 @@
  *   - Input (dx, dy) is the wall direction vector.
  *   - Normal = (-dy, dx) normalised to unit length, packed into int8_t * 127.
  *   - Returns the length of the input vector (useful as a wall length).
+ *
+ * Also checks that the init_wall_vertex() macro from walls.c keeps each
+ * field of wall_vertex_t (map.h) where the vertex attributes read it.
  */
 
 #include <stdio.h>
@@ -44,6 +47,28 @@ static float compute_normal_packed(float dx, float dy, int8_t out[3]) {
   return length;
 }
 
+// Copied from map.h and walls.c, with a stand-in for the map it writes to
+typedef struct {
+  int16_t x, y, z;    // Position
+  int16_t u, v;       // Texture coordinates
+  int8_t nx, ny, nz;  // Normal
+  uint16_t surface;   // Floors: row in the flat surface table, see draw_floors
+  int32_t color;
+} wall_vertex_t;
+
+typedef struct {
+  struct {
+    wall_vertex_t vertices[16];
+    int num_vertices;
+  } walls;
+} test_map_t;
+
+#define init_wall_vertex(X, Y, Z, U, V) \
+write_line=true;\
+map->walls.vertices[map->walls.num_vertices++] = \
+(wall_vertex_t) {.x=X,.y=Y,.z=Z,.u=U*dist+u_offset,.v=V*height+v_offset,\
+.nx=n[0],.ny=n[1],.nz=n[2],.surface=0,.color=color}
+
 // ── Test helpers ─────────────────────────────────────────────────────────────
 
 static int tests_passed = 0;
@@ -211,6 +236,29 @@ static void test_opposite_directions_flip_normal(void) {
   PASS();
 }
 
+/* init_wall_vertex fills every field by name, so the line colour the editor
+ * draws with is not shifted into surface. */
+static void test_wall_vertex_keeps_color(void) {
+  TEST("init_wall_vertex stores color and clears surface");
+  test_map_t map_storage = {0};
+  test_map_t *map = &map_storage;
+  bool write_line = false;
+  float dist = 128, height = 64, u_offset = 8, v_offset = 4;
+  int8_t n[3];
+  compute_normal_packed(1.0f, 0.0f, n);
+  int32_t color = 0x00e0b000;
+  init_wall_vertex(16, -32, 96, 1.0f, 0.0f);
+  wall_vertex_t const *v = &map->walls.vertices[0];
+  ASSERT(write_line, "macro should mark the line as written");
+  ASSERT(map->walls.num_vertices == 1, "one vertex should be written");
+  ASSERT(v->color == 0x00e0b000, "color should survive");
+  ASSERT(v->surface == 0, "surface should start at 0");
+  ASSERT(v->x == 16 && v->y == -32 && v->z == 96, "position should be kept");
+  ASSERT(v->u == 136 && v->v == 4, "texture coordinates should be scaled and offset");
+  ASSERT(v->nx == n[0] && v->ny == n[1] && v->nz == n[2], "normal should be kept");
+  PASS();
+}
+
 // ── main ─────────────────────────────────────────────────────────────────────
 
 int main(void) {
@@ -226,6 +274,7 @@ int main(void) {
   test_scale_independence();
   test_z_component_always_zero();
   test_opposite_directions_flip_normal();
+  test_wall_vertex_keeps_color();
 
   printf("\n=== Test Results ===\n");
   printf("Passed: %d/%d\n", tests_passed, tests_total);